@@ -0,0 +1,102 @@
+# Builds the plugin at each clap-helpers checking level (see CLAP_SAW_DEMO_CHECKING_LEVEL) and
+# compares them using the headless bench (src/headless-host.cpp), so the cost of the checks
+# can be seen scenario by scenario.
+#
+# Run it through the checking-bench target of any configured build, or directly with
+#
+#     cmake [-DBUILD_ROOT=build-checking] [-DBENCH_SECONDS=10] [-DBUILD_TYPE=Release] \
+#           -P cmake/checking-bench.cmake
+#
+# Each level is built under BUILD_ROOT/<level> with the same build type (Release unless
+# BUILD_TYPE says otherwise, since that is where the checks would be shipped), benched, and
+# the ns/sample of every scenario printed side by side with the increase over None.
+
+cmake_minimum_required(VERSION 3.15)
+
+get_filename_component(default_source "${CMAKE_CURRENT_LIST_DIR}/.." ABSOLUTE)
+if (NOT SOURCE_DIR)
+    set(SOURCE_DIR "${default_source}")
+endif()
+if (NOT BUILD_ROOT)
+    set(BUILD_ROOT "${SOURCE_DIR}/build-checking")
+endif()
+if (NOT BENCH_SECONDS)
+    set(BENCH_SECONDS 10)
+endif()
+if (NOT BUILD_TYPE)
+    set(BUILD_TYPE Release)
+endif()
+get_filename_component(BUILD_ROOT "${BUILD_ROOT}" ABSOLUTE)
+
+set(levels None Minimal Maximal)
+
+set(configure_args -DCMAKE_BUILD_TYPE=${BUILD_TYPE})
+if (GENERATOR)
+    list(APPEND configure_args -G "${GENERATOR}")
+endif()
+if (C_COMPILER)
+    list(APPEND configure_args "-DCMAKE_C_COMPILER=${C_COMPILER}")
+endif()
+if (CXX_COMPILER)
+    list(APPEND configure_args "-DCMAKE_CXX_COMPILER=${CXX_COMPILER}")
+endif()
+
+function(run)
+    execute_process(COMMAND ${ARGN} RESULT_VARIABLE rv)
+    if (rv)
+        message(FATAL_ERROR "Failed (${rv}): ${ARGN}")
+    endif()
+endfunction()
+
+# Multi config generators put products in a subdirectory named for the build type
+function(product dir name outvar)
+    if (EXISTS "${dir}/${BUILD_TYPE}/${name}")
+        set(${outvar} "${dir}/${BUILD_TYPE}/${name}" PARENT_SCOPE)
+    else()
+        set(${outvar} "${dir}/${name}" PARENT_SCOPE)
+    endif()
+endfunction()
+
+foreach (level ${levels})
+    set(dir "${BUILD_ROOT}/${level}")
+    message(STATUS "Checking level ${level}: building in ${dir}")
+    run(${CMAKE_COMMAND} -S "${SOURCE_DIR}" -B "${dir}" ${configure_args}
+        -DCLAP_SAW_DEMO_CHECKING_LEVEL=${level})
+    run(${CMAKE_COMMAND} --build "${dir}" --config ${BUILD_TYPE}
+        --target clap-saw-demo-imgui clap-saw-demo-headless)
+
+    product("${dir}" clap-saw-demo-imgui.clap plugin)
+    product("${dir}" clap-saw-demo-headless host)
+    execute_process(COMMAND "${host}" "${plugin}" --seconds ${BENCH_SECONDS}
+                    RESULT_VARIABLE rv OUTPUT_VARIABLE out)
+    if (rv)
+        message(FATAL_ERROR "The bench failed (${rv}) on ${plugin}")
+    endif()
+    message("${out}")
+    string(REGEX MATCHALL "[a-z]+ +[0-9.]+ +[0-9.]+" lines_${level} "${out}")
+endforeach()
+
+# One row per scenario, with the increase over None in percent (math() is integer only)
+set(report "\nns/sample by checking level, ${BUILD_TYPE}\n")
+foreach (line ${lines_None})
+    string(REGEX REPLACE "^([a-z]+) +([0-9.]+).*" "\\1;\\2" parts "${line}")
+    list(GET parts 0 name)
+    list(GET parts 1 none)
+    string(REGEX REPLACE "\\." "" none_i "${none}")
+    string(APPEND report "  ${name}: None ${none}")
+    foreach (level Minimal Maximal)
+        foreach (oline ${lines_${level}})
+            if (oline MATCHES "^${name} +([0-9.]+)")
+                set(cost "${CMAKE_MATCH_1}")
+                string(REGEX REPLACE "\\." "" cost_i "${cost}")
+                math(EXPR pct "(${cost_i} * 100) / ${none_i} - 100")
+                if (pct GREATER_EQUAL 0)
+                    set(pct "+${pct}")
+                endif()
+                string(APPEND report ", ${level} ${cost} (${pct}%)")
+            endif()
+        endforeach()
+    endforeach()
+    string(APPEND report "\n")
+endforeach()
+message("${report}")
@@ -0,0 +1,138 @@
+# Builds a profile guided, link time optimized plugin and compares it against a plain Release
+# build using the headless bench (src/headless-host.cpp). GCC and Clang only.
+#
+# Run it through the pgo-build target of any configured build, or directly with
+#
+#     cmake [-DBUILD_ROOT=build-pgo] [-DTRAIN_SECONDS=10] [-DBENCH_SECONDS=10] \
+#           -P cmake/pgo-pipeline.cmake
+#
+# The steps are
+#
+# 1. BUILD_ROOT/baseline: a Release build with the default flags, benched
+# 2. BUILD_ROOT/pgo: the same with CLAP_SAW_DEMO_PGO=GENERATE, then trained by running the bench
+#    scenarios (real time and offline) against it, which writes BUILD_ROOT/profile
+# 3. For Clang, the raw profiles are merged with llvm-profdata
+# 4. BUILD_ROOT/pgo again, reconfigured with CLAP_SAW_DEMO_PGO=USE and CLAP_SAW_DEMO_LTO=ON,
+#    benched
+#
+# Step 4 rebuilds in the same directory as step 2 on purpose: GCC finds each object's profile
+# by the object's path.
+
+cmake_minimum_required(VERSION 3.15)
+
+get_filename_component(default_source "${CMAKE_CURRENT_LIST_DIR}/.." ABSOLUTE)
+if (NOT SOURCE_DIR)
+    set(SOURCE_DIR "${default_source}")
+endif()
+if (NOT BUILD_ROOT)
+    set(BUILD_ROOT "${SOURCE_DIR}/build-pgo")
+endif()
+if (NOT TRAIN_SECONDS)
+    set(TRAIN_SECONDS 10)
+endif()
+if (NOT BENCH_SECONDS)
+    set(BENCH_SECONDS 10)
+endif()
+get_filename_component(BUILD_ROOT "${BUILD_ROOT}" ABSOLUTE)
+set(profile_dir "${BUILD_ROOT}/profile")
+
+set(configure_args -DCMAKE_BUILD_TYPE=Release)
+if (GENERATOR)
+    list(APPEND configure_args -G "${GENERATOR}")
+endif()
+if (C_COMPILER)
+    list(APPEND configure_args "-DCMAKE_C_COMPILER=${C_COMPILER}")
+endif()
+if (CXX_COMPILER)
+    list(APPEND configure_args "-DCMAKE_CXX_COMPILER=${CXX_COMPILER}")
+endif()
+
+function(run)
+    execute_process(COMMAND ${ARGN} RESULT_VARIABLE rv)
+    if (rv)
+        message(FATAL_ERROR "Failed (${rv}): ${ARGN}")
+    endif()
+endfunction()
+
+function(build dir)
+    run(${CMAKE_COMMAND} -S "${SOURCE_DIR}" -B "${dir}" ${configure_args} ${ARGN})
+    run(${CMAKE_COMMAND} --build "${dir}" --config Release
+        --target clap-saw-demo-imgui clap-saw-demo-headless)
+endfunction()
+
+# Multi config generators put products in a Release subdirectory
+function(product dir name outvar)
+    if (EXISTS "${dir}/Release/${name}")
+        set(${outvar} "${dir}/Release/${name}" PARENT_SCOPE)
+    else()
+        set(${outvar} "${dir}/${name}" PARENT_SCOPE)
+    endif()
+endfunction()
+
+function(bench dir seconds outvar)
+    product("${dir}" clap-saw-demo-imgui.clap plugin)
+    product("${dir}" clap-saw-demo-headless host)
+    execute_process(COMMAND "${host}" "${plugin}" --seconds ${seconds} ${ARGN}
+                    RESULT_VARIABLE rv OUTPUT_VARIABLE out)
+    if (rv)
+        message(FATAL_ERROR "The bench failed (${rv}) on ${plugin}")
+    endif()
+    message("${out}")
+    set(${outvar} "${out}" PARENT_SCOPE)
+endfunction()
+
+message(STATUS "PGO step 1: baseline Release build")
+build("${BUILD_ROOT}/baseline" -DCLAP_SAW_DEMO_PGO=OFF -DCLAP_SAW_DEMO_LTO=OFF)
+bench("${BUILD_ROOT}/baseline" ${BENCH_SECONDS} baseline)
+
+message(STATUS "PGO step 2: instrumented build and training")
+file(REMOVE_RECURSE "${profile_dir}")
+build("${BUILD_ROOT}/pgo" -DCLAP_SAW_DEMO_PGO=GENERATE "-DCLAP_SAW_DEMO_PGO_DIR=${profile_dir}"
+      -DCLAP_SAW_DEMO_LTO=OFF)
+bench("${BUILD_ROOT}/pgo" ${TRAIN_SECONDS} ignored)
+bench("${BUILD_ROOT}/pgo" ${TRAIN_SECONDS} ignored --offline)
+
+file(GLOB raw_profiles "${profile_dir}/*.profraw")
+if (raw_profiles)
+    message(STATUS "PGO step 3: merging Clang profiles")
+    find_program(LLVM_PROFDATA NAMES llvm-profdata)
+    if (NOT LLVM_PROFDATA AND APPLE)
+        execute_process(COMMAND xcrun -f llvm-profdata OUTPUT_VARIABLE LLVM_PROFDATA
+                        OUTPUT_STRIP_TRAILING_WHITESPACE)
+    endif()
+    if (NOT LLVM_PROFDATA)
+        message(FATAL_ERROR "Clang profiles need llvm-profdata, which wasn't found")
+    endif()
+    run("${LLVM_PROFDATA}" merge -o "${profile_dir}/default.profdata" ${raw_profiles})
+endif()
+
+message(STATUS "PGO step 4: optimized build with the profile and LTO")
+build("${BUILD_ROOT}/pgo" -DCLAP_SAW_DEMO_PGO=USE "-DCLAP_SAW_DEMO_PGO_DIR=${profile_dir}"
+      -DCLAP_SAW_DEMO_LTO=ON)
+bench("${BUILD_ROOT}/pgo" ${BENCH_SECONDS} optimized)
+
+# Pair up the scenario lines of the two benches
+function(scenario_costs text outvar)
+    string(REGEX MATCHALL "[a-z]+ +[0-9.]+ +[0-9.]+" lines "${text}")
+    set(${outvar} "${lines}" PARENT_SCOPE)
+endfunction()
+scenario_costs("${baseline}" base_lines)
+scenario_costs("${optimized}" opt_lines)
+
+set(report "\nns/sample, baseline -> PGO+LTO\n")
+foreach (line ${base_lines})
+    string(REGEX REPLACE "^([a-z]+) +([0-9.]+).*" "\\1;\\2" parts "${line}")
+    list(GET parts 0 name)
+    list(GET parts 1 base)
+    foreach (oline ${opt_lines})
+        if (oline MATCHES "^${name} +([0-9.]+)")
+            set(opt "${CMAKE_MATCH_1}")
+            # math() is integer only, so the speedup is in percent
+            string(REGEX REPLACE "\\." "" base_i "${base}")
+            string(REGEX REPLACE "\\." "" opt_i "${opt}")
+            math(EXPR pct "(${base_i} * 100) / ${opt_i} - 100")
+            string(APPEND report "  ${name}: ${base} -> ${opt} (${pct}% faster)\n")
+        endif()
+    endforeach()
+endforeach()
+message("${report}")
@@ -0,0 +1,71 @@
+/*
+ * ClapSawDemo
+ * https://github.com/surge-synthesizer/clap-saw-demo
+ *
+ * Copyright 2022 Paul Walker and others as listed in the git history
+ *
+ * Released under the MIT License. See LICENSE.md for full text.
+ */
+
+#ifndef CLAP_SAW_DEMO_ALIGNED_BUFFER_H
+#define CLAP_SAW_DEMO_ALIGNED_BUFFER_H
+
+/*
+ * A heap array of floats whose start is on a cache line, for scratch the audio thread works
+ * in (see ClapSawDemo::activate). It is allocated and freed on the main thread only.
+ *
+ * This over-allocates and aligns by hand rather than using C++17 aligned new, since the
+ * aligned operator new isn't available in libc++ before macOS 10.14 and we deploy to 10.11.
+ */
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+
+namespace sst::clap_saw_demo
+{
+struct AlignedBuffer
+{
+    static constexpr size_t alignment = 64;
+    // Floats per cache line, which is what callers round their strides up to
+    static constexpr size_t lineFloats = alignment / sizeof(float);
+    static constexpr size_t roundUp(size_t n)
+    {
+        return (n + lineFloats - 1) / lineFloats * lineFloats;
+    }
+
+    // n zeroed floats. Returns false (and holds nothing) if the allocation fails.
+    bool allocate(size_t n) noexcept
+    {
+        release();
+        storage.reset(new (std::nothrow) unsigned char[n * sizeof(float) + alignment]);
+        if (!storage)
+            return false;
+
+        auto p = reinterpret_cast<uintptr_t>(storage.get());
+        ptr = reinterpret_cast<float *>((p + alignment - 1) & ~(uintptr_t)(alignment - 1));
+        count = n;
+        std::fill(ptr, ptr + count, 0.f);
+        return true;
+    }
+
+    void release() noexcept
+    {
+        storage.reset();
+        ptr = nullptr;
+        count = 0;
+    }
+
+    float *data() const noexcept { return ptr; }
+    size_t size() const noexcept { return count; }
+
+  private:
+    std::unique_ptr<unsigned char[]> storage;
+    float *ptr{nullptr};
+    size_t count{0};
+};
+} // namespace sst::clap_saw_demo
+
+#endif // CLAP_SAW_DEMO_ALIGNED_BUFFER_H
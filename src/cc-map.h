@@ -0,0 +1,102 @@
+/*
+ * ClapSawDemo
+ * https://github.com/surge-synthesizer/clap-saw-demo
+ *
+ * Copyright 2022 Paul Walker and others as listed in the git history
+ *
+ * Released under the MIT License. See LICENSE.md for full text.
+ */
+
+#ifndef CLAP_SAW_DEMO_CC_MAP_H
+#define CLAP_SAW_DEMO_CC_MAP_H
+
+/*
+ * Which parameter, if any, each MIDI CC on each channel drives. Controllers can send CCs
+ * in their thousands a second, so finding the mapping is one index into a flat 16 x 128
+ * table with no searching, and an unmapped CC costs a load and a compare.
+ *
+ * Each entry is a single 32 bit atomic: the parameter's index in paramIdList plus one
+ * (zero for none) in the top byte, then where CC 0 and CC 127 land within the parameter's
+ * range, each as 12 bits from 0 to 1. Swapping them turns the controller around. Being one
+ * word, an entry can be read on the audio thread while MIDI learn (audio thread), the
+ * editor or a state load (main thread) replaces it, and no reader ever sees half of one.
+ *
+ * In the saved state each mapping is an item CC-<channel>-<cc>=<param id>,<lo>,<hi> which
+ * versions before this one skip.
+ */
+
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+
+namespace sst::clap_saw_demo
+{
+struct CCMap
+{
+    static constexpr int nChannels = 16, nCCs = 128;
+    static constexpr uint32_t scaleMax = 4095;
+
+    struct Mapping
+    {
+        int param{-1}; // index in paramIdList, or -1 for unmapped
+        float lo{0.f}, hi{1.f};
+    };
+
+    static constexpr int slot(int channel, int cc) { return channel * nCCs + cc; }
+
+    static uint32_t pack(const Mapping &m)
+    {
+        if (m.param < 0 || m.param > 254)
+            return 0;
+        auto q = [](float f)
+        { return (uint32_t)std::lround(std::fmin(std::fmax(f, 0.f), 1.f) * scaleMax); };
+        return ((uint32_t)(m.param + 1) << 24) | (q(m.lo) << 12) | q(m.hi);
+    }
+    static Mapping unpack(uint32_t e)
+    {
+        Mapping m;
+        m.param = (int)(e >> 24) - 1;
+        m.lo = (float)((e >> 12) & scaleMax) / scaleMax;
+        m.hi = (float)(e & scaleMax) / scaleMax;
+        return m;
+    }
+
+    uint32_t raw(int channel, int cc) const
+    {
+        return entries[slot(channel, cc)].load(std::memory_order_relaxed);
+    }
+    Mapping get(int channel, int cc) const { return unpack(raw(channel, cc)); }
+    void set(int channel, int cc, const Mapping &m)
+    {
+        entries[slot(channel, cc)].store(pack(m), std::memory_order_relaxed);
+    }
+    void clear(int channel, int cc)
+    {
+        entries[slot(channel, cc)].store(0, std::memory_order_relaxed);
+    }
+    void clearAll()
+    {
+        for (auto &e : entries)
+            e.store(0, std::memory_order_relaxed);
+    }
+
+    // Unmap every CC which drives param
+    void forget(int param)
+    {
+        for (auto &e : entries)
+            if ((int)(e.load(std::memory_order_relaxed) >> 24) == param + 1)
+                e.store(0, std::memory_order_relaxed);
+    }
+    // MIDI learn: this CC now drives param over its whole range, and nothing else does
+    void learn(int channel, int cc, int param)
+    {
+        forget(param);
+        set(channel, cc, {param, 0.f, 1.f});
+    }
+
+  private:
+    std::atomic<uint32_t> entries[nChannels * nCCs]{};
+};
+} // namespace sst::clap_saw_demo
+
+#endif // CLAP_SAW_DEMO_CC_MAP_H
@@ -9,6 +9,8 @@
 #include "imgui.h"
 
 #include <clap/helpers/host-proxy.hxx>
+#include <algorithm>
+#include <cmath>
 
 #define STR_INDIR(x) #x
 #define STR(x) STR_INDIR(x)
@@ -53,7 +55,18 @@ bool ClapSawDemo::guiCreate(const char *api, bool isFloating) noexcept
 {
     _DBGMARK;
     assert(!editor);
-    editor = new ClapSawDemoEditor(toUiQ, fromUiQ, dataCopyForUI, [this]() { editorParamsFlush(); });
+    auto queues = uiQueues.load(std::memory_order_relaxed);
+    if (!queues)
+    {
+        queues = new UIQueues();
+        uiQueues.store(queues, std::memory_order_release);
+    }
+    editor = new ClapSawDemoEditor(
+        queues->toUiQ, queues->fromUiQ, dataCopyForUI, ccMap,
+        [this]() { editorParamsFlush(); },
+        [this](const std::string &scl, const std::string &kbm, std::string &error)
+        { return loadTuning(scl, kbm, error); });
+    editor->setTuningPaths(tuningSclPath, tuningKbmPath);
     const clap_host_timer_support_t *timer{nullptr};
     _host.getExtension(timer, CLAP_EXT_TIMER_SUPPORT);
     return imgui_clap_guiCreateWith(editor, timer);
@@ -71,6 +84,11 @@ void ClapSawDemo::guiDestroy() noexcept
     imgui_clap_guiDestroyWith(editor, timer);
     delete editor;
     editor = nullptr;
+
+    // If we aren't active no audio thread can be looking at the queues, so release them
+    // now. Otherwise deactivate will.
+    if (!isActive())
+        releaseUIQueues();
 }
 
 /*
@@ -94,13 +112,13 @@ bool ClapSawDemo::guiSetParent(const clap_window *window) noexcept
     else
     {
         // Pull the parameters on the main thread
-        for (const auto &[k, v] : paramToValue)
+        for (auto k : paramIdList)
         {
             auto r = ToUI();
             r.type = ToUI::PARAM_VALUE;
             r.id = k;
-            r.value = *v;
-            toUiQ.try_enqueue(r);
+            r.value = *paramValuePtr(k);
+            uiQueues.load(std::memory_order_relaxed)->toUiQ.try_enqueue(r);
         }
     }
     // And we are done!
@@ -118,7 +136,7 @@ bool ClapSawDemo::guiSetParent(const clap_window *window) noexcept
  */
 bool ClapSawDemo::guiSetScale(double scale) noexcept
 {
-    _DBGCOUT << _D(scale) << std::endl;
+    _DBGLOG(Debug, "scale={}", scale);
     return false;
 }
 
@@ -128,7 +146,7 @@ bool ClapSawDemo::guiSetScale(double scale) noexcept
  */
 bool ClapSawDemo::guiSetSize(uint32_t width, uint32_t height) noexcept
 {
-    _DBGCOUT << _D(width) << _D(height) << std::endl;
+    _DBGLOG(Debug, "width={} height={}", width, height);
     assert(editor);
     return imgui_clap_guiSetSizeWith(editor, width, height);
 }
@@ -152,12 +170,21 @@ bool ClapSawDemo::guiAdjustSize(uint32_t *width, uint32_t *height) noexcept
 
 ClapSawDemoEditor::ClapSawDemoEditor(ClapSawDemo::SynthToUI_Queue_t &i,
                                      ClapSawDemo::UIToSynth_Queue_t &o,
-                                     const ClapSawDemo::DataCopyForUI &d, std::function<void()> pf)
-: inbound(i), outbound(o), synthData(d), paramRequestFlush(std::move(pf))
+                                     const ClapSawDemo::DataCopyForUI &d, const CCMap &cc,
+                                     std::function<void()> pf, TuningLoader_t tl)
+: inbound(i), outbound(o), synthData(d), ccMap(cc), paramRequestFlush(std::move(pf)),
+  tuningLoader(std::move(tl))
 {
 
 }
 
+void ClapSawDemoEditor::setTuningPaths(const std::string &scl, const std::string &kbm)
+{
+    strncpy(sclPath, scl.c_str(), sizeof(sclPath) - 1);
+    strncpy(kbmPath, kbm.c_str(), sizeof(kbmPath) - 1);
+    tuningStatus = (scl.empty() && kbm.empty()) ? "Standard tuning" : "Loaded";
+}
+
 void ClapSawDemoEditor::addSliderForParam(clap_id pid, const char* label, float min, float max)
 {
     float co = paramCopy[pid];
@@ -255,9 +282,170 @@ void ClapSawDemoEditor::dequeueParamUpdates()
     }
 }
 
+/*
+ * All 128 keys, from the bitmaps the engine publishes each block (see key-state.h). A held
+ * key is lit more strongly the harder it was played; a key which is only sounding, in its
+ * release say, is lit faintly.
+ */
+void ClapSawDemoEditor::drawKeyboard()
+{
+    static constexpr bool isBlack[12]{false, true,  false, true,  false, false,
+                                      true,  false, true,  false, true,  false};
+    static constexpr int nWhite = 75; // of the 128 keys
+    const auto &keys = synthData.keys;
+
+    auto *dl = ImGui::GetWindowDrawList();
+    auto origin = ImGui::GetCursorScreenPos();
+    auto width = ImGui::GetContentRegionAvail().x;
+    auto whiteW = width / nWhite, blackW = whiteW * 0.6f, height = 28.f, blackH = height * 0.6f;
+
+    auto light = [&](int key, ImVec2 a, ImVec2 b)
+    {
+        if (keys.isHeld(key))
+        {
+            auto v = keys.velocity[key].load(std::memory_order_relaxed) / 127.f;
+            dl->AddRectFilled(a, b, ImColor(0.26f, 0.59f, 0.98f, 0.4f + 0.6f * v));
+        }
+        else if (keys.isSounding(key))
+        {
+            dl->AddRectFilled(a, b, ImColor(0.26f, 0.59f, 0.98f, 0.25f));
+        }
+    };
+
+    // White keys first, then the black ones over them
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        int w{0};
+        for (int key = 0; key < KeyState::nKeys; ++key)
+        {
+            auto black = isBlack[key % 12];
+            if (!black)
+                w++;
+            if (black != (pass == 1))
+                continue;
+
+            auto x = origin.x + (black ? w * whiteW - blackW * 0.5f : (w - 1) * whiteW);
+            auto a = ImVec2(x, origin.y);
+            auto b = ImVec2(x + (black ? blackW : whiteW), origin.y + (black ? blackH : height));
+            dl->AddRectFilled(a, b, black ? ImColor(0.1f, 0.1f, 0.1f) : ImColor(0.9f, 0.9f, 0.9f));
+            light(key, a, b);
+            if (!black)
+                dl->AddRect(a, b, ImColor(0.3f, 0.3f, 0.3f));
+        }
+    }
+    ImGui::Dummy(ImVec2(width, height));
+}
+
+/*
+ * A cell per voice from the latest telemetry snapshot, lit by its envelope level: blue while
+ * held, amber in its release. Then the block's peak, the oldest voice and the steals.
+ */
+void ClapSawDemoEditor::drawVoices()
+{
+    auto *dl = ImGui::GetWindowDrawList();
+    auto origin = ImGui::GetCursorScreenPos();
+    auto width = ImGui::GetContentRegionAvail().x;
+    auto cellW = width / ClapSawDemo::max_voices, height = 8.f;
+
+    uint32_t oldest{0};
+    for (int i = 0; i < ClapSawDemo::max_voices; ++i)
+    {
+        const auto &v = telemetry.voices[i];
+        auto a = ImVec2(origin.x + i * cellW, origin.y);
+        auto b = ImVec2(a.x + cellW - 1.f, origin.y + height);
+        dl->AddRectFilled(a, b, ImColor(0.2f, 0.2f, 0.2f));
+        if (v.state == SawDemoVoice::OFF)
+            continue;
+
+        auto l = 0.2f + 0.8f * std::clamp(v.level, 0.f, 1.f);
+        if (v.state == SawDemoVoice::RELEASING || v.state == SawDemoVoice::NEWLY_OFF)
+            dl->AddRectFilled(a, b, ImColor(0.98f, 0.65f, 0.2f, l));
+        else
+            dl->AddRectFilled(a, b, ImColor(0.26f, 0.59f, 0.98f, l));
+        oldest = std::max(oldest, v.age);
+    }
+    ImGui::Dummy(ImVec2(width, height));
+
+    auto peakDb = telemetry.peak > 0 ? 20 * std::log10(telemetry.peak) : -144.f;
+    ImGui::Text("Peak %.1f dBFS, oldest voice %.1f s, %llu steals", peakDb,
+                telemetry.sampleRate > 0 ? oldest / telemetry.sampleRate : 0.f,
+                (unsigned long long)telemetry.steals);
+}
+
+/*
+ * MIDI learn: pick a parameter and press Learn, and the next CC the synth gets drives it.
+ * Below that, every CC mapped so far, each with a button to forget it. The table is the
+ * engine's own, read straight from its atomics (see cc-map.h).
+ */
+void ClapSawDemoEditor::drawMidiLearn()
+{
+    // In paramIdList order
+    static constexpr const char *names[ClapSawDemo::nParams]{
+        "uni count",  "uni spread", "osc detune", "Attack",     "Release",     "Amp Envelope",
+        "VCA",        "cutoff",     "resonance",  "Filter",     "Decay",       "Sustain",
+        "lfo rate",   "lfo shape",  "lfo pitch",  "lfo cutoff", "lfo vca",     "env attack",
+        "env decay",  "env sustain", "env release", "env amount"};
+
+    auto send = [this](ClapSawDemo::FromUI::MType type, uint32_t id)
+    {
+        auto q = ClapSawDemo::FromUI();
+        q.type = type;
+        q.id = id;
+        q.value = 0;
+        outbound.try_enqueue(q);
+    };
+
+    ImGui::Text("MIDI CC");
+    ImGui::Combo("##learnParam", &learnChoice, names, ClapSawDemo::nParams);
+    ImGui::SameLine();
+    if (learning < 0)
+    {
+        if (ImGui::Button("Learn"))
+        {
+            learning = learnChoice;
+            learnCleared = false;
+            send(ClapSawDemo::FromUI::LEARN_CC, ClapSawDemo::paramIdList[learning]);
+        }
+    }
+    else if (ImGui::Button("Cancel"))
+    {
+        learning = -1;
+        send(ClapSawDemo::FromUI::LEARN_CC, CLAP_INVALID_ID);
+    }
+
+    // The engine drops the parameter's old mapping when it arms, so learning is done once
+    // that has gone and a new one is there
+    bool learnMapped{false};
+    for (int ch = 0; ch < CCMap::nChannels; ++ch)
+    {
+        for (int cc = 0; cc < CCMap::nCCs; ++cc)
+        {
+            auto m = ccMap.get(ch, cc);
+            if (m.param < 0)
+                continue;
+            learnMapped = learnMapped || m.param == learning;
+
+            ImGui::Text("Ch %d CC %d: %s", ch + 1, cc, names[m.param]);
+            ImGui::SameLine();
+            auto label = "Forget##" + std::to_string(CCMap::slot(ch, cc));
+            if (ImGui::Button(label.c_str()))
+                send(ClapSawDemo::FromUI::FORGET_CC, (uint32_t)CCMap::slot(ch, cc));
+        }
+    }
+    if (learning >= 0 && !learnMapped)
+        learnCleared = true;
+    else if (learning >= 0 && learnCleared)
+        learning = -1;
+    if (learning >= 0)
+        ImGui::Text("Move a controller to map it to %s", names[learning]);
+}
+
 void ClapSawDemoEditor::onRender()
 {
+    _TRACE_SCOPE("editorFrame");
     dequeueParamUpdates(); // Do not remove this
+    synthData.telemetry.read(telemetry);
+    rtlog::drainToStdout(); // we are on the main thread, so flush any deferred log records
 
     ImGuiIO& io = ImGui::GetIO(); (void)io;
     
@@ -283,7 +471,9 @@ void ClapSawDemoEditor::onRender()
     
     // PARAMETER UI
     
-    ImGui::Text("Osc (Polyphony %d)", (int)synthData.polyphony);
+    ImGui::Text("Osc (Polyphony %d)", (int)telemetry.active);
+    drawKeyboard();
+    drawVoices();
 
     addSliderForParam(ClapSawDemo::pmUnisonCount, "uni count", 1, SawDemoVoice::max_uni);
     addSliderForParam(ClapSawDemo::pmUnisonSpread, "uni spread", 0, 100);
@@ -296,6 +486,8 @@ void ClapSawDemoEditor::onRender()
     
     ImGui::BeginDisabled(paramCopy[ClapSawDemo::pmAmpIsGate] > 0.5f);
     addSliderForParam(ClapSawDemo::pmAmpAttack, "Attack", 0, 1);
+    addSliderForParam(ClapSawDemo::pmAmpDecay, "Decay", 0, 1);
+    addSliderForParam(ClapSawDemo::pmAmpSustain, "Sustain", 0, 1);
     addSliderForParam(ClapSawDemo::pmAmpRelease, "Release", 0, 1);
     ImGui::EndDisabled();
     
@@ -304,18 +496,91 @@ void ClapSawDemoEditor::onRender()
     ImGui::Text("Filter");
     
     addRadioButtonForParam(ClapSawDemo::pmFilterMode, {
-        { SawDemoVoice::StereoSimperSVF::Mode::LP, "LP"},
-        { SawDemoVoice::StereoSimperSVF::Mode::BP, "BP"},
-        { SawDemoVoice::StereoSimperSVF::Mode::HP, "HP"},
-        { SawDemoVoice::StereoSimperSVF::Mode::NOTCH, "Notch"},
-        { SawDemoVoice::StereoSimperSVF::Mode::PEAK, "Peak"},
-        { SawDemoVoice::StereoSimperSVF::Mode::ALL, "All"} } );
+        { StereoFilter::LP, "LP"},
+        { StereoFilter::BP, "BP"},
+        { StereoFilter::HP, "HP"},
+        { StereoFilter::NOTCH, "Notch"},
+        { StereoFilter::PEAK, "Peak"},
+        { StereoFilter::ALL, "All"} } );
+    addRadioButtonForParam(ClapSawDemo::pmFilterMode, {
+        { StereoFilter::LADDER, "Ladder"},
+        { StereoFilter::OB_LP, "OB LP"},
+        { StereoFilter::OB_BP, "OB BP"},
+        { StereoFilter::OB_HP, "OB HP"} } );
     
     addSliderForParam(ClapSawDemo::pmCutoff, "cutoff", 1, 127);
     addSliderForParam(ClapSawDemo::pmResonance, "resonance", 0, 1);
 
+    ImGui::Text("Filter Envelope");
+
+    addSliderForParam(ClapSawDemo::pmFegToCutoff, "env amount", -96, 96);
+    addSliderForParam(ClapSawDemo::pmFegAttack, "env attack", 0, 1);
+    addSliderForParam(ClapSawDemo::pmFegDecay, "env decay", 0, 1);
+    addSliderForParam(ClapSawDemo::pmFegSustain, "env sustain", 0, 1);
+    addSliderForParam(ClapSawDemo::pmFegRelease, "env release", 0, 1);
+
+    ImGui::Separator();
+
+    ImGui::Text("LFO");
+
+    addRadioButtonForParam(ClapSawDemo::pmLfoShape, {
+        { lfoSine, "Sine"},
+        { lfoTriangle, "Tri"},
+        { lfoSaw, "Saw"},
+        { lfoSquare, "Square"} } );
+    addSliderForParam(ClapSawDemo::pmLfoRate, "lfo rate", 0.01, 20);
+    addSliderForParam(ClapSawDemo::pmLfoToPitch, "lfo pitch", -12, 12);
+    addSliderForParam(ClapSawDemo::pmLfoToCutoff, "lfo cutoff", -60, 60);
+    addSliderForParam(ClapSawDemo::pmLfoToVCA, "lfo vca", 0, 1);
+
     ImGui::Separator();
 
+    drawMidiLearn();
+
+    ImGui::Separator();
+
+    ImGui::Text("Tuning");
+
+    ImGui::InputText(".scl", sclPath, sizeof(sclPath));
+    ImGui::InputText(".kbm", kbmPath, sizeof(kbmPath));
+    if (ImGui::Button("Load Tuning"))
+    {
+        std::string error;
+        if (tuningLoader(sclPath, kbmPath, error))
+            tuningStatus = (sclPath[0] == 0 && kbmPath[0] == 0) ? "Standard tuning" : "Loaded";
+        else
+            tuningStatus = error;
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Standard Tuning"))
+    {
+        std::string error;
+        sclPath[0] = 0;
+        kbmPath[0] = 0;
+        tuningLoader("", "", error);
+        tuningStatus = "Standard tuning";
+    }
+    ImGui::TextWrapped("%s", tuningStatus.c_str());
+
+    ImGui::Separator();
+
+    // How often the voices skipped work nobody would hear; see SawDemoVoice::EarlyOut
+    ImGui::Text("Skipped: %llu silent VCA runs, %llu early releases",
+                (unsigned long long)synthData.earlyOuts[SawDemoVoice::eoSilentVCA].load(),
+                (unsigned long long)synthData.earlyOuts[SawDemoVoice::eoReleaseCut].load());
+
+    ImGui::Separator();
+
+#if CLAP_SAW_DEMO_TRACE
+    if (ImGui::Button("Dump Perf Trace"))
+    {
+        perftrace::dumpChromeTrace(perftrace::defaultTracePath());
+    }
+    ImGui::SameLine();
+    ImGui::Text("%s", perftrace::defaultTracePath());
+    ImGui::Separator();
+#endif
+
     // FOOTER
     
     std::string footerStr = "CLAP v";
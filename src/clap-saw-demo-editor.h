@@ -13,8 +13,14 @@ namespace sst::clap_saw_demo
 
 struct ClapSawDemoEditor : public imgui_clap_editor
 {
+    // The tuning loader is called on the UI (main) thread with the scl and kbm paths. It
+    // returns false and fills in the error if the files couldn't be loaded.
+    typedef std::function<bool(const std::string &, const std::string &, std::string &)>
+        TuningLoader_t;
+
     ClapSawDemoEditor(ClapSawDemo::SynthToUI_Queue_t &, ClapSawDemo::UIToSynth_Queue_t &,
-                      const ClapSawDemo::DataCopyForUI &, std::function<void()>);
+                      const ClapSawDemo::DataCopyForUI &, const CCMap &, std::function<void()>,
+                      TuningLoader_t);
     
     // Write your ImGui Code here
     void onRender() override;
@@ -34,8 +40,26 @@ struct ClapSawDemoEditor : public imgui_clap_editor
     ClapSawDemo::SynthToUI_Queue_t &inbound;
     ClapSawDemo::UIToSynth_Queue_t &outbound;
     const ClapSawDemo::DataCopyForUI &synthData;
+    const CCMap &ccMap;
     std::function<void()> paramRequestFlush;
+
+    // Tuning file UI
+    void setTuningPaths(const std::string &scl, const std::string &kbm);
+    TuningLoader_t tuningLoader;
+    char sclPath[1024]{0}, kbmPath[1024]{0};
+    std::string tuningStatus;
     
+    // the live keyboard and voices under the polyphony count
+    void drawKeyboard();
+    void drawVoices();
+    // MIDI learn; learning is the paramIdList index waiting for a CC, or -1
+    void drawMidiLearn();
+    int learnChoice{0}, learning{-1};
+    bool learnCleared{false};
+
+    // the engine's latest Telemetry, read once a frame
+    ClapSawDemo::Telemetry telemetry{};
+
     // update the parameter state for UI, has to be called each frame
     void dequeueParamUpdates();
 
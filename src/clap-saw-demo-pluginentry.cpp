@@ -18,6 +18,7 @@
  */
 
 #include "clap-saw-demo.h"
+#include "dsp-tables.h"
 
 #include <iostream>
 #include <cmath>
@@ -55,9 +56,19 @@ const CLAP_EXPORT struct clap_plugin_factory clap_saw_demo_factory = {
 };
 static const void *get_factory(const char *factory_id) { return (!strcmp(factory_id,CLAP_PLUGIN_FACTORY_ID)) ? &clap_saw_demo_factory : nullptr; }
 
-// clap_init and clap_deinit are required to be fast, but we have nothing we need to do here
-bool clap_init(const char *p) { return true; }
-void clap_deinit() {}
+/*
+ * clap_init and clap_deinit are required to be fast. All we do here is build the
+ * process wide note-to-frequency and unison layout tables (a few hundred pow and
+ * cos/sin calls) which every instance shares, and release the per-sample-rate tables the
+ * instances built at activate.
+ */
+bool clap_init(const char *p)
+{
+    noteFrequencyTable();
+    unisonLayoutTable();
+    return true;
+}
+void clap_deinit() { releaseDspTables(); }
 
 } // namespace sst::clap_saw_demo::pluginentry
 
@@ -5,9 +5,16 @@
  */
 
 #include "clap-saw-demo.h"
+#include "denormals.h"
+#include "fast-math.h"
+#include "param-text.h"
 #include <iostream>
 #include <cmath>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <initializer_list>
+#include <iterator>
 
 // Eject the core symbols for the plugin
 #include <clap/helpers/plugin.hh>
@@ -15,28 +22,30 @@
 #include <clap/helpers/host-proxy.hh>
 #include <clap/helpers/host-proxy.hxx>
 #include <iomanip>
+#include <fstream>
 #include <locale>
 
 namespace sst::clap_saw_demo
 {
 
 ClapSawDemo::ClapSawDemo(const clap_host *host)
-    : clap::helpers::Plugin<clap::helpers::MisbehaviourHandler::Terminate,
-                            clap::helpers::CheckingLevel::Maximal>(&desc, host)
+    : ClapSawDemoBase(&desc, host)
 {
-    _DBGCOUT << "Constructing ClapSawDemo" << std::endl;
-    paramToValue[pmUnisonCount] = &unisonCount;
-    paramToValue[pmUnisonSpread] = &unisonSpread;
-    paramToValue[pmOscDetune] = &oscDetune;
-    paramToValue[pmAmpAttack] = &ampAttack;
-    paramToValue[pmAmpRelease] = &ampRelease;
-    paramToValue[pmAmpIsGate] = &ampIsGate;
-    paramToValue[pmCutoff] = &cutoff;
-    paramToValue[pmResonance] = &resonance;
-    paramToValue[pmPreFilterVCA] = &preFilterVCA;
-    paramToValue[pmFilterMode] = &filterMode;
-
-    terminatedVoices.reserve(max_voices * 4);
+    _DBGLOG(Debug, "Constructing ClapSawDemo (clap-helpers checking level {})",
+            CLAP_SAW_DEMO_CHECKING_LEVEL);
+    currentTuning = new TuningTable();
+
+    for (uint32_t i = 0; i < nParams; ++i)
+    {
+        clap_param_info info{};
+        if (paramsInfo(i, &info))
+            paramRanges[i] = {info.min_value, info.max_value,
+                              (info.flags & CLAP_PARAM_IS_STEPPED) != 0};
+    }
+
+    recorder = EventRecorder::fromEnvironment();
+    if (recorder)
+        _DBGLOG(Info, "Recording events to {}", std::getenv("CLAP_SAW_DEMO_RECORD"));
 }
 ClapSawDemo::~ClapSawDemo()
 {
@@ -44,6 +53,21 @@ ClapSawDemo::~ClapSawDemo()
     // with an open window but
     if (editor)
         guiDestroy();
+    releaseUIQueues();
+
+    delete currentTuning;
+    delete pendingTuning.exchange(nullptr);
+    delete retiredTuning.exchange(nullptr);
+
+    if (recorder && recorder->dropped > 0)
+        _DBGLOG(Warn, "Event recorder dropped {} records", (uint64_t)recorder->dropped);
+    recorder.reset();
+
+    rtlog::drainToStdout();
+
+#if CLAP_SAW_DEMO_TRACE
+    perftrace::dumpChromeTrace(perftrace::defaultTracePath());
+#endif
 }
 
 const char *features[] = {CLAP_PLUGIN_FEATURE_INSTRUMENT, CLAP_PLUGIN_FEATURE_SYNTHESIZER, nullptr};
@@ -60,6 +84,58 @@ clap_plugin_descriptor ClapSawDemo::desc = {CLAP_VERSION,
 /*
  * PARAMETER SETUP SECTION
  */
+double *ClapSawDemo::paramValuePtr(clap_id paramId) noexcept
+{
+    switch (paramId)
+    {
+    case pmUnisonCount:
+        return &unisonCount;
+    case pmUnisonSpread:
+        return &unisonSpread;
+    case pmOscDetune:
+        return &oscDetune;
+    case pmAmpAttack:
+        return &ampAttack;
+    case pmAmpDecay:
+        return &ampDecay;
+    case pmAmpSustain:
+        return &ampSustain;
+    case pmAmpRelease:
+        return &ampRelease;
+    case pmAmpIsGate:
+        return &ampIsGate;
+    case pmCutoff:
+        return &cutoff;
+    case pmResonance:
+        return &resonance;
+    case pmPreFilterVCA:
+        return &preFilterVCA;
+    case pmFilterMode:
+        return &filterMode;
+    case pmLfoRate:
+        return &lfoRate;
+    case pmLfoShape:
+        return &lfoShape;
+    case pmLfoToPitch:
+        return &lfoToPitch;
+    case pmLfoToCutoff:
+        return &lfoToCutoff;
+    case pmLfoToVCA:
+        return &lfoToVCA;
+    case pmFegAttack:
+        return &fegAttack;
+    case pmFegDecay:
+        return &fegDecay;
+    case pmFegSustain:
+        return &fegSustain;
+    case pmFegRelease:
+        return &fegRelease;
+    case pmFegToCutoff:
+        return &fegToCutoff;
+    }
+    return nullptr;
+}
+
 bool ClapSawDemo::paramsInfo(uint32_t paramIndex, clap_param_info *info) const noexcept
 {
     if (paramIndex >= nParams)
@@ -114,6 +190,7 @@ bool ClapSawDemo::paramsInfo(uint32_t paramIndex, clap_param_info *info) const n
         info->min_value = 0;
         info->max_value = 1;
         info->default_value = 0.01;
+        info->flags |= mod;
         break;
     case 4:
         info->id = pmAmpRelease;
@@ -122,6 +199,7 @@ bool ClapSawDemo::paramsInfo(uint32_t paramIndex, clap_param_info *info) const n
         info->min_value = 0;
         info->max_value = 1;
         info->default_value = 0.2;
+        info->flags |= mod;
         break;
     case 5:
         info->id = pmAmpIsGate;
@@ -163,133 +241,366 @@ bool ClapSawDemo::paramsInfo(uint32_t paramIndex, clap_param_info *info) const n
         info->id = pmFilterMode;
         strncpy(info->name, "Filter Type", CLAP_NAME_SIZE);
         strncpy(info->module, "Filter", CLAP_NAME_SIZE);
-        info->min_value = SawDemoVoice::StereoSimperSVF::Mode::LP;
-        info->max_value = SawDemoVoice::StereoSimperSVF::Mode::ALL;
+        info->min_value = StereoFilter::LP;
+        info->max_value = StereoFilter::nModes - 1;
         info->default_value = 0;
         info->flags |= CLAP_PARAM_IS_STEPPED;
         break;
+    /*
+     * Decay and sustain came after the rest, so they go at the end to keep the existing
+     * parameter indices stable for hosts which remember them.
+     */
+    case 10:
+        info->id = pmAmpDecay;
+        strncpy(info->name, "Amplitude Decay (s)", CLAP_NAME_SIZE);
+        strncpy(info->module, "Amplitude Envelope Generator", CLAP_NAME_SIZE);
+        info->min_value = 0;
+        info->max_value = 1;
+        info->default_value = 0.5;
+        break;
+    case 11:
+        info->id = pmAmpSustain;
+        strncpy(info->name, "Amplitude Sustain", CLAP_NAME_SIZE);
+        strncpy(info->module, "Amplitude Envelope Generator", CLAP_NAME_SIZE);
+        info->min_value = 0;
+        info->max_value = 1;
+        info->default_value = 1;
+        break;
+    // and likewise the internal modulation after them
+    case 12:
+        info->id = pmLfoRate;
+        strncpy(info->name, "LFO Rate (Hz)", CLAP_NAME_SIZE);
+        strncpy(info->module, "LFO", CLAP_NAME_SIZE);
+        info->min_value = 0.01;
+        info->max_value = 20;
+        info->default_value = 2;
+        break;
+    case 13:
+        info->id = pmLfoShape;
+        strncpy(info->name, "LFO Shape", CLAP_NAME_SIZE);
+        strncpy(info->module, "LFO", CLAP_NAME_SIZE);
+        info->min_value = 0;
+        info->max_value = nLFOShapes - 1;
+        info->default_value = lfoSine;
+        info->flags |= CLAP_PARAM_IS_STEPPED;
+        break;
+    case 14:
+        info->id = pmLfoToPitch;
+        strncpy(info->name, "LFO to Pitch (semitones)", CLAP_NAME_SIZE);
+        strncpy(info->module, "LFO", CLAP_NAME_SIZE);
+        info->min_value = -12;
+        info->max_value = 12;
+        info->default_value = 0;
+        break;
+    case 15:
+        info->id = pmLfoToCutoff;
+        strncpy(info->name, "LFO to Cutoff (keys)", CLAP_NAME_SIZE);
+        strncpy(info->module, "LFO", CLAP_NAME_SIZE);
+        info->min_value = -60;
+        info->max_value = 60;
+        info->default_value = 0;
+        break;
+    case 16:
+        info->id = pmLfoToVCA;
+        strncpy(info->name, "LFO to VCA", CLAP_NAME_SIZE);
+        strncpy(info->module, "LFO", CLAP_NAME_SIZE);
+        info->min_value = 0;
+        info->max_value = 1;
+        info->default_value = 0;
+        break;
+    case 17:
+        info->id = pmFegAttack;
+        strncpy(info->name, "Filter Envelope Attack (s)", CLAP_NAME_SIZE);
+        strncpy(info->module, "Filter Envelope Generator", CLAP_NAME_SIZE);
+        info->min_value = 0;
+        info->max_value = 1;
+        info->default_value = 0;
+        break;
+    case 18:
+        info->id = pmFegDecay;
+        strncpy(info->name, "Filter Envelope Decay (s)", CLAP_NAME_SIZE);
+        strncpy(info->module, "Filter Envelope Generator", CLAP_NAME_SIZE);
+        info->min_value = 0;
+        info->max_value = 1;
+        info->default_value = 0.5;
+        break;
+    case 19:
+        info->id = pmFegSustain;
+        strncpy(info->name, "Filter Envelope Sustain", CLAP_NAME_SIZE);
+        strncpy(info->module, "Filter Envelope Generator", CLAP_NAME_SIZE);
+        info->min_value = 0;
+        info->max_value = 1;
+        info->default_value = 0;
+        break;
+    case 20:
+        info->id = pmFegRelease;
+        strncpy(info->name, "Filter Envelope Release (s)", CLAP_NAME_SIZE);
+        strncpy(info->module, "Filter Envelope Generator", CLAP_NAME_SIZE);
+        info->min_value = 0;
+        info->max_value = 1;
+        info->default_value = 0.5;
+        break;
+    case 21:
+        info->id = pmFegToCutoff;
+        strncpy(info->name, "Filter Envelope to Cutoff (keys)", CLAP_NAME_SIZE);
+        strncpy(info->module, "Filter Envelope Generator", CLAP_NAME_SIZE);
+        info->min_value = -96;
+        info->max_value = 96;
+        info->default_value = 0;
+        break;
     }
     return true;
 }
 
+namespace
+{
+/*
+ * The filter modes by name: the long names are what we show the host and the short ones are
+ * the editor's buttons. Typing either one in gets you the mode.
+ */
+struct FilterModeName
+{
+    StereoFilter::Mode mode;
+    const char *name;
+    const char *shortName;
+};
+constexpr FilterModeName filterModeNames[] = {{StereoFilter::LP, "LowPass", "LP"},
+                                              {StereoFilter::HP, "HighPass", "HP"},
+                                              {StereoFilter::BP, "BandPass", "BP"},
+                                              {StereoFilter::NOTCH, "Notch", "Notch"},
+                                              {StereoFilter::PEAK, "Peak", "Peak"},
+                                              {StereoFilter::ALL, "AllPass", "All"},
+                                              {StereoFilter::LADDER, "Ladder LowPass", "Ladder"},
+                                              {StereoFilter::OB_LP, "OB LowPass", "OB LP"},
+                                              {StereoFilter::OB_BP, "OB BandPass", "OB BP"},
+                                              {StereoFilter::OB_HP, "OB HighPass", "OB HP"}};
+static_assert(std::size(filterModeNames) == StereoFilter::nModes);
+
+constexpr const char *lfoShapeNames[] = {"Sine", "Triangle", "Saw", "Square"};
+static_assert(std::size(lfoShapeNames) == nLFOShapes);
+
+/*
+ * A number, then optionally one of the units (each a word and what it multiplies the number
+ * by), then nothing else. With no unit the first one's scale applies.
+ */
+struct Unit
+{
+    const char *word;
+    double scale;
+};
+bool parseWithUnits(const char *text, double &v, std::initializer_list<Unit> units)
+{
+    const char *rest;
+    if (!paramtext::parseNumber(text, v, &rest))
+        return false;
+    if (paramtext::atEnd(rest))
+    {
+        if (units.size())
+            v *= units.begin()->scale;
+        return true;
+    }
+    for (const auto &u : units)
+    {
+        const char *after;
+        if (paramtext::matchWord(rest, u.word, &after) && paramtext::atEnd(after))
+        {
+            v *= u.scale;
+            return true;
+        }
+    }
+    return false;
+}
+} // namespace
+
 bool ClapSawDemo::paramsValueToText(clap_id paramId, double value, char *display,
                                     uint32_t size) noexcept
 {
-    auto pid = (paramIds)paramId;
-    std::string sValue{"ERROR"};
-    auto n2s = [](auto n)
-    {
-        std::ostringstream oss;
-        oss << std::setprecision(6) << n;
-        return oss.str();
-    };
-    switch (pid)
+    paramtext::Writer w(display, size);
+    switch (paramId)
     {
     case pmResonance:
     case pmPreFilterVCA:
-        sValue = n2s(value);
-        break;
+    case pmAmpSustain:
+    case pmLfoToVCA:
+    case pmFegSustain:
+        w.num(value);
+        return true;
     case pmAmpRelease:
+    case pmAmpDecay:
     case pmAmpAttack:
-        sValue = n2s(scaleTimeParamToSeconds(value)) + " s";
-        break;
+    case pmFegAttack:
+    case pmFegDecay:
+    case pmFegRelease:
+        w.num(scaleTimeParamToSeconds(value)).str(" s");
+        return true;
+    case pmLfoRate:
+        w.num(value).str(" Hz");
+        return true;
+    case pmLfoShape:
+        w.str(lfoShapeNames[std::clamp(static_cast<int>(value), 0, nLFOShapes - 1)]);
+        return true;
+    case pmLfoToPitch:
+        w.num(value).str(" semitones");
+        return true;
+    case pmLfoToCutoff:
+    case pmFegToCutoff:
+        w.num(value).str(" keys");
+        return true;
     case pmUnisonCount:
     {
         int vc = static_cast<int>(value);
-        sValue = n2s(vc) + (vc == 1 ? " voice" : " voices");
-        break;
+        w.integer(vc).str(vc == 1 ? " voice" : " voices");
+        return true;
     }
     case pmUnisonSpread:
     case pmOscDetune:
-        sValue = n2s(value) + " cents";
-        break;
+        w.num(value).str(" cents");
+        return true;
     case pmAmpIsGate:
-        sValue = value > 0.5 ? "AEG Bypassed" : "AEG On";
-        break;
+        w.str(value > 0.5 ? "AEG Bypassed" : "AEG On");
+        return true;
     case pmCutoff:
-    {
-        auto co = 440 * pow(2.0, (value - 69) / 12);
-        sValue = n2s(co) + " Hz";
-        break;
-    }
+        w.num(noteFrequencyTable().noteToFrequency(value)).str(" Hz");
+        return true;
     case pmFilterMode:
     {
-        auto fm = (SawDemoVoice::StereoSimperSVF::Mode) static_cast<int>(value);
-        switch (fm)
-        {
-        case SawDemoVoice::StereoSimperSVF::LP:
-            sValue = "LowPass";
-            break;
-        case SawDemoVoice::StereoSimperSVF::BP:
-            sValue = "BandPass";
-            break;
-        case SawDemoVoice::StereoSimperSVF::HP:
-            sValue = "HighPass";
-            break;
-        case SawDemoVoice::StereoSimperSVF::NOTCH:
-            sValue = "Notch";
-            break;
-        case SawDemoVoice::StereoSimperSVF::PEAK:
-            sValue = "Peak";
-            break;
-        case SawDemoVoice::StereoSimperSVF::ALL:
-            sValue = "AllPass";
-            break;
-        }
-        break;
+        auto fm = std::clamp(static_cast<int>(value), 0, StereoFilter::nModes - 1);
+        for (const auto &n : filterModeNames)
+            if (n.mode == fm)
+                w.str(n.name);
+        return true;
     }
     }
 
-    strncpy(display, sValue.c_str(), size);
-    display[size - 1] = '\0';
-    return true;
+    w.str("ERROR");
+    return false;
 }
 
+/*
+ * The inverse of paramsValueToText, for hosts which let you type a value in. It takes what
+ * we display, with or without the unit, and a few obvious alternatives (ms for times, kHz
+ * for the cutoff, a filter mode's editor name). Anything else it can't make sense of is
+ * rejected rather than guessed at.
+ */
 bool ClapSawDemo::paramsTextToValue(clap_id paramId, const char *display, double *value) noexcept
 {
+    double v;
     switch (paramId)
     {
     case pmResonance:
     case pmPreFilterVCA:
-        *value = std::clamp(std::atof(display), 0., 1.);
+    case pmAmpSustain:
+    case pmLfoToVCA:
+    case pmFegSustain:
+        if (!parseWithUnits(display, v, {}))
+            return false;
+        *value = std::clamp(v, 0., 1.);
+        return true;
+    case pmLfoRate:
+        if (!parseWithUnits(display, v, {{"Hz", 1.0}, {"mHz", 0.001}}))
+            return false;
+        *value = std::clamp(v, 0.01, 20.0);
+        return true;
+    case pmLfoShape:
+    {
+        for (int i = 0; i < nLFOShapes; ++i)
+        {
+            const char *rest;
+            if (paramtext::matchWord(display, lfoShapeNames[i], &rest) && paramtext::atEnd(rest))
+            {
+                *value = i;
+                return true;
+            }
+        }
+        if (!parseWithUnits(display, v, {}) || v != std::floor(v) || v < 0 || v >= nLFOShapes)
+            return false;
+        *value = v;
+        return true;
+    }
+    case pmLfoToPitch:
+        if (!parseWithUnits(display, v,
+                            {{"semitones", 1.0}, {"semitone", 1.0}, {"st", 1.0}, {"cents", 0.01}}))
+            return false;
+        *value = std::clamp(v, -12.0, 12.0);
+        return true;
+    case pmLfoToCutoff:
+        if (!parseWithUnits(display, v, {{"keys", 1.0}, {"key", 1.0}}))
+            return false;
+        *value = std::clamp(v, -60.0, 60.0);
+        return true;
+    case pmFegToCutoff:
+        if (!parseWithUnits(display, v, {{"keys", 1.0}, {"key", 1.0}}))
+            return false;
+        *value = std::clamp(v, -96.0, 96.0);
         return true;
-        break;
     case pmAmpRelease:
+    case pmAmpDecay:
     case pmAmpAttack:
-        *value = scaleSecondsToTimeParam(std::atof(display));
+    case pmFegAttack:
+    case pmFegDecay:
+    case pmFegRelease:
+        if (!parseWithUnits(display, v, {{"s", 1.0}, {"sec", 1.0}, {"ms", 0.001}}))
+            return false;
+        *value = scaleSecondsToTimeParam((float)v);
         return true;
-        break;
     case pmUnisonCount:
-    {
-        *value = std::clamp(std::atoi(display), 1, 7);
+        if (!parseWithUnits(display, v, {{"voices", 1.0}, {"voice", 1.0}}))
+            return false;
+        *value = std::clamp((int)std::lround(v), 1, SawDemoVoice::max_uni);
         return true;
-        break;
-    }
     case pmUnisonSpread:
-        *value = std::clamp(std::atof(display), 0., 100.);
+        if (!parseWithUnits(display, v, {{"cents", 1.0}, {"cent", 1.0}, {"ct", 1.0}}))
+            return false;
+        *value = std::clamp(v, 0., 100.);
         return true;
-        break;
-
     case pmOscDetune:
-        *value = std::clamp(std::atof(display), -200.0, 200.0);
+        if (!parseWithUnits(display, v, {{"cents", 1.0}, {"cent", 1.0}, {"ct", 1.0}}))
+            return false;
+        *value = std::clamp(v, -200.0, 200.0);
         return true;
-        break;
     case pmCutoff:
     {
-        // auto co = 440 * pow(2.0, (value - 69) / 12);
-        // log2(co/440) = (value - 69)/12
-        // value = log2(co/440) * 12 + 69
-
-        auto cohz = std::clamp(std::atof(display), 1.0, 25000.0);
-        *value = log2(cohz / 440.0) * 12 + 69;
+        // The display is 440 * 2^((value - 69) / 12) Hz, so value = 12 log2(hz / 440) + 69
+        if (!parseWithUnits(display, v, {{"Hz", 1.0}, {"kHz", 1000.0}}) || !(v > 0))
+            return false;
+        *value = std::clamp(12 * std::log2(v / 440.0) + 69, 1.0, 127.0);
         return true;
-        break;
     }
-        // Skip these two. You get the idea
     case pmFilterMode:
+    {
+        for (const auto &n : filterModeNames)
+        {
+            const char *rest;
+            if ((paramtext::matchWord(display, n.name, &rest) && paramtext::atEnd(rest)) ||
+                (paramtext::matchWord(display, n.shortName, &rest) && paramtext::atEnd(rest)))
+            {
+                *value = n.mode;
+                return true;
+            }
+        }
+        // or the mode's number
+        if (!parseWithUnits(display, v, {}) || v != std::floor(v) || v < 0 ||
+            v >= StereoFilter::nModes)
+            return false;
+        *value = v;
+        return true;
+    }
     case pmAmpIsGate:
-        return false;
-        break;
+    {
+        // "AEG Bypassed" or "AEG On", or just the second word, or 0 / 1
+        const char *rest = display;
+        paramtext::matchWord(display, "AEG", &rest);
+        const char *end;
+        if (paramtext::matchWord(rest, "Bypassed", &end) && paramtext::atEnd(end))
+            *value = 1;
+        else if (paramtext::matchWord(rest, "On", &end) && paramtext::atEnd(end))
+            *value = 0;
+        else if (parseWithUnits(display, v, {}) && (v == 0 || v == 1))
+            *value = v;
+        else
+            return false;
+        return true;
+    }
     }
 
     return false;
@@ -299,22 +610,107 @@ bool ClapSawDemo::paramsTextToValue(clap_id paramId, const char *display, double
  * Stereo out, Midi in, in a pretty obvious way.
  * The only trick is the idi in also has NOTE_DIALECT_CLAP which provides us
  * with options on note expression and the like.
+ *
+ * The stereo out is either one port or, depending on the selected port layout, one
+ * per MIDI channel or one per key range. The first port is always the main port.
  */
+uint32_t ClapSawDemo::outputPortCount() const noexcept
+{
+    switch (portLayout)
+    {
+    case plPerChannel:
+        return 16;
+    case plPerKeyRange:
+        return keyRangeStarts.size();
+    }
+    return 1;
+}
+
+int ClapSawDemo::outputPortFor(int channel, int key) const noexcept
+{
+    switch (portLayout)
+    {
+    case plPerChannel:
+        // CLAP note events can have a channel of -1 meaning 'all'; send those to the first
+        return std::clamp(channel, 0, 15);
+    case plPerKeyRange:
+    {
+        int port = 0;
+        for (int i = 1; i < (int)keyRangeStarts.size(); ++i)
+            if (key >= keyRangeStarts[i])
+                port = i;
+        return port;
+    }
+    }
+    return 0;
+}
+
 bool ClapSawDemo::audioPortsInfo(uint32_t index, bool isInput,
                                  clap_audio_port_info *info) const noexcept
 {
-    if (isInput || index != 0)
+    if (isInput || index >= outputPortCount())
         return false;
 
-    info->id = 0;
+    info->id = index;
     info->in_place_pair = CLAP_INVALID_ID;
-    strncpy(info->name, "main", sizeof(info->name));
-    info->flags = CLAP_AUDIO_PORT_IS_MAIN;
+    switch (portLayout)
+    {
+    case plPerChannel:
+        snprintf(info->name, sizeof(info->name), "channel %d", index + 1);
+        break;
+    case plPerKeyRange:
+    {
+        auto hi = index + 1 < keyRangeStarts.size() ? keyRangeStarts[index + 1] - 1 : 127;
+        snprintf(info->name, sizeof(info->name), "keys %d-%d", keyRangeStarts[index], hi);
+        break;
+    }
+    default:
+        strncpy(info->name, "main", sizeof(info->name));
+        break;
+    }
+    info->flags = (index == 0) ? CLAP_AUDIO_PORT_IS_MAIN : 0;
     info->channel_count = 2;
     info->port_type = CLAP_PORT_STEREO;
     return true;
 }
 
+bool ClapSawDemo::audioPortsConfigGet(uint32_t index,
+                                      clap_audio_ports_config *config) const noexcept
+{
+    if (index >= nPortLayouts)
+        return false;
+
+    static constexpr const char *names[nPortLayouts] = {
+        "Stereo", "Stereo Per MIDI Channel", "Stereo Per Key Range"};
+    static constexpr uint32_t counts[nPortLayouts] = {1, 16, keyRangeStarts.size()};
+
+    config->id = index;
+    strncpy(config->name, names[index], sizeof(config->name));
+    config->input_port_count = 0;
+    config->output_port_count = counts[index];
+    config->has_main_input = false;
+    config->main_input_channel_count = 0;
+    config->main_input_port_type = nullptr;
+    config->has_main_output = true;
+    config->main_output_channel_count = 2;
+    config->main_output_port_type = CLAP_PORT_STEREO;
+    return true;
+}
+
+/*
+ * The host only calls this while we are deactivated, so no voice is playing and no
+ * process call can see the layout change underneath it.
+ */
+bool ClapSawDemo::audioPortsConfigSelect(clap_id configId) noexcept
+{
+    if (configId >= nPortLayouts)
+        return false;
+
+    portLayout = configId;
+    _DBGLOG(Info, "Selected output port layout {} with {} ports", portLayout, outputPortCount());
+    return true;
+}
+
 bool ClapSawDemo::notePortsInfo(uint32_t index, bool isInput,
                                 clap_note_port_info *info) const noexcept
 {
@@ -348,6 +744,11 @@ bool ClapSawDemo::notePortsInfo(uint32_t index, bool isInput,
  */
 clap_process_status ClapSawDemo::process(const clap_process *process) noexcept
 {
+    _TRACE_SCOPE("process");
+
+    // Flush denormals to zero until we return; the host's setting is restored on the way out
+    ScopedDenormalsDisabled noDenormals;
+
     // If I have no outputs, do nothing
     if (process->audio_outputs_count <= 0)
         return CLAP_PROCESS_SLEEP;
@@ -358,7 +759,13 @@ clap_process_status ClapSawDemo::process(const clap_process *process) noexcept
      * The UI can send us gesture begin/end events which translate in to a
      * `clap_event_param_gesture` or value adjustments.
      */
+    eventsOut = process->out_events;
     handleEventsFromUIQueue(process->out_events);
+    adoptPendingTuning();
+
+    // After the UI queue, so the recording has its value changes ahead of this block
+    if (recorder)
+        recorder->process(process);
 
     /*
      * Stage 2: Create the AUDIO output and process events
@@ -366,10 +773,36 @@ clap_process_status ClapSawDemo::process(const clap_process *process) noexcept
      * CLAP has a single inbound event loop where every event is time stamped with
      * a sample id. This means the process loop can easily interleave note and parameter
      * and other events with audio generation. Here we do everything completely sample accurately
-     * by maintaining a pointer to the 'nextEvent' which we check at every sample.
+     * by maintaining a pointer to the 'nextEvent' and rendering the voices in chunks which
+     * run from one event time to the next. Voices are independent so this is identical to
+     * stepping every voice one sample at a time, but lets each voice stay in its own loop
+     * for a while (and lets us time each voice render with the tracer).
      */
-    float **out = process->audio_outputs[0].data32;
-    auto chans = process->audio_outputs->channel_count;
+    // Every bus is reset, not just this layout's, so a voice left on a port from an
+    // earlier layout can never see a stale buffer
+    auto nPorts = outputPortCount();
+    bool useScratch = process->frames_count <= scratchFrames;
+    for (uint32_t p = 0; p < maxOutputPorts; ++p)
+    {
+        auto &bus = outputBuses[p];
+        bus = OutputBus();
+        if (p < nPorts && p < process->audio_outputs_count && process->audio_outputs[p].data32 &&
+            process->audio_outputs[p].channel_count > 0)
+        {
+            bus.host = process->audio_outputs[p].data32;
+            bus.hostChans = process->audio_outputs[p].channel_count;
+            if (useScratch)
+            {
+                bus.data = busScratchChans[p].data();
+                bus.chans = std::min(bus.hostChans, maxBusChans);
+            }
+            else
+            {
+                bus.data = bus.host;
+                bus.chans = bus.hostChans;
+            }
+        }
+    }
 
     auto ev = process->in_events;
     auto sz = ev->size(ev);
@@ -382,11 +815,37 @@ clap_process_status ClapSawDemo::process(const clap_process *process) noexcept
         nextEvent = ev->get(ev, nextEventIndex);
     }
 
-    for (int i = 0; i < process->frames_count; ++i)
+    for (uint32_t p = 0; p < nPorts; ++p)
+    {
+        const auto &bus = outputBuses[p];
+        for (uint32_t ch = 0; ch < bus.chans; ++ch)
+            std::fill(bus.data[ch], bus.data[ch] + process->frames_count, 0.f);
+    }
+
+    uint32_t frame{0};
+    while (frame < process->frames_count)
     {
+        // Modulation arriving now glides to its target by the time of the next later event
+        // (or the end of the block), so look ahead for that once for this group of events
+        if (nextEvent && nextEvent->time <= frame)
+        {
+            auto rampEnd = process->frames_count;
+            for (auto i = nextEventIndex + 1; i < sz; ++i)
+            {
+                auto t = ev->get(ev, i)->time;
+                if (t > frame)
+                {
+                    rampEnd = t;
+                    break;
+                }
+            }
+            modRampSamples = rampEnd - frame;
+        }
+
         // Do I have an event to process. Note that multiple events
         // can occur on the same sample, hence 'while' not 'if'
-        while (nextEvent && nextEvent->time == i)
+        eventFrame = frame;
+        while (nextEvent && nextEvent->time <= frame)
         {
             // handleInboundEvent is a separate function which adjusts the state based
             // on event type. We segregate it for clarity but you really should read it!
@@ -398,28 +857,43 @@ clap_process_status ClapSawDemo::process(const clap_process *process) noexcept
                 nextEvent = ev->get(ev, nextEventIndex);
         }
 
-        // This is a simple accumulator of output across our active voices.
-        // See saw-voice.h for information on the individual voice.
-        for (int ch = 0; ch < chans; ++ch)
+        auto chunkEnd = process->frames_count;
+        if (nextEvent)
+            chunkEnd = std::min(chunkEnd, nextEvent->time);
+
+        renderVoices(frame, chunkEnd - frame);
+        frame = chunkEnd;
+    }
+
+    // Hand the scratch to the host, and let it know which ports are silent so it can skip
+    // them downstream. The loudest sample goes in the telemetry.
+    float peak{0.f};
+    for (uint32_t p = 0; p < nPorts && p < process->audio_outputs_count; ++p)
+    {
+        const auto &bus = outputBuses[p];
+        if (!bus.host)
+            continue;
+
+        if (bus.rendered)
         {
-            out[ch][i] = 0.f;
+            for (uint32_t ch = 0; ch < bus.chans; ++ch)
+                for (uint32_t s = 0; s < process->frames_count; ++s)
+                    peak = std::max(peak, std::fabs(bus.data[ch][s]));
         }
-        for (auto &v : voices)
+
+        if (bus.data != bus.host)
         {
-            if (v.isPlaying())
+            for (uint32_t ch = 0; ch < bus.hostChans; ++ch)
             {
-                v.step();
-                if (chans >= 2)
-                {
-                    out[0][i] += v.L;
-                    out[1][i] += v.R;
-                }
-                else if (chans == 1)
-                {
-                    out[0][i] += (v.L + v.R) * 0.5;
-                }
+                auto out = bus.host[ch];
+                if (bus.rendered && ch < bus.chans)
+                    std::copy(bus.data[ch], bus.data[ch] + process->frames_count, out);
+                else
+                    std::fill(out, out + process->frames_count, 0.f);
             }
         }
+        process->audio_outputs[p].constant_mask =
+            bus.rendered ? 0 : (bus.hostChans >= 64 ? ~0ULL : (1ULL << bus.hostChans) - 1);
     }
 
     /*
@@ -429,57 +903,241 @@ clap_process_status ClapSawDemo::process(const clap_process *process) noexcept
      * modulators, and it is also the reason we have the NEWLY_OFF state in addition
      * to the OFF state.
      *
-     * Note that there are two ways to enter the terminatedVoices array. The first
+     * Note that there are two ways to enter the terminatedVoices queue. The first
      * is here through natural state transition to NEWLY_OFF and the second is in
      * handleNoteOn when we steal a voice.
      */
+    {
+        _TRACE_SCOPE("terminationSweep");
+        // Hosts may send an empty block just to deliver events; its NOTE_ENDs go at 0
+        eventFrame = process->frames_count ? process->frames_count - 1 : 0;
+        for (auto &v : voices)
+        {
+            if (v.state == SawDemoVoice::NEWLY_OFF)
+            {
+                queueTermination(v.portid, v.channel, v.key, v.note_id);
+                v.state = SawDemoVoice::OFF;
+            }
+        }
+
+        for (int i = 0; i < terminatedCount; ++i)
+            sendNoteEnd(terminatedVoices[i], eventFrame);
+        terminatedCount = 0;
+    }
+    eventsOut = nullptr;
+
+    // We should have gotten all the events
+    assert(!nextEvent);
+
+    controlGridPhase =
+        (controlGridPhase + process->frames_count) % SawDemoVoice::controlBlockSize;
+
+    // Report how often the voices' shortcuts fired (see SawDemoVoice::EarlyOut)
     for (auto &v : voices)
     {
-        if (v.state == SawDemoVoice::NEWLY_OFF)
+        for (int e = 0; e < SawDemoVoice::nEarlyOuts; ++e)
         {
-            terminatedVoices.emplace_back(v.portid, v.channel, v.key, v.note_id);
-            v.state = SawDemoVoice::OFF;
+            if (v.earlyOutCounts[e])
+            {
+                dataCopyForUI.earlyOuts[e].fetch_add(v.earlyOutCounts[e],
+                                                     std::memory_order_relaxed);
+                v.earlyOutCounts[e] = 0;
+            }
         }
     }
 
-    for (const auto &[portid, channel, key, note_id] : terminatedVoices)
+    if (rtlog::hasPending() && !logDrainRequested.exchange(true))
+        _host.requestCallback();
+
+    // A little optimization - if we have any active voices continue
+    samplesProcessed += process->frames_count;
+    if (publishVoiceState(peak))
+        return CLAP_PROCESS_CONTINUE;
+
+    // Otherwise we have no voices - we can return CLAP_PROCESS_SLEEP until we get the next event
+    // And our host can optionally skip processing
+    return CLAP_PROCESS_SLEEP;
+}
+
+/*
+ * This is a simple accumulator of output across our active voices for the
+ * frames [offset, offset + frames) into each voice's output port. See saw-voice.h for
+ * information on the individual voice.
+ *
+ * The one wrinkle is the filter. Voices whose filters share a model are rendered together,
+ * StereoFilter::batchVoices at a time, so one pass of the filter code runs all of them in
+ * SIMD lanes (see filter-models.h). Voices which only need skipping are done first.
+ *
+ * Offline (see renderSetMode) the batches render in parallel into scratch, a
+ * OfflineEngine::blockFrames slice at a time, and are then mixed on this thread batch by
+ * batch. Every sample of every bus sees the same additions in the same order as the live
+ * path, so the bounce matches a real time render exactly.
+ */
+void ClapSawDemo::renderVoices(uint32_t offset, uint32_t frames)
+{
+    std::array<std::array<int, max_voices>, StereoFilter::nFilterModels> byModel;
+    std::array<int, StereoFilter::nFilterModels> countByModel{};
+
+    for (int vi = 0; vi < max_voices; ++vi)
     {
-        auto ov = process->out_events;
-        auto evt = clap_event_note();
-        evt.header.size = sizeof(clap_event_note);
-        evt.header.type = (uint16_t)CLAP_EVENT_NOTE_END;
-        evt.header.time = process->frames_count - 1;
-        evt.header.space_id = CLAP_CORE_EVENT_SPACE_ID;
-        evt.header.flags = 0;
+        auto &v = voices[vi];
+        if (!v.isPlaying())
+            continue;
 
-        evt.port_index = portid;
-        evt.channel = channel;
-        evt.key = key;
-        evt.note_id = note_id;
-        evt.velocity = 0.0;
+        if (!outputBuses[v.outputPort].data)
+        {
+            v.skip(frames);
+            continue;
+        }
 
-        ov->try_push(ov, &(evt.header));
+        outputBuses[v.outputPort].rendered = true;
+        auto m = v.filter.model;
+        byModel[m][countByModel[m]++] = vi;
+    }
 
-        dataCopyForUI.updateCount++;
-        dataCopyForUI.polyphony--;
+    struct Batch
+    {
+        const int *voiceIndices;
+        int count;
+    };
+    std::array<Batch, maxVoiceBatches> batches;
+    int nBatches{0};
+    for (int m = 0; m < StereoFilter::nFilterModels; ++m)
+    {
+        for (int i = 0; i < countByModel[m]; i += StereoFilter::batchVoices)
+        {
+            auto count = std::min(StereoFilter::batchVoices, countByModel[m] - i);
+            batches[nBatches++] = {&byModel[m][i], count};
+        }
+    }
+
+    auto offline = offlineRender.load(std::memory_order_acquire) ? offlineEngine.get() : nullptr;
+    if (!offline || nBatches < 2)
+    {
+        for (int b = 0; b < nBatches; ++b)
+            renderVoiceBatch(batches[b].voiceIndices, batches[b].count, offset, frames);
+        return;
+    }
+
+    constexpr auto blockFrames = OfflineEngine::blockFrames;
+    for (uint32_t done = 0; done < frames; done += blockFrames)
+    {
+        auto n = std::min(frames - done, blockFrames);
+        auto job = [&](int b)
+        {
+            renderVoiceBatch(batches[b].voiceIndices, batches[b].count, offset + done, n,
+                             offline->scratch[b].io);
+        };
+        offline->pool.run(nBatches, job);
+
+        // Stopped voices captured zeros, and adding those changes nothing
+        const bool playing[StereoFilter::batchVoices]{true, true, true, true};
+        for (int b = 0; b < nBatches; ++b)
+        {
+            std::array<SawDemoVoice *, StereoFilter::batchVoices> batch;
+            for (int i = 0; i < batches[b].count; ++i)
+                batch[i] = &voices[batches[b].voiceIndices[i]];
+            mixVoiceBatch(batch.data(), playing, batches[b].count, offline->scratch[b].io, n,
+                          offset + done);
+        }
+    }
+}
+
+void ClapSawDemo::renderVoiceBatch(const int *voiceIndices, int count, uint32_t offset,
+                                   uint32_t frames, float (*capture)[StereoFilter::batchLanes])
+{
+    _TRACE_SCOPE_ARG("renderVoiceBatch", voiceIndices[0]);
+
+    constexpr auto batchVoices = StereoFilter::batchVoices;
+    constexpr auto maxFrames = StereoFilter::maxBatchFrames;
+
+    std::array<SawDemoVoice *, batchVoices> batch;
+    std::array<StereoFilter *, batchVoices> filters;
+    for (int i = 0; i < count; ++i)
+    {
+        batch[i] = &voices[voiceIndices[i]];
+        filters[i] = &batch[i]->filter;
+    }
+
+    alignas(32) float io[maxFrames][StereoFilter::batchLanes];
+    float L[maxFrames], R[maxFrames];
+
+    uint32_t done{0};
+    while (done < frames)
+    {
+        // Run up to the first control block boundary of any voice, which (since they share
+        // a grid) is usually all of them. Those starting a block move their LFOs on together
+        // first.
+        SawDemoVoice::advanceLFOs(batch.data(), count);
+        auto n = (int)std::min(frames - done, (uint32_t)maxFrames);
+        for (int i = 0; i < count; ++i)
+            if (batch[i]->isPlaying())
+                n = batch[i]->beginRender(n);
+
+        // A voice which finishes mid-chunk stays silent until the end of the block. Its
+        // lanes run on zeros, which is cheaper than re-forming the batch
+        bool playing[batchVoices];
+        bool any{false};
+        for (int i = 0; i < count; ++i)
+        {
+            playing[i] = batch[i]->isPlaying();
+            any = any || playing[i];
+            if (playing[i])
+            {
+                batch[i]->renderUnfiltered(L, R, n);
+            }
+            else
+            {
+                std::fill(L, L + n, 0.f);
+                std::fill(R, R + n, 0.f);
+            }
+
+            for (int s = 0; s < n; ++s)
+            {
+                io[s][2 * i] = L[s];
+                io[s][2 * i + 1] = R[s];
+            }
+        }
+        if (!any)
+            break;
+
+        processFilterBatch(filters.data(), count, io, n);
+
+        if (capture)
+        {
+            for (int s = 0; s < n; ++s)
+                for (int i = 0; i < count; ++i)
+                {
+                    capture[done + s][2 * i] = playing[i] ? io[s][2 * i] : 0.f;
+                    capture[done + s][2 * i + 1] = playing[i] ? io[s][2 * i + 1] : 0.f;
+                }
+        }
+        else
+        {
+            mixVoiceBatch(batch.data(), playing, count, io, n, offset + done);
+        }
+        done += n;
     }
-    terminatedVoices.clear();
-
-    // We should have gotten all the events
-    assert(!nextEvent);
 
-    // A little optimization - if we have any active voices continue
-    for (const auto &v : voices)
+    if (capture)
     {
-        if (v.state != SawDemoVoice::OFF)
-        {
-            return CLAP_PROCESS_CONTINUE;
-        }
+        for (auto s = done; s < frames; ++s)
+            std::fill(capture[s], capture[s] + 2 * count, 0.f);
     }
+}
 
-    // Otherwise we have no voices - we can return CLAP_PROCESS_SLEEP until we get the next event
-    // And our host can optionally skip processing
-    return CLAP_PROCESS_SLEEP;
+// Add n samples of a batch's lanes to its voices' buses from sample 'at'
+void ClapSawDemo::mixVoiceBatch(SawDemoVoice *const *batch, const bool *playing, int count,
+                                const float (*io)[StereoFilter::batchLanes], int n, uint32_t at)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        if (!playing[i])
+            continue;
+
+        const auto &bus = outputBuses[batch[i]->outputPort];
+        voiceKernels().addVoice(bus.data, bus.chans, at, io, i, n);
+    }
 }
 
 /*
@@ -491,6 +1149,8 @@ clap_process_status ClapSawDemo::process(const clap_process *process) noexcept
  */
 void ClapSawDemo::handleInboundEvent(const clap_event_header_t *evt)
 {
+    _TRACE_SCOPE("handleInboundEvent");
+
     if (evt->space_id != CLAP_CORE_EVENT_SPACE_ID)
         return;
 
@@ -510,8 +1170,12 @@ void ClapSawDemo::handleInboundEvent(const clap_event_header_t *evt)
         {
         case 0x90:
         {
-            // Hosts should prefer CLAP_NOTE events but if they don't
-            handleNoteOn(mevt->port_index, chan, mevt->data[1], -1);
+            // Hosts should prefer CLAP_NOTE events but if they don't. A note on with velocity
+            // zero is how a lot of MIDI gear says note off.
+            if (mevt->data[2] == 0)
+                handleNoteOff(mevt->port_index, chan, mevt->data[1]);
+            else
+                handleNoteOn(mevt->port_index, chan, mevt->data[1], -1, mevt->data[2] / 127.0);
             break;
         }
         case 0x80:
@@ -520,6 +1184,11 @@ void ClapSawDemo::handleInboundEvent(const clap_event_header_t *evt)
             handleNoteOff(mevt->port_index, chan, mevt->data[1]);
             break;
         }
+        case 0xB0:
+        {
+            handleCC(chan, mevt->data[1] & 0x7F, mevt->data[2] & 0x7F);
+            break;
+        }
         case 0xE0:
         {
             // pitch bend
@@ -545,7 +1214,8 @@ void ClapSawDemo::handleInboundEvent(const clap_event_header_t *evt)
     case CLAP_EVENT_NOTE_ON:
     {
         auto nevt = reinterpret_cast<const clap_event_note *>(evt);
-        handleNoteOn(nevt->port_index, nevt->channel, nevt->key, nevt->note_id);
+        handleNoteOn(nevt->port_index, nevt->channel, nevt->key, nevt->note_id,
+                     nevt->velocity);
     }
     break;
     case CLAP_EVENT_NOTE_OFF:
@@ -562,19 +1232,7 @@ void ClapSawDemo::handleInboundEvent(const clap_event_header_t *evt)
     case CLAP_EVENT_PARAM_VALUE:
     {
         auto v = reinterpret_cast<const clap_event_param_value *>(evt);
-
-        *paramToValue[v->param_id] = v->value;
-        pushParamsToVoices();
-
-        if (editor)
-        {
-            auto r = ToUI();
-            r.type = ToUI::PARAM_VALUE;
-            r.id = v->param_id;
-            r.value = (double)v->value;
-
-            toUiQ.try_enqueue(r);
-        }
+        applyParamValue(v->param_id, v->value);
     }
     break;
     /*
@@ -586,8 +1244,9 @@ void ClapSawDemo::handleInboundEvent(const clap_event_header_t *evt)
     {
         auto pevt = reinterpret_cast<const clap_event_param_mod *>(evt);
 
-        // This little lambda updates a modulation slot in a voice properly
-        auto applyToVoice = [&pevt](auto &v)
+        // This little lambda updates a modulation slot in a voice properly. The voice
+        // glides to the new amount over modRampSamples (see process) rather than jumping.
+        auto applyToVoice = [&pevt, rampSamples = modRampSamples](auto &v)
         {
             if (!v.isPlaying())
                 return;
@@ -596,34 +1255,26 @@ void ClapSawDemo::handleInboundEvent(const clap_event_header_t *evt)
             switch (pd)
             {
             case paramIds::pmCutoff:
-            {
-                v.cutoffMod = pevt->amount;
-                v.recalcFilter();
+                v.setModTarget(SawDemoVoice::mtCutoff, pevt->amount, rampSamples);
                 break;
-            }
             case paramIds::pmUnisonSpread:
-            {
-                v.uniSpreadMod = pevt->amount;
-                v.recalcPitch();
+                v.setModTarget(SawDemoVoice::mtUniSpread, pevt->amount, rampSamples);
                 break;
-            }
             case paramIds::pmOscDetune:
-            {
-                // _DBGCOUT << "Detune Mod" << _D(pevt->amount) << std::endl;
-                v.oscDetuneMod = pevt->amount;
-                v.recalcPitch();
+                v.setModTarget(SawDemoVoice::mtOscDetune, pevt->amount, rampSamples);
                 break;
-            }
             case paramIds::pmResonance:
-            {
-                v.resMod = pevt->amount;
-                v.recalcFilter();
+                v.setModTarget(SawDemoVoice::mtResonance, pevt->amount, rampSamples);
                 break;
-            }
             case paramIds::pmPreFilterVCA:
-            {
-                v.preFilterVCAMod = pevt->amount;
-            }
+                v.setModTarget(SawDemoVoice::mtPreFilterVCA, pevt->amount, rampSamples);
+                break;
+            case paramIds::pmAmpAttack:
+                v.setModTarget(SawDemoVoice::mtAmpAttack, pevt->amount, rampSamples);
+                break;
+            case paramIds::pmAmpRelease:
+                v.setModTarget(SawDemoVoice::mtAmpRelease, pevt->amount, rampSamples);
+                break;
             }
         };
 
@@ -701,9 +1352,15 @@ void ClapSawDemo::handleInboundEvent(const clap_event_header_t *evt)
 
 void ClapSawDemo::handleEventsFromUIQueue(const clap_output_events_t *ov)
 {
+    _TRACE_SCOPE("handleEventsFromUIQueue");
+
+    auto queues = uiQueues.load(std::memory_order_acquire);
+    if (!queues)
+        return;
+
     bool uiAdjustedValues{false};
     ClapSawDemo::FromUI r;
-    while (fromUiQ.try_dequeue(r))
+    while (queues->fromUiQ.try_dequeue(r))
     {
         switch (r.type)
         {
@@ -725,7 +1382,12 @@ void ClapSawDemo::handleEventsFromUIQueue(const clap_output_events_t *ov)
         case FromUI::ADJUST_VALUE:
         {
             // So set my value
-            *paramToValue[r.id] = r.value;
+            auto pv = paramValuePtr(r.id);
+            if (!pv)
+                break;
+            *pv = r.value;
+            if (recorder)
+                recorder->uiParamValue(r.id, r.value);
 
             // But we also need to generate outbound message to the host
             auto evt = clap_event_param_value();
@@ -740,23 +1402,42 @@ void ClapSawDemo::handleEventsFromUIQueue(const clap_output_events_t *ov)
             ov->try_push(ov, &(evt.header));
 
             uiAdjustedValues = true;
+            break;
+        }
+        case FromUI::LEARN_CC:
+        {
+            // Arming drops the parameter's old mapping, so the editor can tell when the new
+            // one arrives
+            ccLearnParam = -1;
+            for (int i = 0; i < nParams; ++i)
+                if (paramIdList[i] == r.id)
+                    ccLearnParam = i;
+            if (ccLearnParam >= 0)
+                ccMap.forget(ccLearnParam);
+            break;
+        }
+        case FromUI::FORGET_CC:
+        {
+            if (r.id < (uint32_t)(CCMap::nChannels * CCMap::nCCs))
+                ccMap.clear(r.id / CCMap::nCCs, r.id % CCMap::nCCs);
+            break;
         }
         }
     }
 
     // Similarly we need to push values to a UI on startup
-    if (refreshUIValues && editor)
+    if (refreshUIValues)
     {
-        _DBGCOUT << "Pushing a refresh of UI values to the editor" << std::endl;
+        _DBGLOG(Debug, "Pushing a refresh of UI values to the editor");
         refreshUIValues = false;
 
-        for (const auto &[k, v] : paramToValue)
+        for (auto k : paramIdList)
         {
             auto r = ToUI();
             r.type = ToUI::PARAM_VALUE;
             r.id = k;
-            r.value = *v;
-            toUiQ.try_enqueue(r);
+            r.value = *paramValuePtr(k);
+            queues->toUiQ.try_enqueue(r);
         }
     }
 
@@ -764,12 +1445,126 @@ void ClapSawDemo::handleEventsFromUIQueue(const clap_output_events_t *ov)
         pushParamsToVoices();
 }
 
+void ClapSawDemo::applyParamValue(clap_id paramId, double value)
+{
+    auto pv = paramValuePtr(paramId);
+    if (!pv)
+        return;
+
+    *pv = value;
+    pushParamsToVoices();
+
+    if (auto queues = uiQueues.load(std::memory_order_acquire))
+    {
+        auto r = ToUI();
+        r.type = ToUI::PARAM_VALUE;
+        r.id = paramId;
+        r.value = value;
+
+        queues->toUiQ.try_enqueue(r);
+    }
+}
+
+/*
+ * A CC either completes a MIDI learn or, if it is mapped, moves its parameter to the same
+ * point across the mapped part of its range (rounded for stepped parameters). The host
+ * hears about the change like an edit from the editor, so it can record it.
+ */
+void ClapSawDemo::handleCC(int channel, int cc, int value)
+{
+    if (ccLearnParam >= 0)
+    {
+        ccMap.learn(channel, cc, ccLearnParam);
+        ccLearnParam = -1;
+    }
+
+    auto e = ccMap.raw(channel, cc);
+    if (!e)
+        return;
+
+    auto m = CCMap::unpack(e);
+    const auto &r = paramRanges[m.param];
+    auto v = r.min + (r.max - r.min) * (m.lo + (m.hi - m.lo) * value / 127.0);
+    if (r.stepped)
+        v = std::round(v);
+
+    auto id = paramIdList[m.param];
+    applyParamValue(id, v);
+
+    if (eventsOut)
+    {
+        auto evt = clap_event_param_value();
+        evt.header.size = sizeof(clap_event_param_value);
+        evt.header.type = (uint16_t)CLAP_EVENT_PARAM_VALUE;
+        evt.header.time = eventFrame;
+        evt.header.space_id = CLAP_CORE_EVENT_SPACE_ID;
+        evt.header.flags = 0;
+        evt.param_id = id;
+        evt.note_id = -1;
+        evt.port_index = -1;
+        evt.channel = -1;
+        evt.key = -1;
+        evt.value = v;
+        eventsOut->try_push(eventsOut, &(evt.header));
+    }
+}
+
+/*
+ * What the editor shows of the voices: the keys it draws (see key-state.h) and the
+ * Telemetry snapshot, both from one pass over the voices. Returns whether any voice is
+ * still going.
+ */
+bool ClapSawDemo::publishVoiceState(float peak)
+{
+    uint64_t sounding[KeyState::nWords]{};
+    auto &t = dataCopyForUI.telemetry.beginWrite();
+    uint32_t active{0};
+    for (int i = 0; i < max_voices; ++i)
+    {
+        const auto &v = voices[i];
+        auto &tv = t.voices[i];
+        tv.state = (uint8_t)v.state;
+        if (v.state == SawDemoVoice::OFF)
+        {
+            tv = {tv.state, -1, 0, 0.f, 0};
+            continue;
+        }
+        active++;
+        tv.key = (int8_t)std::clamp(v.key, -1, 127);
+        tv.port = (uint8_t)v.outputPort;
+        tv.level = v.envelopeLevel();
+        tv.age = (uint32_t)std::min<uint64_t>(samplesProcessed - v.startSample, UINT32_MAX);
+        if (v.key >= 0 && v.key < KeyState::nKeys)
+            sounding[v.key >> 6] |= 1ULL << (v.key & 63);
+    }
+    t.blocks++;
+    t.steals = steals;
+    t.sampleRate = voices[0].sampleRate;
+    t.active = active;
+    t.peak = peak;
+    dataCopyForUI.telemetry.publish();
+
+    dataCopyForUI.keys.publish(sounding);
+    return active > 0;
+}
+
 /*
  * The note on, note off, and push params to voices implementations are, basically, completely
  * uninteresting.
  */
-void ClapSawDemo::handleNoteOn(int port_index, int channel, int key, int noteid)
+void ClapSawDemo::handleNoteOn(int port_index, int channel, int key, int noteid,
+                               double velocity)
 {
+    dataCopyForUI.keys.noteOn(key, velocity);
+
+    if (!currentTuning->isMapped(key))
+    {
+        // A key the keyboard mapping leaves out makes no sound, but we still owe the host
+        // a NOTE_END for it, so count it like a voice which ended immediately
+        queueTermination(port_index, channel, key, noteid);
+        return;
+    }
+
     bool foundVoice{false};
     for (auto &v : voices)
     {
@@ -787,24 +1582,46 @@ void ClapSawDemo::handleNoteOn(int port_index, int channel, int key, int noteid)
         // to the voice I guess. This is just a demo synth though.
         auto idx = rand() % max_voices;
         auto &v = voices[idx];
-        terminatedVoices.emplace_back(v.portid, v.channel, v.key, v.note_id);
+        queueTermination(v.portid, v.channel, v.key, v.note_id);
         activateVoice(v, port_index, channel, key, noteid);
+        steals++;
     }
+}
 
-    dataCopyForUI.updateCount++;
-    dataCopyForUI.polyphony++;
+void ClapSawDemo::queueTermination(int portid, int channel, int key, int note_id)
+{
+    auto t = Termination{portid, channel, key, note_id};
+    if (terminatedCount < maxTerminations)
+        terminatedVoices[terminatedCount++] = t;
+    else
+        sendNoteEnd(t, eventFrame);
+}
 
-    if (editor)
+void ClapSawDemo::sendNoteEnd(const Termination &t, uint32_t time)
+{
+    if (eventsOut)
     {
-        auto r = ToUI();
-        r.type = ToUI::MIDI_NOTE_ON;
-        r.id = (uint32_t)key;
-        toUiQ.try_enqueue(r);
+        auto evt = clap_event_note();
+        evt.header.size = sizeof(clap_event_note);
+        evt.header.type = (uint16_t)CLAP_EVENT_NOTE_END;
+        evt.header.time = time;
+        evt.header.space_id = CLAP_CORE_EVENT_SPACE_ID;
+        evt.header.flags = 0;
+
+        evt.port_index = t.portid;
+        evt.channel = t.channel;
+        evt.key = t.key;
+        evt.note_id = t.note_id;
+        evt.velocity = 0.0;
+
+        eventsOut->try_push(eventsOut, &(evt.header));
     }
 }
 
 void ClapSawDemo::handleNoteOff(int port_index, int channel, int n)
 {
+    dataCopyForUI.keys.noteOff(n);
+
     for (auto &v : voices)
     {
         if (v.isPlaying() && v.key == n && v.portid == port_index && v.channel == channel)
@@ -812,32 +1629,41 @@ void ClapSawDemo::handleNoteOff(int port_index, int channel, int n)
             v.release();
         }
     }
-
-    if (editor)
-    {
-        auto r = ToUI();
-        r.type = ToUI::MIDI_NOTE_OFF;
-        r.id = (uint32_t)n;
-        toUiQ.try_enqueue(r);
-    }
 }
 
 void ClapSawDemo::activateVoice(SawDemoVoice &v, int port_index, int channel, int key, int noteid)
 {
-    v.unison = std::max(1, std::min(7, (int)unisonCount));
+    v.unison = std::clamp((int)unisonCount, 1, SawDemoVoice::max_uni);
     v.filterMode = (int)static_cast<int>(filterMode);
     v.note_id = noteid;
     v.portid = port_index;
+    v.outputPort = outputPortFor(channel, key);
+    v.keyPitch = (float)currentTuning->keyNote[std::clamp(key, 0, 127)];
+    v.controlPhase = (int)(SawDemoVoice::controlBlockSize -
+                           (controlGridPhase + eventFrame) % SawDemoVoice::controlBlockSize);
     v.channel = channel;
+    v.startSample = samplesProcessed + eventFrame;
 
     v.uniSpread = unisonSpread;
     v.oscDetune = oscDetune;
     v.cutoff = cutoff;
     v.res = resonance;
     v.preFilterVCA = preFilterVCA;
-    v.ampRelease = scaleTimeParamToSeconds(ampRelease);
-    v.ampAttack = scaleTimeParamToSeconds(ampAttack);
+    v.ampAttack = ampAttack;
+    v.ampDecay = ampDecay;
+    v.ampSustain = ampSustain;
+    v.ampRelease = ampRelease;
     v.ampGate = ampIsGate > 0.5;
+    v.lfoRate = lfoRate;
+    v.lfoShape = std::clamp((int)lfoShape, 0, nLFOShapes - 1);
+    v.lfoToPitch = lfoToPitch;
+    v.lfoToCutoff = lfoToCutoff;
+    v.lfoToVCA = lfoToVCA;
+    v.fegAttack = fegAttack;
+    v.fegDecay = fegDecay;
+    v.fegSustain = fegSustain;
+    v.fegRelease = fegRelease;
+    v.fegToCutoff = fegToCutoff;
 
     // reset all the modulations
     v.cutoffMod = 0;
@@ -845,6 +1671,8 @@ void ClapSawDemo::activateVoice(SawDemoVoice &v, int port_index, int channel, in
     v.resMod = 0;
     v.preFilterVCAMod = 0;
     v.uniSpreadMod = 0;
+    v.ampAttackMod = 0;
+    v.ampReleaseMod = 0;
     v.volumeNoteExpressionValue = 0;
     v.pitchNoteExpressionValue = 0;
 
@@ -860,6 +1688,15 @@ void ClapSawDemo::paramsFlush(const clap_input_events *in, const clap_output_eve
 {
     auto sz = in->size(in);
 
+    if (recorder)
+        recorder->flush(in);
+
+    // There's no audio to glide across, so modulation lands immediately
+    modRampSamples = 0;
+    eventFrame = 0;
+    eventsOut = out;
+    adoptPendingTuning();
+
     // This pointer is the sentinel to our next event which we advance once an event is processed
     for (auto e = 0U; e < sz; ++e)
     {
@@ -868,6 +1705,8 @@ void ClapSawDemo::paramsFlush(const clap_input_events *in, const clap_output_eve
     }
 
     handleEventsFromUIQueue(out);
+    eventsOut = nullptr;
+    publishVoiceState(0.f);
 
     // We will never generate a note end event with processing active, and we have no midi
     // output, so we are done.
@@ -884,34 +1723,107 @@ void ClapSawDemo::pushParamsToVoices()
             v.cutoff = cutoff;
             v.res = resonance;
             v.preFilterVCA = preFilterVCA;
-            v.ampRelease = scaleTimeParamToSeconds(ampRelease);
-            v.ampAttack = scaleTimeParamToSeconds(ampAttack);
+            v.ampAttack = ampAttack;
+            v.ampDecay = ampDecay;
+            v.ampSustain = ampSustain;
+            v.ampRelease = ampRelease;
             v.ampGate = ampIsGate > 0.5;
             v.filterMode = filterMode;
+            v.lfoRate = lfoRate;
+            v.lfoShape = std::clamp((int)lfoShape, 0, nLFOShapes - 1);
+            v.lfoToPitch = lfoToPitch;
+            v.lfoToCutoff = lfoToCutoff;
+            v.lfoToVCA = lfoToVCA;
+            v.fegAttack = fegAttack;
+            v.fegDecay = fegDecay;
+            v.fegSustain = fegSustain;
+            v.fegRelease = fegRelease;
+            v.fegToCutoff = fegToCutoff;
 
             v.recalcPitch();
             v.recalcFilter();
+            v.recalcEnvelope();
         }
     }
 }
 
 float ClapSawDemo::scaleTimeParamToSeconds(float param)
 {
-    auto scaleTime = std::clamp((param - 2.0 / 3.0) * 6, -100.0, 2.0);
-    auto res = powf(2.f, scaleTime);
-    return res;
+    return SawDemoVoice::timeParamToSeconds(param);
 }
 
 float ClapSawDemo::scaleSecondsToTimeParam(float seconds)
 {
     seconds = std::max(seconds, 0.000001f);
-    auto scaleTime = std::clamp((float)log2(seconds), -100.f, 2.f);
+    auto scaleTime = std::clamp(fastmath::log2(seconds), -100.f, 2.f);
 
     // scaletime = (param - 2 / 3) * 6 so
     // param = scaleTime / 6 + 2/ 3
 
-    auto param = scaleTime / 6 * 2.0 / 3.0;
-    return param;
+    return std::clamp(scaleTime / 6 + 2.f / 3.f, 0.f, 1.f);
+}
+
+namespace
+{
+std::string escapeStatePath(const std::string &p)
+{
+    std::string res;
+    for (auto c : p)
+    {
+        if (c == '%')
+            res += "%25";
+        else if (c == ';')
+            res += "%3B";
+        else
+            res += c;
+    }
+    return res;
+}
+
+std::string unescapeStatePath(const std::string &p)
+{
+    std::string res;
+    for (size_t i = 0; i < p.size(); ++i)
+    {
+        if (p[i] == '%' && p.compare(i, 3, "%25") == 0)
+        {
+            res += '%';
+            i += 2;
+        }
+        else if (p[i] == '%' && p.compare(i, 3, "%3B") == 0)
+        {
+            res += ';';
+            i += 2;
+        }
+        else
+        {
+            res += p[i];
+        }
+    }
+    return res;
+}
+} // namespace
+
+// One CC-<channel>-<cc>=<param id>,<lo>,<hi> state item. Anything malformed is dropped.
+void ClapSawDemo::loadCCMapping(const std::string &key, const std::string &value)
+{
+    int ch, cc;
+    unsigned int id;
+    char sep;
+    std::istringstream k(key.substr(3)), v(value);
+    k.imbue(std::locale("C"));
+    v.imbue(std::locale("C"));
+    CCMap::Mapping m;
+    if (!(k >> ch >> sep >> cc) || sep != '-' || ch < 0 || ch >= CCMap::nChannels || cc < 0 ||
+        cc >= CCMap::nCCs)
+        return;
+    if (!(v >> id >> sep >> m.lo >> sep >> m.hi))
+        return;
+    for (int i = 0; i < nParams; ++i)
+        if (paramIdList[i] == id)
+            m.param = i;
+    if (m.param >= 0)
+        ccMap.set(ch, cc, m);
 }
 
 bool ClapSawDemo::stateSave(const clap_ostream *stream) noexcept
@@ -924,13 +1836,29 @@ bool ClapSawDemo::stateSave(const clap_ostream *stream) noexcept
     auto cloc = std::locale("C");
     oss.imbue(cloc);
     oss << "STREAM-VERSION-1;";
-    for (const auto &[id, val] : paramToValue)
+    for (auto id : paramIdList)
     {
-        oss << id << "=" << std::setw(30) << std::setprecision(20) << *val << ";";
+        oss << id << "=" << std::setw(30) << std::setprecision(20) << *paramValuePtr(id) << ";";
+    }
+    // Older versions skip these since their ids aren't numbers. The paths are escaped so they
+    // can't contain our separator.
+    if (!tuningSclPath.empty())
+        oss << "TUNING-SCL=" << escapeStatePath(tuningSclPath) << ";";
+    if (!tuningKbmPath.empty())
+        oss << "TUNING-KBM=" << escapeStatePath(tuningKbmPath) << ";";
+    for (int ch = 0; ch < CCMap::nChannels; ++ch)
+    {
+        for (int cc = 0; cc < CCMap::nCCs; ++cc)
+        {
+            auto m = ccMap.get(ch, cc);
+            if (m.param >= 0)
+                oss << "CC-" << ch << "-" << cc << "=" << paramIdList[m.param] << ","
+                    << m.lo << "," << m.hi << ";";
+        }
     }
-    _DBGCOUT << oss.str() << std::endl;
-
     auto st = oss.str();
+    _DBGLOG(Debug, "Saving {} params in {} bytes", nParams, st.length());
+
     auto c = st.c_str();
     auto s = st.length() + 1; // write the null terminator
     while (s > 0)
@@ -946,6 +1874,8 @@ bool ClapSawDemo::stateSave(const clap_ostream *stream) noexcept
 
 bool ClapSawDemo::stateLoad(const clap_istream *stream) noexcept
 {
+    _TRACE_SCOPE("stateLoad");
+
     // Again, see the comment above on 'this is terrible'
     static constexpr uint32_t maxSize = 4096 * 8, chunkSize = 256;
     char buffer[maxSize];
@@ -960,7 +1890,7 @@ bool ClapSawDemo::stateLoad(const clap_istream *stream) noexcept
         totalRd += rd;
         if (totalRd >= maxSize - chunkSize - 1)
         {
-            _DBGCOUT << "Invalid stream: Why did you send me so many bytes!" << std::endl;
+            _DBGLOG(Warn, "Invalid stream: Why did you send me so many bytes!");
             // What the heck? You sdent me more than 32kb of data for a 700 byte string?
             // That means my next chunk read will blow out memory so....
             return false;
@@ -972,7 +1902,7 @@ bool ClapSawDemo::stateLoad(const clap_istream *stream) noexcept
         buffer[totalRd] = 0;
 
     auto dat = std::string(buffer);
-    _DBGCOUT << dat << std::endl;
+    _DBGLOG(Debug, "Loading state of {} bytes", totalRd);
 
     std::vector<std::string> items;
     size_t spos{0};
@@ -985,27 +1915,256 @@ bool ClapSawDemo::stateLoad(const clap_istream *stream) noexcept
 
     if (items[0] != "STREAM-VERSION-1")
     {
-        _DBGCOUT << "Invalid stream" << std::endl;
+        _DBGLOG(Warn, "Invalid stream");
         return false;
     }
+    std::string sclPath, kbmPath;
+    ccMap.clearAll();
     for (auto i : items)
     {
         auto epos = i.find('=');
         if (epos == std::string::npos)
             continue; // oh well
+
+        auto key = i.substr(0, epos);
+        if (key == "TUNING-SCL" || key == "TUNING-KBM")
+        {
+            (key == "TUNING-SCL" ? sclPath : kbmPath) = unescapeStatePath(i.substr(epos + 1));
+            continue;
+        }
+        if (key.compare(0, 3, "CC-") == 0)
+        {
+            loadCCMapping(key, i.substr(epos + 1));
+            continue;
+        }
+
         auto id = std::atoi(i.substr(0, epos).c_str());
         double val = 0.0;
         std::istringstream istr(i.substr(epos + 1));
         istr.imbue(std::locale("C"));
         istr >> val;
 
-        *(paramToValue[(paramIds)id]) = val;
+        auto pv = paramValuePtr(id);
+        if (pv)
+            *pv = val;
     }
 
     pushParamsToVoices();
+
+    // A session whose tuning files have gone missing still loads, in standard tuning
+    std::string error;
+    if (!loadTuning(sclPath, kbmPath, error))
+    {
+        // rtlog keeps string arguments by pointer until the drain, which error won't outlive
+        _DBGLOG(Warn, "Unable to restore the session's tuning; using standard tuning");
+        loadTuning("", "", error);
+    }
+    return true;
+}
+
+bool ClapSawDemo::activate(double sampleRate, uint32_t minFrameCount,
+                           uint32_t maxFrameCount) noexcept
+{
+    dataCopyForUI.keys.clear();
+    samplesProcessed = 0;
+
+    auto &kernels = selectVoiceKernels();
+    _DBGLOG(Info, "Voice kernels {}", kernels.name);
+
+    auto cutoffTable = cutoffPrewarpTableFor(sampleRate);
+    for (auto &v : voices)
+        v.setSampleRate(sampleRate, cutoffTable);
+
+    // Each channel starts on a cache line, so round the stride up to a whole number of them
+    scratchFrames = 0;
+    busScratchChans = {};
+    busScratch.release();
+    if (maxFrameCount > 0 && maxFrameCount <= maxScratchFrames)
+    {
+        auto stride = AlignedBuffer::roundUp(maxFrameCount);
+        auto nPorts = outputPortCount();
+        if (busScratch.allocate(stride * maxBusChans * nPorts))
+        {
+            for (uint32_t p = 0; p < nPorts; ++p)
+                for (uint32_t ch = 0; ch < maxBusChans; ++ch)
+                    busScratchChans[p][ch] = busScratch.data() + (p * maxBusChans + ch) * stride;
+            scratchFrames = maxFrameCount;
+        }
+        else
+        {
+            _DBGLOG(Warn, "Unable to allocate output scratch; mixing into host buffers");
+        }
+    }
+
+    if (recorder)
+    {
+        std::array<uint32_t, nParams> ids;
+        std::array<double, nParams> values;
+        for (int i = 0; i < nParams; ++i)
+        {
+            ids[i] = paramIdList[i];
+            values[i] = *paramValuePtr(paramIdList[i]);
+        }
+        recorder->activate(sampleRate, minFrameCount, maxFrameCount, portLayout, ids.data(),
+                           values.data(), nParams);
+    }
+    return true;
+}
+
+void ClapSawDemo::deactivate() noexcept
+{
+    if (recorder)
+        recorder->deactivate();
+
+    busScratch.release();
+    busScratchChans = {};
+    scratchFrames = 0;
+
+    // If the editor went away while we were active, we kept the queues for the audio
+    // thread. It's stopped now, so they can go.
+    if (!editor)
+        releaseUIQueues();
+
+    // Likewise the offline workers, if we're back to real time
+    if (!offlineRender)
+        offlineEngine.reset();
+}
+
+/*
+ * The host may switch modes while the audio thread runs, so the audio thread only looks at
+ * offlineEngine after seeing offlineRender set, and the engine is only freed once processing
+ * has stopped (in deactivate). Making the threads can fail, in which case we stay live.
+ */
+bool ClapSawDemo::renderSetMode(clap_plugin_render_mode mode) noexcept
+{
+    if (mode != CLAP_RENDER_REALTIME && mode != CLAP_RENDER_OFFLINE)
+        return false;
+
+    if (mode == CLAP_RENDER_OFFLINE && !offlineEngine)
+    {
+        try
+        {
+            offlineEngine = std::make_unique<OfflineEngine>(RenderPool::defaultWorkers());
+        }
+        catch (const std::exception &)
+        {
+            _DBGLOG(Warn, "Unable to start offline render workers; staying real time");
+            return false;
+        }
+        _DBGLOG(Debug, "Offline rendering with {} threads", offlineEngine->pool.threads());
+    }
+
+    offlineRender.store(mode == CLAP_RENDER_OFFLINE, std::memory_order_release);
+    return true;
+}
+
+void ClapSawDemo::onMainThread() noexcept
+{
+    logDrainRequested = false;
+    rtlog::drainToStdout();
+    collectRetiredTuning();
+}
+
+namespace
+{
+bool readWholeFile(const std::string &path, std::string &contents)
+{
+    std::ifstream ifs(path, std::ios::binary);
+    if (!ifs)
+        return false;
+    std::ostringstream oss;
+    oss << ifs.rdbuf();
+    contents = oss.str();
+    return true;
+}
+} // namespace
+
+bool ClapSawDemo::loadTuning(const std::string &sclPath, const std::string &kbmPath,
+                             std::string &error)
+{
+    auto table = std::make_unique<TuningTable>();
+
+    if (!sclPath.empty() || !kbmPath.empty())
+    {
+        // Either file can be missing; the defaults are 12-TET and the standard mapping
+        Scale scale;
+        for (int i = 1; i <= 12; ++i)
+            scale.cents.push_back(i * 100.0);
+        KeyboardMapping mapping;
+
+        std::string contents;
+        if (!sclPath.empty())
+        {
+            if (!readWholeFile(sclPath, contents))
+            {
+                error = "Unable to read '" + sclPath + "'";
+                return false;
+            }
+            if (!parseScl(contents, scale, error))
+                return false;
+        }
+        if (!kbmPath.empty())
+        {
+            if (!readWholeFile(kbmPath, contents))
+            {
+                error = "Unable to read '" + kbmPath + "'";
+                return false;
+            }
+            if (!parseKbm(contents, mapping, error))
+                return false;
+        }
+        if (!table->build(scale, mapping, error))
+            return false;
+    }
+
+    collectRetiredTuning();
+    delete pendingTuning.exchange(table.release(), std::memory_order_acq_rel);
+    tuningSclPath = sclPath;
+    tuningKbmPath = kbmPath;
+
+    // With no audio thread running we can swap it in ourselves
+    if (!isActive())
+    {
+        adoptPendingTuning();
+        collectRetiredTuning();
+    }
+
+    // Not the paths: rtlog keeps string arguments by pointer until the drain
+    _DBGLOG(Info, "Loaded tuning (scale file {}, mapping file {})", !sclPath.empty(),
+            !kbmPath.empty());
     return true;
 }
 
+void ClapSawDemo::adoptPendingTuning()
+{
+    // If the main thread hasn't freed the last table yet, pick this one up next block
+    if (retiredTuning.load(std::memory_order_acquire))
+        return;
+
+    auto t = pendingTuning.exchange(nullptr, std::memory_order_acq_rel);
+    if (!t)
+        return;
+
+    retiredTuning.store(currentTuning, std::memory_order_release);
+    currentTuning = t;
+
+    for (auto &v : voices)
+    {
+        if (v.isPlaying())
+        {
+            v.keyPitch = (float)currentTuning->keyNote[std::clamp(v.key, 0, 127)];
+            v.recalcPitch();
+        }
+    }
+
+    _host.requestCallback();
+}
+
+void ClapSawDemo::collectRetiredTuning()
+{
+    delete retiredTuning.exchange(nullptr, std::memory_order_acq_rel);
+}
+
 /*
  * A simple passthrough. Put it here to allow the template mechanics to see the impl.
  */
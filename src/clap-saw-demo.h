@@ -11,6 +11,7 @@
 #define CLAP_SAW_DEMO_H
 #include <iostream>
 #include "debug-helpers.h"
+#include "perf-trace.h"
 
 /*
  * ClapSawDemo is the core synthesizer class. It uses the clap-helpers C++ plugin extensions
@@ -36,11 +37,18 @@
 #include <clap/helpers/plugin.hh>
 #include <atomic>
 #include <array>
-#include <unordered_map>
 #include <memory>
 #include <readerwriterqueue.h>
 
 #include "saw-voice.h"
+#include "voice-kernels.h"
+#include "tuning.h"
+#include "render-pool.h"
+#include "aligned-buffer.h"
+#include "event-recorder.h"
+#include "key-state.h"
+#include "snapshot-buffer.h"
+#include "cc-map.h"
 #include <memory>
 
 namespace sst::clap_saw_demo
@@ -48,8 +56,30 @@ namespace sst::clap_saw_demo
 
 struct ClapSawDemoEditor;
 
-struct ClapSawDemo : public clap::helpers::Plugin<clap::helpers::MisbehaviourHandler::Terminate,
-                                                  clap::helpers::CheckingLevel::Maximal>
+/*
+ * The clap-helpers Plugin base can check, on every host call, that the host is calling
+ * from the right thread and in the right state. That's great while developing (and a big
+ * reason to use the helpers at all) but it is a cost on every call in a shipping plugin.
+ * So the level is picked at build time by the CLAP_SAW_DEMO_CHECKING_LEVEL cmake option,
+ * which arrives here as 0 (None), 1 (Minimal) or 2 (Maximal). The default is Maximal for
+ * debug builds and None for everything else; a build without the definition gets Maximal.
+ */
+#if !defined(CLAP_SAW_DEMO_CHECKING_LEVEL)
+#define CLAP_SAW_DEMO_CHECKING_LEVEL 2
+#endif
+
+#if CLAP_SAW_DEMO_CHECKING_LEVEL == 0
+static constexpr auto pluginCheckingLevel = clap::helpers::CheckingLevel::None;
+#elif CLAP_SAW_DEMO_CHECKING_LEVEL == 1
+static constexpr auto pluginCheckingLevel = clap::helpers::CheckingLevel::Minimal;
+#else
+static constexpr auto pluginCheckingLevel = clap::helpers::CheckingLevel::Maximal;
+#endif
+
+using ClapSawDemoBase =
+    clap::helpers::Plugin<clap::helpers::MisbehaviourHandler::Terminate, pluginCheckingLevel>;
+
+struct ClapSawDemo : public ClapSawDemoBase
 {
     static constexpr int max_voices = 64;
     ClapSawDemo(const clap_host *host);
@@ -64,15 +94,29 @@ struct ClapSawDemo : public clap::helpers::Plugin<clap::helpers::MisbehaviourHan
     /*
      * Activate makes sure sampleRate is distributed through
      * the data structures, in this case by stamping the sampleRate
-     * onto each pre-allocated voice object.
+     * and the shared cutoff table for that rate onto each pre-allocated voice object. It also
+     * picks the voice kernels for this CPU (see voice-kernels.h) and makes the output scratch
+     * for maxFrameCount samples, which deactivate frees.
      */
     bool activate(double sampleRate, uint32_t minFrameCount,
-                  uint32_t maxFrameCount) noexcept override
-    {
-        for (auto &v : voices)
-            v.sampleRate = sampleRate;
-        return true;
-    }
+                  uint32_t maxFrameCount) noexcept override;
+    void deactivate() noexcept override;
+
+    /*
+     * Tuning. loadTuning reads and parses the Scala files and builds a TuningTable on the
+     * main thread (empty paths mean standard tuning). The new table goes in pendingTuning, and
+     * at the top of the next block the audio thread adopts it, retuning any sounding voices,
+     * and hands the table it replaced back in retiredTuning. That gets freed on the main
+     * thread in onMainThread or the next loadTuning. The audio thread won't adopt again until
+     * the retired slot is empty, so each pointer only ever has one owner and neither side
+     * locks or allocates on the other's behalf.
+     */
+    bool loadTuning(const std::string &sclPath, const std::string &kbmPath, std::string &error);
+    void adoptPendingTuning();
+    void collectRetiredTuning();
+    std::string tuningSclPath, tuningKbmPath; // main thread only
+    TuningTable *currentTuning{nullptr};      // audio thread only (or main when inactive)
+    std::atomic<TuningTable *> pendingTuning{nullptr}, retiredTuning{nullptr};
 
     /*
      * Parameter Handling:
@@ -84,9 +128,10 @@ struct ClapSawDemo : public clap::helpers::Plugin<clap::helpers::MisbehaviourHan
      *
      * The implementation of paramsInfo contains the setup of these params.
      *
-     * The actual synth has a very simple model to update parameter values. It
-     * contains a map from these IDs to a double * which the constructor sets up
-     * as references to members.
+     * The actual synth has a very simple model to update parameter values. Each ID
+     * maps to a double member via the switch in paramValuePtr. (This used to be a
+     * std::unordered_map, but a few hundred instances each holding a heap allocated map
+     * for ten entries adds up, and the switch is faster anyway).
      */
     enum paramIds : uint32_t
     {
@@ -95,6 +140,8 @@ struct ClapSawDemo : public clap::helpers::Plugin<clap::helpers::MisbehaviourHan
         pmOscDetune = 8675309,
 
         pmAmpAttack = 2874,
+        pmAmpDecay = 3271,
+        pmAmpSustain = 4417,
         pmAmpRelease = 728,
         pmAmpIsGate = 1942,
 
@@ -102,20 +149,64 @@ struct ClapSawDemo : public clap::helpers::Plugin<clap::helpers::MisbehaviourHan
 
         pmCutoff = 17,
         pmResonance = 94,
-        pmFilterMode = 14255
+        pmFilterMode = 14255,
+
+        pmLfoRate = 5113,
+        pmLfoShape = 5128,
+        pmLfoToPitch = 5209,
+        pmLfoToCutoff = 5237,
+        pmLfoToVCA = 5261,
+
+        pmFegAttack = 6031,
+        pmFegDecay = 6047,
+        pmFegSustain = 6053,
+        pmFegRelease = 6089,
+        pmFegToCutoff = 6113
     };
-    static constexpr int nParams = 10;
+    static constexpr int nParams = 22;
+    static constexpr std::array<paramIds, nParams> paramIdList{
+        pmUnisonCount, pmUnisonSpread, pmOscDetune,  pmAmpAttack,   pmAmpRelease, pmAmpIsGate,
+        pmPreFilterVCA, pmCutoff,      pmResonance,  pmFilterMode,  pmAmpDecay,   pmAmpSustain,
+        pmLfoRate,     pmLfoShape,     pmLfoToPitch, pmLfoToCutoff, pmLfoToVCA,   pmFegAttack,
+        pmFegDecay,    pmFegSustain,   pmFegRelease, pmFegToCutoff};
+    double *paramValuePtr(clap_id paramId) noexcept;
+    const double *paramValuePtr(clap_id paramId) const noexcept
+    {
+        return const_cast<ClapSawDemo *>(this)->paramValuePtr(paramId);
+    }
 
     bool implementsParams() const noexcept override { return true; }
     bool isValidParamId(clap_id paramId) const noexcept override
     {
-        return paramToValue.find(paramId) != paramToValue.end();
+        return paramValuePtr(paramId) != nullptr;
     }
     uint32_t paramsCount() const noexcept override { return nParams; }
     bool paramsInfo(uint32_t paramIndex, clap_param_info *info) const noexcept override;
+    /*
+     * MIDI CC mapping (see cc-map.h). A mapped CC sets its parameter exactly as a host
+     * CLAP_EVENT_PARAM_VALUE does, through applyParamValue, and then tells the host about
+     * the new value. The editor arms MIDI learn for a parameter with FromUI::LEARN_CC and
+     * the next CC to arrive is mapped to it. paramRanges caches each parameter's range (by
+     * paramIdList index) so a CC doesn't call paramsInfo.
+     */
+    CCMap ccMap;
+    struct ParamRange
+    {
+        double min{0}, max{1};
+        bool stepped{false};
+    };
+    std::array<ParamRange, nParams> paramRanges{};
+    int ccLearnParam{-1}; // audio thread only
+    void applyParamValue(clap_id paramId, double value);
+    void handleCC(int channel, int cc, int value);
+    void loadCCMapping(const std::string &key, const std::string &value);
+
     bool paramsValue(clap_id paramId, double *value) noexcept override
     {
-        *value = *paramToValue[paramId];
+        auto pv = paramValuePtr(paramId);
+        if (!pv)
+            return false;
+        *value = *pv;
         return true;
     }
 
@@ -124,9 +215,9 @@ struct ClapSawDemo : public clap::helpers::Plugin<clap::helpers::MisbehaviourHan
      * For instance we model filter cutoff in 12-TET MIDI Note space, so the value
      * "60" of pmCutoff shows as "261.6 hz" and "69" (concert A) as "440 hz". Similarly
      * this is where we show our time scaling for our attack and release, filter type,
-     * and so on. If you want, you can also implement paramsTextToValue which is the
-     * inverse function, for hosts which allow user typeins. In this example, we choose
-     * to not implement that.
+     * and so on. paramsTextToValue is the inverse function, for hosts which allow user
+     * typeins. Hosts call paramsValueToText a lot, so both work in the host's buffer without
+     * allocating and without caring about the C locale (see param-text.h).
      */
     bool paramsValueToText(clap_id paramId, double value, char *display,
                            uint32_t size) noexcept override;
@@ -143,12 +234,40 @@ struct ClapSawDemo : public clap::helpers::Plugin<clap::helpers::MisbehaviourHan
      * Many CLAP plugins will want input and output audio and note ports, although
      * the spec doesn't require this. Here as a simple synth we set up a single s
      * stereo output and a single midi / clap_note input.
+     *
+     * Well, a single stereo output by default. Using the audio-ports-config extension the
+     * host can pick one of a few output layouts while we are deactivated: one stereo port,
+     * a stereo port per MIDI channel, or a stereo port per key range. Each voice picks its
+     * port at note on and renders straight into that port's buffer.
      */
+    enum PortLayout : uint32_t
+    {
+        plStereo = 0,
+        plPerChannel = 1,
+        plPerKeyRange = 2,
+        nPortLayouts = 3
+    };
+    static constexpr uint32_t maxOutputPorts = 16;
+    // The first key of each of the plPerKeyRange ports
+    static constexpr std::array<int, 4> keyRangeStarts{0, 48, 72, 96};
+    uint32_t portLayout{plStereo};
+    uint32_t outputPortCount() const noexcept;
+    int outputPortFor(int channel, int key) const noexcept;
+
     bool implementsAudioPorts() const noexcept override { return true; }
-    uint32_t audioPortsCount(bool isInput) const noexcept override { return isInput ? 0 : 1; }
+    uint32_t audioPortsCount(bool isInput) const noexcept override
+    {
+        return isInput ? 0 : outputPortCount();
+    }
     bool audioPortsInfo(uint32_t index, bool isInput,
                         clap_audio_port_info *info) const noexcept override;
 
+    bool implementsAudioPortsConfig() const noexcept override { return true; }
+    uint32_t audioPortsConfigCount() const noexcept override { return nPortLayouts; }
+    bool audioPortsConfigGet(uint32_t index,
+                             clap_audio_ports_config *config) const noexcept override;
+    bool audioPortsConfigSelect(clap_id configId) noexcept override;
+
     bool implementsNotePorts() const noexcept override { return true; }
     uint32_t notePortsCount(bool isInput) const noexcept override { return isInput ? 1 : 0; }
     bool notePortsInfo(uint32_t index, bool isInput,
@@ -178,6 +297,18 @@ struct ClapSawDemo : public clap::helpers::Plugin<clap::helpers::MisbehaviourHan
     bool stateSave(const clap_ostream *) noexcept override;
     bool stateLoad(const clap_istream *) noexcept override;
 
+    /*
+     * Render tells us if the host is playing live or bouncing offline. Live, we render the
+     * voices one batch after another on the audio thread. Offline nobody is waiting on the
+     * block, so we render the batches in parallel on a RenderPool and mix them afterwards in
+     * the same order the live path adds them, which keeps the output bit for bit the same.
+     * The pool and its scratch are made on the main thread the first time we go offline and
+     * kept until we deactivate back in real time mode.
+     */
+    bool implementsRender() const noexcept override { return true; }
+    bool renderHasHardRealtimeRequirement() noexcept override { return false; }
+    bool renderSetMode(clap_plugin_render_mode mode) noexcept override;
+
     /*
      * process is the meat of the operation. It does obvious things like trigger
      * voices but also handles all the polyphonic modulation and so on. Please see the
@@ -185,13 +316,67 @@ struct ClapSawDemo : public clap::helpers::Plugin<clap::helpers::MisbehaviourHan
      * delegated to.
      */
     clap_process_status process(const clap_process *process) noexcept override;
+    void renderVoices(uint32_t offset, uint32_t frames);
+    // Render a batch from offset for frames, adding it to the output buses. If capture is
+    // given, store the batch's lanes there instead (frames must fit; see OfflineEngine)
+    void renderVoiceBatch(const int *voiceIndices, int count, uint32_t offset, uint32_t frames,
+                          float (*capture)[StereoFilter::batchLanes] = nullptr);
+    void mixVoiceBatch(SawDemoVoice *const *batch, const bool *playing, int count,
+                       const float (*io)[StereoFilter::batchLanes], int n, uint32_t at);
+
+    // Batches of voices in one call to renderVoices: full ones, plus a partial one per model
+    static constexpr int maxVoiceBatches =
+        max_voices / StereoFilter::batchVoices + StereoFilter::nFilterModels;
+    struct OfflineEngine
+    {
+        // Offline, each batch renders this many frames per trip to the pool
+        static constexpr uint32_t blockFrames = 256;
+        struct Scratch
+        {
+            alignas(32) float io[blockFrames][StereoFilter::batchLanes];
+        };
+
+        explicit OfflineEngine(int nWorkers) : pool(nWorkers) {}
+        RenderPool pool;
+        std::array<Scratch, maxVoiceBatches> scratch;
+    };
+    std::unique_ptr<OfflineEngine> offlineEngine;
+    std::atomic<bool> offlineRender{false};
+    // How long a CLAP_EVENT_PARAM_MOD being handled now takes to reach its target
+    uint32_t modRampSamples{0};
+    // Voices keep their control blocks on one grid (see SawDemoVoice::controlPhase) so they
+    // batch well. This is where the first sample of the current block sits on that grid, and
+    // eventFrame is the sample in the block of the event being handled.
+    uint32_t controlGridPhase{0}, eventFrame{0};
     void handleInboundEvent(const clap_event_header_t *evt);
     void pushParamsToVoices();
-    void handleNoteOn(int port_index, int channel, int key, int noteid);
+    void handleNoteOn(int port_index, int channel, int key, int noteid, double velocity);
     void handleNoteOff(int port_index, int channel, int key);
+    bool publishVoiceState(float peak);
+    // For the telemetry: samples since activate (voice ages count from it) and voices stolen
+    uint64_t samplesProcessed{0}, steals{0};
     void activateVoice(SawDemoVoice &v, int port_index, int channel, int key, int noteid);
     void handleEventsFromUIQueue(const clap_output_events_t *);
 
+    /*
+     * Voices which ended (or were stolen) owe the host a NOTE_END. We queue them as they happen
+     * and send them together at the end of the block. The queue is a fixed array so queueing
+     * never allocates on the audio thread. If a flood of steals fills it, the NOTE_END goes
+     * out immediately through eventsOut, stamped with the time of the event which caused it,
+     * so a voice is never silently dropped. eventsOut is the host's output queue for the
+     * duration of ::process or ::paramsFlush and null otherwise.
+     */
+    struct Termination
+    {
+        int portid, channel, key, note_id;
+    };
+    static constexpr int maxTerminations = max_voices * 4;
+    std::array<Termination, maxTerminations> terminatedVoices;
+    int terminatedCount{0};
+    const clap_output_events_t *eventsOut{nullptr};
+    void queueTermination(int portid, int channel, int key, int note_id);
+    void sendNoteEnd(const Termination &t, uint32_t time);
+
     /*
      * In addition to ::process, the plugin should implement ::paramsFlush. ::paramsFlush will be
      * called when processing isn't active (no audio being generated, etc...) but the host or UI
@@ -208,15 +393,21 @@ struct ClapSawDemo : public clap::helpers::Plugin<clap::helpers::MisbehaviourHan
     bool startProcessing() noexcept override
     {
         dataCopyForUI.isProcessing = true;
-        dataCopyForUI.updateCount++;
         return true;
     }
     void stopProcessing() noexcept override
     {
         dataCopyForUI.isProcessing = false;
-        dataCopyForUI.updateCount++;
     }
 
+    /*
+     * The audio thread never formats log output (see rt-log.h). If records are pending at
+     * the end of a block, ::process asks the host for a main thread callback and we drain
+     * the log here. The editor frame and the destructor drain too.
+     */
+    void onMainThread() noexcept override;
+    std::atomic<bool> logDrainRequested{false};
+
   protected:
     /*
      * OK so now you see how the engine works. Great! But how does the GUI work?
@@ -239,10 +430,12 @@ struct ClapSawDemo : public clap::helpers::Plugin<clap::helpers::MisbehaviourHan
      *   gestures and value changes. This is written on the UI thread and read in
      *   stage 1 of `CLapSawDemo::process` go update engine parameters and send parameter
      *   change events to the host from the processing thread.
+     *   These two queues are only allocated while an editor exists (see UIQueues below),
+     *   since most instances in a big session never have their UI open.
      * - A data structure which contains std::atomic values and where the editor keeps
-     *   an in-memory const& to it. ::process updates a counter and the idle loop looks
-     *   for counter changes. This allows values to propagate without events, and we use
-     *   it here for polyphony count.
+     *   an in-memory const& to it. ::process publishes a Telemetry snapshot there each
+     *   block, along with which keys are held and sounding, and the editor samples them
+     *   every frame. This allows values to propagate without events.
      * - A single std::function<void()> which the editor can use to ask the host to do
      *   a parameter flush.
      *
@@ -310,13 +503,11 @@ struct ClapSawDemo : public clap::helpers::Plugin<clap::helpers::MisbehaviourHan
     {
         enum MType
         {
-            PARAM_VALUE = 0x31,
-            MIDI_NOTE_ON,
-            MIDI_NOTE_OFF
+            PARAM_VALUE = 0x31
         } type;
 
-        uint32_t id;  // param-id for PARAM_VALUE, key for noteon/noteoff
-        double value; // value or unused
+        uint32_t id;  // param-id
+        double value; // value
     };
 
     struct FromUI
@@ -325,38 +516,112 @@ struct ClapSawDemo : public clap::helpers::Plugin<clap::helpers::MisbehaviourHan
         {
             BEGIN_EDIT = 0xF9,
             END_EDIT,
-            ADJUST_VALUE
+            ADJUST_VALUE,
+            LEARN_CC, // id is the param to map to the next CC, or CLAP_INVALID_ID to cancel
+            FORGET_CC // id is CCMap::slot(channel, cc)
         } type;
         uint32_t id;
         double value;
     };
 
+    /*
+     * What the engine was doing at the end of the latest block, for the editor to show. It is
+     * built from the voices once a block (and after a flush) rather than counted up and down
+     * as notes come and go, so it costs the same however busy the block was and can't drift.
+     */
+    struct Telemetry
+    {
+        struct Voice
+        {
+            uint8_t state;     // a SawDemoVoice::AEGMode
+            int8_t key;        // -1 when OFF
+            uint8_t port;      // the output port
+            float level;       // of the amplitude envelope
+            uint32_t age;      // samples since note on
+        };
+        uint64_t blocks{0}, steals{0};
+        float sampleRate{0};
+        uint32_t active{0};
+        float peak{0};         // the largest absolute sample out of any port in the block
+        Voice voices[max_voices]{};
+    };
+
     struct DataCopyForUI
     {
-        std::atomic<uint32_t> updateCount{0};
         std::atomic<bool> isProcessing{false};
-        std::atomic<int> polyphony{0};
+        SnapshotBuffer<Telemetry> telemetry;
+        // Running totals of SawDemoVoice::earlyOutCounts, indexed by SawDemoVoice::EarlyOut
+        std::atomic<uint64_t> earlyOuts[SawDemoVoice::nEarlyOuts]{};
+        // Held and sounding keys for the editor's keyboard, published once a block
+        KeyState keys;
     } dataCopyForUI;
 
     typedef moodycamel::ReaderWriterQueue<ToUI, 4096> SynthToUI_Queue_t;
     typedef moodycamel::ReaderWriterQueue<FromUI, 4096> UIToSynth_Queue_t;
 
-    SynthToUI_Queue_t toUiQ;
-    UIToSynth_Queue_t fromUiQ;
+    /*
+     * The queues are created in guiCreate, which the host can call while we are processing,
+     * so they reach the audio thread through an atomic: guiCreate publishes them with a
+     * release store and the audio thread loads them with acquire, and only touches them if
+     * that load is non-null. guiDestroy frees them if we aren't active; otherwise the audio
+     * thread may still be looking at them, so they are kept (and reused by the next
+     * guiCreate) until deactivate or destruction. Only the main thread stores to uiQueues.
+     */
+    struct UIQueues
+    {
+        static constexpr size_t capacity = 4096;
+        SynthToUI_Queue_t toUiQ{capacity};
+        UIToSynth_Queue_t fromUiQ{capacity};
+    };
+    std::atomic<UIQueues *> uiQueues{nullptr};
+    // Main thread, and never while processing
+    void releaseUIQueues() { delete uiQueues.exchange(nullptr, std::memory_order_acq_rel); }
 
   private:
     ClapSawDemoEditor *editor{nullptr};
 
     // These items are ONLY read and written on the audio thread, so they
-    // are safe to be non-atomic doubles. We keep a map to locate them
+    // are safe to be non-atomic doubles. paramValuePtr locates them
     // for parameter updates.
     double unisonCount{3}, unisonSpread{10}, oscDetune{0}, cutoff{69}, resonance{0.7},
-        ampAttack{0.01}, ampRelease{0.2}, ampIsGate{0}, preFilterVCA{1.0}, filterMode{0};
-    std::unordered_map<clap_id, double *> paramToValue;
+        ampAttack{0.01}, ampDecay{0.5}, ampSustain{1.0}, ampRelease{0.2}, ampIsGate{0},
+        preFilterVCA{1.0}, filterMode{0}, lfoRate{2}, lfoShape{0}, lfoToPitch{0}, lfoToCutoff{0},
+        lfoToVCA{0}, fegAttack{0}, fegDecay{0.5}, fegSustain{0}, fegRelease{0.5}, fegToCutoff{0};
 
     // "Voice Management" is "randomly pick a voice to kill and put it in stolen voices"
     std::array<SawDemoVoice, max_voices> voices;
-    std::vector<std::tuple<int, int, int, int>> terminatedVoices; // that's PCK ID
+
+    // The buffers for each of our output ports for the current block. data is where voices
+    // mix to: our scratch for the port if we have it, or else the host's buffers. It is null
+    // for a port the host didn't give us (or gave us without buffers) and voices on that port
+    // only advance their envelope. rendered tracks if anything was written this block.
+    struct OutputBus
+    {
+        float **data{nullptr};
+        uint32_t chans{0};
+        bool rendered{false};
+        float **host{nullptr};
+        uint32_t hostChans{0};
+    };
+    std::array<OutputBus, maxOutputPorts> outputBuses;
+
+    /*
+     * The output scratch. Hosts hand us whatever buffers they like, at any alignment, and
+     * several voices add into each sample. So the voices mix into our own cache line aligned
+     * buffers, one per channel of each port, and process copies the result out once at the
+     * end of the block (or zeroes the host's buffers if the port stayed silent). It is made
+     * at activate for maxFrameCount samples and the current port layout, which can't change
+     * while we are active. A block longer than scratchFrames, which a host shouldn't send,
+     * or a maxFrameCount past maxScratchFrames, mixes straight into the host's buffers.
+     */
+    static constexpr uint32_t maxBusChans = 2, maxScratchFrames = 1 << 16;
+    AlignedBuffer busScratch;
+    uint32_t scratchFrames{0};
+    std::array<std::array<float *, maxBusChans>, maxOutputPorts> busScratchChans{};
+
+    // Set when CLAP_SAW_DEMO_RECORD asks for a recording of what the host sends us; see
+    // event-recorder.h and the --replay mode of the headless host
+    std::unique_ptr<EventRecorder> recorder;
 };
 } // namespace sst::clap_saw_demo
 
@@ -10,13 +10,25 @@
 #ifndef CLAP_SAW_DEMO_DEBUG_HELPERS_H
 #define CLAP_SAW_DEMO_DEBUG_HELPERS_H
 
-// These are just some macros I put in to trace certain lifecycle and value moments to stdout
+// These are just some macros I put in to trace certain lifecycle and value moments.
+//
+// _DBGLOG and _DBGMARK go through the deferred lock-free logger in rt-log.h, so they are
+// safe on the audio thread; the records show up on stdout whenever the main thread drains.
+// Usage is _DBGLOG(Warn, "voice {} stolen at key {}", idx, key); with levels Trace, Debug,
+// Info, Warn and Error filtered at compile time by CLAP_SAW_DEMO_LOG_LEVEL.
+//
+// _DBGCOUT is the old direct-to-cout stream. It blocks, so only use it for ad-hoc debugging
+// on the main thread and never leave it in ::process or anything process calls.
 #include <iostream>
+#include "rt-log.h"
+
+#define _DBGLOG(lvl, ...)                                                                          \
+    ::sst::clap_saw_demo::rtlog::emit<::sst::clap_saw_demo::rtlog::Level::lvl>(                   \
+        __FILE__, __LINE__, __func__, __VA_ARGS__)
+#define _DBGMARK _DBGLOG(Debug, "")
+
 #define _DBGCOUT                                                                                   \
     std::cout << "[clap-saw-demo-imgui] " << __FILE__ << ":" << __LINE__ << " (" << __func__ << ") : "
-#define _DBGMARK                                                                                   \
-    std::cout << "[clap-saw-demo-imgui] " << __FILE__ << ":" << __LINE__ << " (" << __func__ << ")"      \
-              << std::endl;
 #define _D(x) " [" << #x << "=" << x << "] "
 
 #endif // CLAP_SAW_DEMO_DEBUG_HELPERS_H
@@ -0,0 +1,76 @@
+/*
+ * ClapSawDemo
+ * https://github.com/surge-synthesizer/clap-saw-demo
+ *
+ * Copyright 2022 Paul Walker and others as listed in the git history
+ *
+ * Released under the MIT License. See LICENSE.md for full text.
+ */
+
+#ifndef CLAP_SAW_DEMO_DENORMALS_H
+#define CLAP_SAW_DEMO_DENORMALS_H
+
+/*
+ * Denormals (floats so small they lose the implicit leading 1 of the mantissa) show up
+ * whenever a recursive filter rings down toward zero, and on many CPUs every operation on
+ * one takes a microcode assist costing tens to hundreds of cycles. A release tail can then
+ * cost far more than the note it came from.
+ *
+ * The usual fix is to set the floating point control register so the hardware flushes
+ * denormal results to zero (FTZ) and treats denormal inputs as zero (DAZ). The register is
+ * per thread and belongs to the host, so we set it for the duration of our process call
+ * and put it back exactly as we found it on the way out. ScopedDenormalsDisabled does that
+ * on SSE (MXCSR) and AArch64 (FPCR) and does nothing elsewhere.
+ *
+ * This doesn't help on a target without the register or if a host calls us on a thread
+ * where some other code changes it mid call, so the filter also snaps its tiny state to zero
+ * at control rate (see StereoFilter::flushDenormals).
+ */
+
+#include <cstdint>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define CLAP_SAW_DEMO_DENORMALS_SSE 1
+#elif defined(__aarch64__) && (defined(__GNUC__) || defined(__clang__))
+#define CLAP_SAW_DEMO_DENORMALS_AARCH64 1
+#endif
+
+namespace sst::clap_saw_demo
+{
+struct ScopedDenormalsDisabled
+{
+#if CLAP_SAW_DEMO_DENORMALS_SSE
+    // MXCSR bit 15 is FTZ and bit 6 is DAZ
+    static constexpr uint32_t ftzDaz = 0x8040;
+
+    ScopedDenormalsDisabled() : saved(_mm_getcsr()) { _mm_setcsr(saved | ftzDaz); }
+    ~ScopedDenormalsDisabled() { _mm_setcsr(saved); }
+
+    uint32_t saved;
+#elif CLAP_SAW_DEMO_DENORMALS_AARCH64
+    // FPCR bit 24 is FZ, which on AArch64 flushes both inputs and results
+    static constexpr uint64_t fz = 1ULL << 24;
+
+    ScopedDenormalsDisabled() : saved(readFPCR()) { writeFPCR(saved | fz); }
+    ~ScopedDenormalsDisabled() { writeFPCR(saved); }
+
+    static inline uint64_t readFPCR()
+    {
+        uint64_t r;
+        __asm__ __volatile__("mrs %0, fpcr" : "=r"(r));
+        return r;
+    }
+    static inline void writeFPCR(uint64_t r) { __asm__ __volatile__("msr fpcr, %0" : : "r"(r)); }
+
+    uint64_t saved;
+#else
+    ScopedDenormalsDisabled() = default;
+#endif
+
+    ScopedDenormalsDisabled(const ScopedDenormalsDisabled &) = delete;
+    ScopedDenormalsDisabled &operator=(const ScopedDenormalsDisabled &) = delete;
+};
+} // namespace sst::clap_saw_demo
+
+#endif // CLAP_SAW_DEMO_DENORMALS_H
@@ -0,0 +1,119 @@
+/*
+ * ClapSawDemo
+ * https://github.com/surge-synthesizer/clap-saw-demo
+ *
+ * Copyright 2022 Paul Walker and others as listed in the git history
+ *
+ * Released under the MIT License. See LICENSE.md for full text.
+ */
+
+#include "dsp-tables.h"
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace sst::clap_saw_demo
+{
+static constexpr double pival = 3.14159265358979323846;
+
+NoteFrequencyTable::NoteFrequencyTable()
+{
+    for (int n = minNote; n <= maxNote; ++n)
+        noteFrequency[n - minNote] = 440.0 * std::pow(2.0, (n - 69.0) / 12.0);
+    for (int i = 0; i <= fineSteps; ++i)
+        fineRatio[i] = std::pow(2.0, 1.0 * i / fineSteps / 12.0);
+}
+
+const NoteFrequencyTable &noteFrequencyTable()
+{
+    static const NoteFrequencyTable table;
+    return table;
+}
+
+UnisonLayoutTable::UnisonLayoutTable()
+{
+    for (int count = 1; count <= maxUnison; ++count)
+    {
+        auto &l = layouts[count - 1];
+        l.unitShift.fill(0.f);
+        l.startPhase.fill(0.f);
+        l.panNormL.fill(0.f);
+        l.panNormR.fill(0.f);
+
+        if (count == 1)
+        {
+            l.panNormL[0] = 1.f;
+            l.panNormR[0] = 1.f;
+            continue;
+        }
+
+        auto norm = 1.0 / std::sqrt(count);
+        for (int i = 0; i < count; ++i)
+        {
+            auto dI = 1.0 * i / (count - 1);
+            l.unitShift[i] = (float)(2 * dI - 1);
+            l.startPhase[i] = (float)dI;
+            l.panNormL[i] = (float)(std::cos(0.5 * pival * dI) * norm);
+            l.panNormR[i] = (float)(std::sin(0.5 * pival * dI) * norm);
+        }
+    }
+}
+
+const UnisonLayoutTable &unisonLayoutTable()
+{
+    static const UnisonLayoutTable table;
+    return table;
+}
+
+CutoffPrewarpTable::CutoffPrewarpTable(double sr) : sampleRate(sr)
+{
+    // The clamp has to stay below nyquist or tan flips sign, which matters at low rates
+    auto hiHz = std::min((double)highestHz, 0.45 * sr);
+    lowKey = (float)(69.0 + 12.0 * std::log2(lowestHz / 440.0));
+    highKey = std::min((float)(69.0 + 12.0 * std::log2(hiHz / 440.0)), keyRange);
+
+    // keyToG clamps the key to [lowKey, highKey] before the lookup, so build the table from
+    // the unclamped curve (with a semitone of margin) to keep interpolation smooth at the knees
+    auto semi = std::pow(2.0, 1.0 / 12.0);
+    for (size_t i = 0; i < g.size(); ++i)
+    {
+        auto key = 1.0 * i / stepsPerKey;
+        auto co = std::clamp(440.0 * std::pow(2.0, (key - 69.0) / 12.0), lowestHz / semi,
+                             hiHz * semi);
+        g[i] = (float)std::tan(pival * co / sr);
+    }
+}
+
+namespace
+{
+struct CutoffRegistry
+{
+    std::mutex lock;
+    std::vector<std::unique_ptr<CutoffPrewarpTable>> tables;
+};
+CutoffRegistry &cutoffRegistry()
+{
+    static CutoffRegistry r;
+    return r;
+}
+} // namespace
+
+const CutoffPrewarpTable *cutoffPrewarpTableFor(double sampleRate)
+{
+    auto &r = cutoffRegistry();
+    std::lock_guard<std::mutex> g(r.lock);
+    for (const auto &t : r.tables)
+        if (t->sampleRate == sampleRate)
+            return t.get();
+
+    r.tables.push_back(std::make_unique<CutoffPrewarpTable>(sampleRate));
+    return r.tables.back().get();
+}
+
+void releaseDspTables()
+{
+    auto &r = cutoffRegistry();
+    std::lock_guard<std::mutex> g(r.lock);
+    r.tables.clear();
+}
+} // namespace sst::clap_saw_demo
@@ -0,0 +1,132 @@
+/*
+ * ClapSawDemo
+ * https://github.com/surge-synthesizer/clap-saw-demo
+ *
+ * Copyright 2022 Paul Walker and others as listed in the git history
+ *
+ * Released under the MIT License. See LICENSE.md for full text.
+ */
+
+#ifndef CLAP_SAW_DEMO_DSP_TABLES_H
+#define CLAP_SAW_DEMO_DSP_TABLES_H
+
+/*
+ * The voices convert MIDI-note-space values to frequencies (for the oscillator and the
+ * unison detune) and to the prewarped filter coefficient g = tan(pi * f / sr) every time
+ * a note starts or a modulation arrives. Rather than have every voice in every instance
+ * call pow and tan, we build a few small immutable tables once per process and share them.
+ *
+ * - NoteFrequencyTable maps a fractional MIDI note to Hz. It is two level: one entry per
+ *   semitone and a 1/256 semitone fine table which we interpolate, so the whole thing is
+ *   about 5kb and accurate to well under a thousandth of a cent. It is built the first time
+ *   anyone asks for it (which is clap_init) and is thread-safe via a function static.
+ * - UnisonLayoutTable holds, for every unison count from 1 to 32, where each unison voice
+ *   sits: its detune position, its starting phase, and its equal power pan gains already
+ *   scaled by 1/sqrt(count). Voices pick a row at note on instead of calling cos/sin/sqrt.
+ * - CutoffPrewarpTable maps a cutoff in MIDI-note space to the SVF 'g' coefficient for one
+ *   sample rate, including the 10hz-15khz safety clamp. One is built per distinct sample
+ *   rate the first time an instance activates at that rate, and all instances running at
+ *   that rate share it.
+ */
+
+#include <cmath>
+#include <cstdint>
+#include <array>
+#include <algorithm>
+
+namespace sst::clap_saw_demo
+{
+struct NoteFrequencyTable
+{
+    static constexpr int minNote = -128, maxNote = 255;
+    static constexpr int fineSteps = 256;
+
+    NoteFrequencyTable();
+
+    // 440 * 2^((note - 69)/12), clamped to the note range above
+    inline double noteToFrequency(double note) const
+    {
+        note = std::clamp(note, (double)minNote, (double)maxNote - 1e-9);
+        auto n = std::floor(note);
+        auto fpos = (note - n) * fineSteps;
+        auto fi = (int)fpos;
+        auto ff = fpos - fi;
+        auto fine = fineRatio[fi] + (fineRatio[fi + 1] - fineRatio[fi]) * ff;
+        return noteFrequency[(int)n - minNote] * fine;
+    }
+
+    // 2^(semitones/12), so the unison detune and similar can skip pow
+    inline double semitonesToRatio(double semitones) const
+    {
+        return noteToFrequency(69.0 + semitones) * (1.0 / 440.0);
+    }
+
+  private:
+    std::array<double, maxNote - minNote + 1> noteFrequency;
+    std::array<double, fineSteps + 1> fineRatio;
+};
+
+// The single process wide instance. Lazy and thread-safe.
+const NoteFrequencyTable &noteFrequencyTable();
+
+struct UnisonLayoutTable
+{
+    static constexpr int maxUnison = 32;
+
+    // Entries at and above the count are zero, so a voice can run its unison loop
+    // over a padded count and the extra lanes contribute nothing.
+    struct Layout
+    {
+        std::array<float, maxUnison> unitShift; // detune position in [-1, 1]
+        std::array<float, maxUnison> startPhase;
+        std::array<float, maxUnison> panNormL, panNormR;
+    };
+
+    UnisonLayoutTable();
+
+    inline const Layout &forCount(int count) const
+    {
+        return layouts[std::clamp(count, 1, maxUnison) - 1];
+    }
+
+  private:
+    std::array<Layout, maxUnison> layouts;
+};
+
+// The single process wide instance. Lazy and thread-safe.
+const UnisonLayoutTable &unisonLayoutTable();
+
+struct CutoffPrewarpTable
+{
+    static constexpr float lowestHz = 10.f, highestHz = 15000.f;
+    static constexpr int stepsPerKey = 16;
+    static constexpr float keyRange = 140.f;
+
+    explicit CutoffPrewarpTable(double sampleRate);
+
+    double sampleRate;
+
+    // g = tan(pi * clamp(freq(key), 10, 15000) / sr)
+    inline float keyToG(float key) const
+    {
+        key = std::clamp(key, lowKey, highKey);
+        auto pos = key * stepsPerKey;
+        auto i = (int)pos;
+        auto f = pos - i;
+        return g[i] + (g[i + 1] - g[i]) * f;
+    }
+
+  private:
+    float lowKey, highKey;
+    std::array<float, (int)(keyRange * stepsPerKey) + 2> g;
+};
+
+/*
+ * Find or build the table for a sample rate. Call this from activate (it can take a lock
+ * and allocate). The returned pointer lives until releaseDspTables is called at clap_deinit.
+ */
+const CutoffPrewarpTable *cutoffPrewarpTableFor(double sampleRate);
+void releaseDspTables();
+} // namespace sst::clap_saw_demo
+
+#endif // CLAP_SAW_DEMO_DSP_TABLES_H
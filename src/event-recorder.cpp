@@ -0,0 +1,247 @@
+/*
+ * ClapSawDemo
+ * https://github.com/surge-synthesizer/clap-saw-demo
+ *
+ * Copyright 2022 Paul Walker and others as listed in the git history
+ *
+ * Released under the MIT License. See LICENSE.md for full text.
+ */
+
+#include "event-recorder.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+namespace sst::clap_saw_demo
+{
+namespace
+{
+constexpr uint32_t recordHeaderBytes = 1 + sizeof(uint32_t);
+constexpr uint32_t gapRecordBytes = recordHeaderBytes + sizeof(uint32_t);
+// Anything claiming to be bigger than this is broken, not an event we want a copy of
+constexpr uint32_t maxEventBytes = 1024;
+} // namespace
+
+std::unique_ptr<EventRecorder> EventRecorder::fromEnvironment()
+{
+    auto path = std::getenv("CLAP_SAW_DEMO_RECORD");
+    if (!path || !*path)
+        return nullptr;
+
+    static std::atomic<int> instances{0};
+    auto n = ++instances;
+    auto p = std::string(path);
+    if (n > 1)
+        p += "." + std::to_string(n);
+
+    auto res = std::make_unique<EventRecorder>(p.c_str());
+    if (!res->ok())
+        return nullptr;
+    return res;
+}
+
+EventRecorder::EventRecorder(const char *path)
+{
+    ring.reset(new (std::nothrow) uint8_t[capacity]);
+    if (!ring)
+        return;
+
+    file = fopen(path, "wb");
+    if (!file)
+        return;
+    if (fwrite(magic, sizeof(magic), 1, file) != 1)
+    {
+        fclose(file);
+        file = nullptr;
+        return;
+    }
+
+    writer = std::thread([this]() { writerLoop(); });
+}
+
+EventRecorder::~EventRecorder()
+{
+    if (writer.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> g(lock);
+            stopping = true;
+        }
+        wake.notify_one();
+        writer.join();
+    }
+    if (file)
+        fclose(file);
+}
+
+bool EventRecorder::recordable(const clap_event_header_t *e)
+{
+    return e->space_id == CLAP_CORE_EVENT_SPACE_ID && e->type != CLAP_EVENT_MIDI_SYSEX &&
+           e->size >= sizeof(clap_event_header_t) && e->size <= maxEventBytes;
+}
+
+bool EventRecorder::begin(RecordType type, uint32_t payload)
+{
+    auto w = writePos.load(std::memory_order_relaxed);
+    auto space = capacity - (size_t)(w - readPos.load(std::memory_order_acquire));
+    auto need = (size_t)recordHeaderBytes + payload + (gapCount ? gapRecordBytes : 0);
+    if (need > space)
+    {
+        gapCount++;
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    pending = w;
+    if (gapCount)
+    {
+        put((uint8_t)rtGap);
+        put((uint32_t)sizeof(uint32_t));
+        put(gapCount);
+        gapCount = 0;
+    }
+    put((uint8_t)type);
+    put(payload);
+    return true;
+}
+
+void EventRecorder::put(const void *data, size_t bytes)
+{
+    auto src = static_cast<const uint8_t *>(data);
+    auto at = (size_t)(pending & (capacity - 1));
+    auto first = std::min(bytes, capacity - at);
+    memcpy(ring.get() + at, src, first);
+    if (first < bytes)
+        memcpy(ring.get(), src + first, bytes - first);
+    pending += bytes;
+}
+
+void EventRecorder::commit() { writePos.store(pending, std::memory_order_release); }
+
+uint32_t EventRecorder::eventsPayload(const clap_input_events_t *in, uint32_t &nEvents) const
+{
+    uint32_t bytes{sizeof(uint32_t)};
+    nEvents = 0;
+    auto sz = in ? in->size(in) : 0;
+    for (uint32_t i = 0; i < sz; ++i)
+    {
+        auto e = in->get(in, i);
+        if (!recordable(e))
+            continue;
+        nEvents++;
+        bytes += e->size;
+    }
+    return bytes;
+}
+
+void EventRecorder::putEvents(const clap_input_events_t *in, uint32_t nEvents)
+{
+    put(nEvents);
+    if (!nEvents)
+        return;
+    auto sz = in->size(in);
+    for (uint32_t i = 0; i < sz; ++i)
+    {
+        auto e = in->get(in, i);
+        if (recordable(e))
+            put(e, e->size);
+    }
+}
+
+void EventRecorder::activate(double sampleRate, uint32_t minFrames, uint32_t maxFrames,
+                             uint32_t portConfig, const uint32_t *paramIds,
+                             const double *values, uint32_t nParams)
+{
+    auto payload = (uint32_t)(sizeof(double) + 4 * sizeof(uint32_t) +
+                              nParams * (sizeof(uint32_t) + sizeof(double)));
+    if (!begin(rtActivate, payload))
+        return;
+    put(sampleRate);
+    put(minFrames);
+    put(maxFrames);
+    put(portConfig);
+    put(nParams);
+    for (uint32_t i = 0; i < nParams; ++i)
+    {
+        put(paramIds[i]);
+        put(values[i]);
+    }
+    commit();
+}
+
+void EventRecorder::deactivate()
+{
+    if (begin(rtDeactivate, 0))
+        commit();
+}
+
+void EventRecorder::process(const clap_process_t *process)
+{
+    uint32_t nEvents;
+    auto payload = eventsPayload(process->in_events, nEvents);
+    payload += (uint32_t)(sizeof(uint32_t) + sizeof(int64_t) + sizeof(uint32_t) +
+                          process->audio_outputs_count * sizeof(uint32_t));
+    if (!begin(rtProcess, payload))
+        return;
+    put(process->frames_count);
+    put(process->steady_time);
+    put(process->audio_outputs_count);
+    for (uint32_t p = 0; p < process->audio_outputs_count; ++p)
+        put(process->audio_outputs[p].channel_count);
+    putEvents(process->in_events, nEvents);
+    commit();
+}
+
+void EventRecorder::flush(const clap_input_events_t *in)
+{
+    uint32_t nEvents;
+    auto payload = eventsPayload(in, nEvents);
+    if (!begin(rtFlush, payload))
+        return;
+    putEvents(in, nEvents);
+    commit();
+}
+
+void EventRecorder::uiParamValue(uint32_t paramId, double value)
+{
+    if (!begin(rtUIParam, sizeof(uint32_t) + sizeof(double)))
+        return;
+    put(paramId);
+    put(value);
+    commit();
+}
+
+void EventRecorder::writerLoop()
+{
+    std::unique_lock<std::mutex> g(lock);
+    while (!stopping)
+    {
+        wake.wait_for(g, std::chrono::milliseconds(10));
+        g.unlock();
+        drain();
+        g.lock();
+    }
+    g.unlock();
+    drain();
+}
+
+void EventRecorder::drain()
+{
+    auto r = readPos.load(std::memory_order_relaxed);
+    auto w = writePos.load(std::memory_order_acquire);
+    if (r == w)
+        return;
+
+    auto at = (size_t)(r & (capacity - 1));
+    auto bytes = (size_t)(w - r);
+    auto first = std::min(bytes, capacity - at);
+    fwrite(ring.get() + at, 1, first, file);
+    if (first < bytes)
+        fwrite(ring.get(), 1, bytes - first, file);
+    fflush(file);
+
+    readPos.store(w, std::memory_order_release);
+}
+} // namespace sst::clap_saw_demo
@@ -0,0 +1,128 @@
+/*
+ * ClapSawDemo
+ * https://github.com/surge-synthesizer/clap-saw-demo
+ *
+ * Copyright 2022 Paul Walker and others as listed in the git history
+ *
+ * Released under the MIT License. See LICENSE.md for full text.
+ */
+
+#ifndef CLAP_SAW_DEMO_EVENT_RECORDER_H
+#define CLAP_SAW_DEMO_EVENT_RECORDER_H
+
+/*
+ * The event recorder captures what a host actually sends us, so a performance problem seen
+ * in a real session can be replayed later, as often as you like, with a profiler attached
+ * (clap-saw-demo-headless --replay; see headless-host.cpp).
+ *
+ * It is off unless the CLAP_SAW_DEMO_RECORD environment variable names a file when the
+ * plugin is created. The first instance writes that file, and any more instances in the
+ * same process write to it with .2, .3 and so on appended. Off, it costs a null pointer
+ * check per block.
+ *
+ * On, every process and paramsFlush call appends a record with its block size, the output
+ * channel layout and a copy of every core input event. Parameter changes from the editor,
+ * which never appear in the host's events, get a record of their own and replay at the
+ * start of the next block. Activate records the sample rate, frame counts, port layout and
+ * every parameter value, so the replay starts from the same settings.
+ *
+ * The audio thread only copies bytes into a preallocated single producer / single consumer
+ * ring; it never locks, allocates or does I/O. A writer thread wakes every few ms and
+ * appends whatever is in the ring to the file. If the ring is full the record is dropped,
+ * counted, and a gap record saying how many were lost goes in ahead of the next one that
+ * fits. CLAP never runs process, paramsFlush and activate at the same time, which is what
+ * makes one producer enough.
+ *
+ * The file is an 8 byte magic, "CSDREC1" and a zero, followed by records of a one byte
+ * type, a four byte payload length and the payload, all in native byte order (it is
+ * meant to be replayed on the machine that recorded it):
+ *
+ * - 'A' activate: f64 sample rate, u32 min frames, u32 max frames, u32 port config id,
+ *   u32 n, then n of { u32 param id, f64 value }
+ * - 'P' process: u32 frames, i64 steady time, u32 ports, then u32 channels per port,
+ *   u32 events, then the events as they came (each is its header.size bytes)
+ * - 'F' paramsFlush: u32 events, then the events
+ * - 'U' an editor parameter change: u32 param id, f64 value
+ * - 'D' deactivate: nothing
+ * - 'G' a gap: u32 records lost
+ *
+ * Events outside the core space, and MIDI sysex (whose payload is behind a pointer), are
+ * left out.
+ */
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <clap/clap.h>
+
+namespace sst::clap_saw_demo
+{
+struct EventRecorder
+{
+    static constexpr char magic[8] = {'C', 'S', 'D', 'R', 'E', 'C', '1', '\0'};
+    enum RecordType : uint8_t
+    {
+        rtActivate = 'A',
+        rtProcess = 'P',
+        rtFlush = 'F',
+        rtUIParam = 'U',
+        rtDeactivate = 'D',
+        rtGap = 'G'
+    };
+
+    // A recorder as the environment asks for, or null. Call on the main thread.
+    static std::unique_ptr<EventRecorder> fromEnvironment();
+
+    // Opens path and starts the writer; check ok() after
+    explicit EventRecorder(const char *path);
+    // Stops the writer, after it writes everything it has
+    ~EventRecorder();
+    bool ok() const { return file != nullptr; }
+
+    // The producer side; see above for when each is called
+    void activate(double sampleRate, uint32_t minFrames, uint32_t maxFrames,
+                  uint32_t portConfig, const uint32_t *paramIds, const double *values,
+                  uint32_t nParams);
+    void deactivate();
+    void process(const clap_process_t *process);
+    void flush(const clap_input_events_t *in);
+    void uiParamValue(uint32_t paramId, double value);
+
+    static bool recordable(const clap_event_header_t *e);
+
+    std::atomic<uint64_t> dropped{0};
+
+  private:
+    // Reserve a record of payload bytes, writing any pending gap record first. False (and
+    // the record is dropped) if the ring hasn't room.
+    bool begin(RecordType type, uint32_t payload);
+    void put(const void *data, size_t bytes);
+    template <typename T> void put(const T &v) { put(&v, sizeof(T)); }
+    void commit();
+    uint32_t eventsPayload(const clap_input_events_t *in, uint32_t &nEvents) const;
+    void putEvents(const clap_input_events_t *in, uint32_t nEvents);
+
+    void writerLoop();
+    void drain();
+
+    static constexpr size_t capacity = 1 << 22; // bytes, and must be a power of two
+    std::unique_ptr<uint8_t[]> ring;
+    alignas(64) std::atomic<uint64_t> writePos{0};
+    alignas(64) std::atomic<uint64_t> readPos{0};
+    uint64_t pending{0};  // the producer's write position within the record being built
+    uint32_t gapCount{0}; // records dropped since the last gap record
+
+    FILE *file{nullptr};
+    std::mutex lock;
+    std::condition_variable wake;
+    bool stopping{false};
+    std::thread writer;
+};
+} // namespace sst::clap_saw_demo
+
+#endif // CLAP_SAW_DEMO_EVENT_RECORDER_H
@@ -0,0 +1,230 @@
+/*
+ * ClapSawDemo
+ * https://github.com/surge-synthesizer/clap-saw-demo
+ *
+ * Copyright 2022 Paul Walker and others as listed in the git history
+ *
+ * Released under the MIT License. See LICENSE.md for full text.
+ */
+
+/*
+ * clap-saw-demo-fast-math-check holds the approximations in fast-math.h to the error bounds
+ * documented there. For each function and each range a caller feeds it, it runs every float
+ * in the range through both the scalar and the 4-wide version, compares them with the
+ * standard library in double precision and reports the largest error. Any error over the
+ * bound is a failure, and the exit status is non-zero.
+ *
+ * After that it times each approximation, scalar and 4-wide, against the float version from
+ * libm on the caller's range and reports ns per value. The scalar ones and libm are both
+ * called through a function pointer, so neither is inlined into the loop.
+ *
+ * Sweeping every float takes a while (billions of values for the ranges which go through
+ * zero); pass a stride, e.g. clap-saw-demo-fast-math-check 64, to visit every 64th. It isn't
+ * built by default; run it with
+ *
+ *     cmake --build build --target fast-math-check
+ */
+
+#include "fast-math.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace
+{
+using namespace sst::clap_saw_demo;
+
+/*
+ * One function over one caller's range. The error is relative to the true value, or
+ * absolute if 'absolute' is set.
+ */
+struct Check
+{
+    const char *name;
+    const char *caller;
+    float lo, hi;
+    double bound;
+    bool absolute;
+    float (*fast)(float);
+    void (*fastArray)(const float *, float *, int);
+    double (*exact)(double);
+    float (*libm)(float);
+};
+
+const Check checks[] = {
+    {"exp2", "documented range", -126.f, 126.f, 3e-7, false, fastmath::exp2, fastmath::exp2,
+     [](double x) { return std::exp2(x); }, [](float x) { return std::exp2(x); }},
+    {"exp2", "SawDemoVoice::timeParamToSeconds", -100.f, 2.f, 3e-7, false, fastmath::exp2,
+     fastmath::exp2, [](double x) { return std::exp2(x); }, [](float x) { return std::exp2(x); }},
+    {"log2", "documented range", 1e-3f, 1e3f, 1e-6, true, fastmath::log2, fastmath::log2,
+     [](double x) { return std::log2(x); }, [](float x) { return std::log2(x); }},
+    {"log2", "ClapSawDemo::scaleSecondsToTimeParam", 1e-6f, 4.f, 1.2e-6, true, fastmath::log2,
+     fastmath::log2, [](double x) { return std::log2(x); }, [](float x) { return std::log2(x); }},
+    {"tan", "StereoFilter::setCoeff", 0.f, 1.45f, 1e-6, false, fastmath::tan, fastmath::tan,
+     [](double x) { return std::tan(x); }, [](float x) { return std::tan(x); }},
+    {"tanh", "voice kernels (the same ops)", -3.f, 3.f, 0.026, true, fastmath::tanh,
+     fastmath::tanh, [](double x) { return std::tanh(x); },
+     [](float x) { return std::tanh(x); }},
+};
+
+// Floats in the same order as their values, so a range is a run of consecutive integers
+int64_t floatToOrdered(float f)
+{
+    int32_t b;
+    memcpy(&b, &f, sizeof(b));
+    return (b >= 0) ? (int64_t)b : -(int64_t)(b & 0x7FFFFFFF);
+}
+
+float orderedToFloat(int64_t o)
+{
+    int32_t b = (o >= 0) ? (int32_t)o : (int32_t)((-o) | 0x80000000u);
+    float f;
+    memcpy(&f, &b, sizeof(f));
+    return f;
+}
+
+double error(const Check &c, float got, double want)
+{
+    auto d = std::fabs((double)got - want);
+    if (c.absolute || want == 0.0)
+        return d;
+    return d / std::fabs(want);
+}
+
+struct Sweep
+{
+    double scalarErr{0}, vectorErr{0};
+    float scalarAt{0}, vectorAt{0};
+    int64_t count{0};
+};
+
+Sweep sweep(const Check &c, int64_t stride)
+{
+    constexpr int chunk = 4096;
+    std::vector<float> in(chunk), out(chunk);
+    Sweep s;
+
+    auto first = floatToOrdered(c.lo), last = floatToOrdered(c.hi);
+    for (auto o = first; o <= last;)
+    {
+        int n = 0;
+        for (; n < chunk && o <= last; ++n, o += stride)
+            in[n] = orderedToFloat(o);
+
+        // The array form runs the 4-wide version, and the scalar one only on a remainder
+        c.fastArray(in.data(), out.data(), n & ~3);
+        for (int i = 0; i < n; ++i)
+        {
+            auto want = c.exact(in[i]);
+            auto es = error(c, c.fast(in[i]), want);
+            if (es > s.scalarErr)
+            {
+                s.scalarErr = es;
+                s.scalarAt = in[i];
+            }
+            if (i < (n & ~3))
+            {
+                auto ev = error(c, out[i], want);
+                if (ev > s.vectorErr)
+                {
+                    s.vectorErr = ev;
+                    s.vectorAt = in[i];
+                }
+            }
+        }
+        s.count += n;
+    }
+    return s;
+}
+
+template <typename F> double nsPerValue(F &&f, int values)
+{
+    constexpr int reps = 2000;
+    auto t0 = std::chrono::steady_clock::now();
+    for (int r = 0; r < reps; ++r)
+        f();
+    auto t1 = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(t1 - t0).count() / ((double)reps * values);
+}
+
+void timeAgainstLibm(const Check &c, double &sink)
+{
+    constexpr int n = 4096;
+    std::vector<float> in(n), out(n);
+    std::minstd_rand gen(2112);
+    std::uniform_real_distribution<float> dist(c.lo, c.hi);
+    for (auto &f : in)
+        f = dist(gen);
+
+    auto scalar = nsPerValue(
+        [&]()
+        {
+            for (int i = 0; i < n; ++i)
+                out[i] = c.fast(in[i]);
+            sink += out[n - 1];
+        },
+        n);
+    auto vector = nsPerValue(
+        [&]()
+        {
+            c.fastArray(in.data(), out.data(), n);
+            sink += out[n - 1];
+        },
+        n);
+    auto libm = nsPerValue(
+        [&]()
+        {
+            for (int i = 0; i < n; ++i)
+                out[i] = c.libm(in[i]);
+            sink += out[n - 1];
+        },
+        n);
+    printf("%-6s %-38s %10.2f %10.2f %10.2f\n", c.name, c.caller, scalar, vector, libm);
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+    int64_t stride = 1;
+    if (argc > 1)
+        stride = std::max(1LL, std::atoll(argv[1]));
+
+    int failures = 0;
+    printf("%-6s %-38s %-16s %11s %11s %11s\n", "fn", "caller", "range", "scalar err",
+           "4-wide err", "bound");
+    for (const auto &c : checks)
+    {
+        auto s = sweep(c, stride);
+        auto ok = s.scalarErr <= c.bound && s.vectorErr <= c.bound;
+        char range[32];
+        snprintf(range, sizeof(range), "[%g, %g]", c.lo, c.hi);
+        printf("%-6s %-38s %-16s %11.3g %11.3g %11.3g %s\n", c.name, c.caller, range, s.scalarErr,
+               s.vectorErr, c.bound, ok ? "ok" : "FAIL");
+        if (!ok)
+        {
+            printf("       worst at %.9g (scalar) and %.9g (4-wide), %lld values\n", s.scalarAt,
+                   s.vectorAt, (long long)s.count);
+            failures++;
+        }
+    }
+
+    double sink{0};
+    printf("\n%-6s %-38s %10s %10s %10s   (ns/value)\n", "fn", "caller", "scalar", "4-wide",
+           "libm");
+    for (const auto &c : checks)
+        timeAgainstLibm(c, sink);
+
+    // Keep the optimizer from deciding none of this matters
+    if (sink == 12345.678)
+        printf(" ");
+
+    if (failures)
+        printf("\n%d of the fast math checks are outside their documented error\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,333 @@
+/*
+ * ClapSawDemo
+ * https://github.com/surge-synthesizer/clap-saw-demo
+ *
+ * Copyright 2022 Paul Walker and others as listed in the git history
+ *
+ * Released under the MIT License. See LICENSE.md for full text.
+ */
+
+#ifndef CLAP_SAW_DEMO_FAST_MATH_H
+#define CLAP_SAW_DEMO_FAST_MATH_H
+
+/*
+ * Small single precision approximations of exp2, log2 and tan for the places where the
+ * engine needs them at control rate and libm's double precision is wasted. Each has a
+ * scalar version and a 4-wide version on `vfloat`, which is an SSE2 register on x86, a
+ * NEON register on ARM and a plain struct elsewhere. Both versions run the same
+ * arithmetic in the same order, so they agree with each other to within rounding.
+ *
+ * - exp2 rounds to the nearest integer, builds 2^i in the exponent bits and evaluates a
+ *   degree 6 polynomial on [-0.5, 0.5]. Inputs are clamped to [-126, 126]. Relative error
+ *   is below 3e-7 over that range.
+ * - log2 splits off the exponent, centres the mantissa on [sqrt(1/2), sqrt(2)) and uses the
+ *   atanh series in t = (m-1)/(m+1). Absolute error is below 1e-6 for inputs in [1e-3, 1e3]
+ *   and below 1.2e-6 down to 1e-6; further out the float rounding of the (large) result
+ *   dominates. Inputs must be positive and normal.
+ * - tan is the 7/6 order continued fraction, which has relative error below 1e-6 on
+ *   [0, 1.45]. That covers pi * f / sr for f up to 0.46 sr, which is the range the filter
+ *   prewarp uses (see dsp-tables.h); inputs are clamped to [-1.5, 1.5].
+ * - tanh is the 3/2 order Pade approximant, clamped to [-3, 3] where it reaches exactly 1.
+ *   It is a saturator not a tanh: the error is up to 2.6% near |x| = 1.5, but it is smooth,
+ *   odd, monotonic and has slope 1 at 0, which is all the filter nonlinearities need.
+ */
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CLAP_SAW_DEMO_FASTMATH_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define CLAP_SAW_DEMO_FASTMATH_NEON 1
+#endif
+
+namespace sst::clap_saw_demo::fastmath
+{
+/*
+ * The scalar versions
+ */
+inline float exp2(float x)
+{
+    x = std::clamp(x, -126.f, 126.f);
+    auto xi = std::nearbyint(x);
+    auto f = x - xi;
+    auto p =
+        1.f +
+        f * (0.693147181f +
+             f * (0.240226507f +
+                  f * (0.0555041087f + f * (0.00961812911f + f * (0.00133335581f +
+                                                                  f * 0.000154035304f)))));
+    int32_t bits = ((int32_t)xi + 127) << 23;
+    float scale;
+    memcpy(&scale, &bits, sizeof(float));
+    return p * scale;
+}
+
+inline float log2(float x)
+{
+    int32_t bits;
+    memcpy(&bits, &x, sizeof(float));
+    auto e = (float)(((bits >> 23) & 0xFF) - 127);
+    bits = (bits & 0x007FFFFF) | 0x3F800000;
+    float m;
+    memcpy(&m, &bits, sizeof(float));
+    if (m > 1.41421356f)
+    {
+        m *= 0.5f;
+        e += 1.f;
+    }
+    auto t = (m - 1.f) / (m + 1.f);
+    auto t2 = t * t;
+    auto p = t * (2.88539008f + t2 * (0.961796694f + t2 * (0.577078017f + t2 * 0.412198583f)));
+    return e + p;
+}
+
+inline float tan(float x)
+{
+    x = std::clamp(x, -1.5f, 1.5f);
+    auto x2 = x * x;
+    auto num = x * (135135.f + x2 * (-17325.f + x2 * (378.f - x2)));
+    auto den = 135135.f + x2 * (-62370.f + x2 * (3150.f - 28.f * x2));
+    return num / den;
+}
+
+inline float tanh(float x)
+{
+    x = std::clamp(x, -3.f, 3.f);
+    auto x2 = x * x;
+    return x * (27.f + x2) / (27.f + 9.f * x2);
+}
+
+/*
+ * The 4-wide versions. vfloat is deliberately minimal; we only wrap the handful of
+ * operations the functions below need.
+ */
+#if CLAP_SAW_DEMO_FASTMATH_SSE2
+typedef __m128 vfloat;
+typedef __m128i vint;
+inline vfloat vLoad(const float *f) { return _mm_loadu_ps(f); }
+inline void vStore(float *f, vfloat v) { _mm_storeu_ps(f, v); }
+inline vfloat vSet(float f) { return _mm_set1_ps(f); }
+inline vfloat vAdd(vfloat a, vfloat b) { return _mm_add_ps(a, b); }
+inline vfloat vSub(vfloat a, vfloat b) { return _mm_sub_ps(a, b); }
+inline vfloat vMul(vfloat a, vfloat b) { return _mm_mul_ps(a, b); }
+inline vfloat vDiv(vfloat a, vfloat b) { return _mm_div_ps(a, b); }
+inline vfloat vMin(vfloat a, vfloat b) { return _mm_min_ps(a, b); }
+inline vfloat vMax(vfloat a, vfloat b) { return _mm_max_ps(a, b); }
+inline vint vRoundToInt(vfloat a) { return _mm_cvtps_epi32(a); } // MXCSR round to nearest
+inline vfloat vIntToFloat(vint a) { return _mm_cvtepi32_ps(a); }
+inline vfloat vPow2FromInt(vint i)
+{
+    return _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(i, _mm_set1_epi32(127)), 23));
+}
+inline vint vBits(vfloat a) { return _mm_castps_si128(a); }
+inline vfloat vFromBits(vint a) { return _mm_castsi128_ps(a); }
+inline vint vExponentField(vint b)
+{
+    return _mm_sub_epi32(_mm_and_si128(_mm_srli_epi32(b, 23), _mm_set1_epi32(0xFF)),
+                         _mm_set1_epi32(127));
+}
+inline vint vMantissaOne(vint b)
+{
+    return _mm_or_si128(_mm_and_si128(b, _mm_set1_epi32(0x007FFFFF)),
+                        _mm_set1_epi32(0x3F800000));
+}
+inline vfloat vSelectGT(vfloat a, vfloat b, vfloat ifTrue, vfloat ifFalse)
+{
+    auto m = _mm_cmpgt_ps(a, b);
+    return _mm_or_ps(_mm_and_ps(m, ifTrue), _mm_andnot_ps(m, ifFalse));
+}
+#elif CLAP_SAW_DEMO_FASTMATH_NEON
+typedef float32x4_t vfloat;
+typedef int32x4_t vint;
+inline vfloat vLoad(const float *f) { return vld1q_f32(f); }
+inline void vStore(float *f, vfloat v) { vst1q_f32(f, v); }
+inline vfloat vSet(float f) { return vdupq_n_f32(f); }
+inline vfloat vAdd(vfloat a, vfloat b) { return vaddq_f32(a, b); }
+inline vfloat vSub(vfloat a, vfloat b) { return vsubq_f32(a, b); }
+inline vfloat vMul(vfloat a, vfloat b) { return vmulq_f32(a, b); }
+inline vfloat vDiv(vfloat a, vfloat b) { return vdivq_f32(a, b); }
+inline vfloat vMin(vfloat a, vfloat b) { return vminq_f32(a, b); }
+inline vfloat vMax(vfloat a, vfloat b) { return vmaxq_f32(a, b); }
+inline vint vRoundToInt(vfloat a) { return vcvtnq_s32_f32(a); }
+inline vfloat vIntToFloat(vint a) { return vcvtq_f32_s32(a); }
+inline vfloat vPow2FromInt(vint i)
+{
+    return vreinterpretq_f32_s32(vshlq_n_s32(vaddq_s32(i, vdupq_n_s32(127)), 23));
+}
+inline vint vBits(vfloat a) { return vreinterpretq_s32_f32(a); }
+inline vfloat vFromBits(vint a) { return vreinterpretq_f32_s32(a); }
+inline vint vExponentField(vint b)
+{
+    return vsubq_s32(vandq_s32(vshrq_n_s32(b, 23), vdupq_n_s32(0xFF)), vdupq_n_s32(127));
+}
+inline vint vMantissaOne(vint b)
+{
+    return vorrq_s32(vandq_s32(b, vdupq_n_s32(0x007FFFFF)), vdupq_n_s32(0x3F800000));
+}
+inline vfloat vSelectGT(vfloat a, vfloat b, vfloat ifTrue, vfloat ifFalse)
+{
+    return vbslq_f32(vcgtq_f32(a, b), ifTrue, ifFalse);
+}
+#else
+struct vfloat
+{
+    float v[4];
+};
+struct vint
+{
+    int32_t v[4];
+};
+#define CLAP_SAW_DEMO_FASTMATH_LANEWISE(expr)                                                      \
+    vfloat r;                                                                                      \
+    for (int l = 0; l < 4; ++l)                                                                    \
+        r.v[l] = expr;                                                                             \
+    return r;
+inline vfloat vLoad(const float *f)
+{
+    vfloat r;
+    memcpy(r.v, f, sizeof(r.v));
+    return r;
+}
+inline void vStore(float *f, vfloat v) { memcpy(f, v.v, sizeof(v.v)); }
+inline vfloat vSet(float f) { CLAP_SAW_DEMO_FASTMATH_LANEWISE(f) }
+inline vfloat vAdd(vfloat a, vfloat b) { CLAP_SAW_DEMO_FASTMATH_LANEWISE(a.v[l] + b.v[l]) }
+inline vfloat vSub(vfloat a, vfloat b) { CLAP_SAW_DEMO_FASTMATH_LANEWISE(a.v[l] - b.v[l]) }
+inline vfloat vMul(vfloat a, vfloat b) { CLAP_SAW_DEMO_FASTMATH_LANEWISE(a.v[l] * b.v[l]) }
+inline vfloat vDiv(vfloat a, vfloat b) { CLAP_SAW_DEMO_FASTMATH_LANEWISE(a.v[l] / b.v[l]) }
+inline vfloat vMin(vfloat a, vfloat b) { CLAP_SAW_DEMO_FASTMATH_LANEWISE(std::min(a.v[l], b.v[l])) }
+inline vfloat vMax(vfloat a, vfloat b) { CLAP_SAW_DEMO_FASTMATH_LANEWISE(std::max(a.v[l], b.v[l])) }
+inline vfloat vSelectGT(vfloat a, vfloat b, vfloat t, vfloat f)
+{
+    CLAP_SAW_DEMO_FASTMATH_LANEWISE(a.v[l] > b.v[l] ? t.v[l] : f.v[l])
+}
+#undef CLAP_SAW_DEMO_FASTMATH_LANEWISE
+inline vint vRoundToInt(vfloat a)
+{
+    vint r;
+    for (int l = 0; l < 4; ++l)
+        r.v[l] = (int32_t)std::nearbyint(a.v[l]);
+    return r;
+}
+inline vfloat vIntToFloat(vint a)
+{
+    vfloat r;
+    for (int l = 0; l < 4; ++l)
+        r.v[l] = (float)a.v[l];
+    return r;
+}
+inline vfloat vPow2FromInt(vint i)
+{
+    vfloat r;
+    for (int l = 0; l < 4; ++l)
+    {
+        int32_t bits = (i.v[l] + 127) << 23;
+        memcpy(&r.v[l], &bits, sizeof(float));
+    }
+    return r;
+}
+inline vint vBits(vfloat a)
+{
+    vint r;
+    memcpy(r.v, a.v, sizeof(r.v));
+    return r;
+}
+inline vfloat vFromBits(vint a)
+{
+    vfloat r;
+    memcpy(r.v, a.v, sizeof(r.v));
+    return r;
+}
+inline vint vExponentField(vint b)
+{
+    vint r;
+    for (int l = 0; l < 4; ++l)
+        r.v[l] = ((b.v[l] >> 23) & 0xFF) - 127;
+    return r;
+}
+inline vint vMantissaOne(vint b)
+{
+    vint r;
+    for (int l = 0; l < 4; ++l)
+        r.v[l] = (b.v[l] & 0x007FFFFF) | 0x3F800000;
+    return r;
+}
+#endif
+
+inline vfloat exp2(vfloat x)
+{
+    x = vMin(vMax(x, vSet(-126.f)), vSet(126.f));
+    auto xi = vRoundToInt(x);
+    auto f = vSub(x, vIntToFloat(xi));
+    auto p = vAdd(vSet(0.00133335581f), vMul(f, vSet(0.000154035304f)));
+    p = vAdd(vSet(0.00961812911f), vMul(f, p));
+    p = vAdd(vSet(0.0555041087f), vMul(f, p));
+    p = vAdd(vSet(0.240226507f), vMul(f, p));
+    p = vAdd(vSet(0.693147181f), vMul(f, p));
+    p = vAdd(vSet(1.f), vMul(f, p));
+    return vMul(p, vPow2FromInt(xi));
+}
+
+inline vfloat log2(vfloat x)
+{
+    auto b = vBits(x);
+    auto e = vIntToFloat(vExponentField(b));
+    auto m = vFromBits(vMantissaOne(b));
+    auto big = vSet(1.41421356f);
+    e = vSelectGT(m, big, vAdd(e, vSet(1.f)), e);
+    m = vSelectGT(m, big, vMul(m, vSet(0.5f)), m);
+    auto t = vDiv(vSub(m, vSet(1.f)), vAdd(m, vSet(1.f)));
+    auto t2 = vMul(t, t);
+    auto p = vAdd(vSet(0.577078017f), vMul(t2, vSet(0.412198583f)));
+    p = vAdd(vSet(0.961796694f), vMul(t2, p));
+    p = vAdd(vSet(2.88539008f), vMul(t2, p));
+    return vAdd(e, vMul(t, p));
+}
+
+inline vfloat tan(vfloat x)
+{
+    x = vMin(vMax(x, vSet(-1.5f)), vSet(1.5f));
+    auto x2 = vMul(x, x);
+    auto num = vSub(vSet(378.f), x2);
+    num = vAdd(vSet(-17325.f), vMul(x2, num));
+    num = vMul(x, vAdd(vSet(135135.f), vMul(x2, num)));
+    auto den = vSub(vSet(3150.f), vMul(vSet(28.f), x2));
+    den = vAdd(vSet(-62370.f), vMul(x2, den));
+    den = vAdd(vSet(135135.f), vMul(x2, den));
+    return vDiv(num, den);
+}
+
+inline vfloat tanh(vfloat x)
+{
+    x = vMin(vMax(x, vSet(-3.f)), vSet(3.f));
+    auto x2 = vMul(x, x);
+    auto num = vMul(x, vAdd(vSet(27.f), x2));
+    auto den = vAdd(vSet(27.f), vMul(vSet(9.f), x2));
+    return vDiv(num, den);
+}
+
+/*
+ * Array forms, which run 4 at a time and finish any remainder with the scalar
+ * version. In and out may alias.
+ */
+#define CLAP_SAW_DEMO_FASTMATH_ARRAY(fn)                                                           \
+    inline void fn(const float *in, float *out, int n)                                             \
+    {                                                                                              \
+        int i = 0;                                                                                 \
+        for (; i + 4 <= n; i += 4)                                                                 \
+            vStore(out + i, fn(vLoad(in + i)));                                                    \
+        for (; i < n; ++i)                                                                         \
+            out[i] = fn(in[i]);                                                                    \
+    }
+CLAP_SAW_DEMO_FASTMATH_ARRAY(exp2)
+CLAP_SAW_DEMO_FASTMATH_ARRAY(log2)
+CLAP_SAW_DEMO_FASTMATH_ARRAY(tan)
+CLAP_SAW_DEMO_FASTMATH_ARRAY(tanh)
+#undef CLAP_SAW_DEMO_FASTMATH_ARRAY
+} // namespace sst::clap_saw_demo::fastmath
+
+#endif // CLAP_SAW_DEMO_FAST_MATH_H
@@ -0,0 +1,326 @@
+/*
+ * ClapSawDemo
+ * https://github.com/surge-synthesizer/clap-saw-demo
+ *
+ * Copyright 2022 Paul Walker and others as listed in the git history
+ *
+ * Released under the MIT License. See LICENSE.md for full text.
+ */
+
+/*
+ * clap-saw-demo-filter-bench times each filter model (see filter-models.h) for a range of
+ * voice counts, both one voice at a time (StereoFilter::process, which is what a lone voice
+ * costs) and in batches of StereoFilter::batchVoices (processFilterBatch, which is what the
+ * engine does when voices share a model). It reports ns per voice per sample, so a flat
+ * column means the cost scales linearly with voices.
+ *
+ * The input is white noise at the level a voice feeds its filter, with cutoff spread across
+ * the keyboard and moderately high resonance, and the coefficients glide every block as
+ * they do under modulation.
+ *
+ * After that it runs each voice kernel variant this build has and this CPU supports (see
+ * voice-kernels.h) on the same inputs: the unison saws, a batch of each filter model and
+ * the mix into a bus. It reports the cost and the largest difference from the base variant,
+ * which should stay around 1e-6. A difference over kernelTolerance fails the run with a
+ * non-zero exit status, so CI can hold the variants to the base one; only x86 builds have
+ * variants to compare.
+ *
+ * It isn't built by default; run it with
+ *
+ *     cmake --build build --target filter-bench
+ *
+ * and compare numbers on the same machine and build type.
+ */
+
+#include "filter-models.h"
+#include "denormals.h"
+#include "dsp-tables.h"
+#include "voice-kernels.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <random>
+#include <vector>
+
+namespace
+{
+using namespace sst::clap_saw_demo;
+
+constexpr double sampleRate = 48000;
+constexpr int blockSize = StereoFilter::maxBatchFrames;
+constexpr int nBlocks = 48000 / blockSize;
+
+struct Setup
+{
+    std::vector<StereoFilter> filters;
+    std::vector<float> input; // nBlocks * blockSize noise samples
+
+    Setup(int mode, int nVoices) : filters(nVoices), input(nBlocks * blockSize)
+    {
+        std::minstd_rand gen(2112);
+        std::uniform_real_distribution<float> dist(-0.3f, 0.3f);
+        for (auto &f : input)
+            f = dist(gen);
+        for (auto &f : filters)
+            f.setMode(mode);
+    }
+
+    // Glide the cutoffs a little each block, as modulation would
+    void glide(int block)
+    {
+        auto table = cutoffPrewarpTableFor(sampleRate);
+        for (size_t i = 0; i < filters.size(); ++i)
+            filters[i].setCoeffTarget(40 + (i * 7) % 60 + (block % 32) * 0.5f, 0.8f,
+                                      1.0 / sampleRate, table, blockSize);
+    }
+};
+
+template <typename F> double timeIt(F &&f)
+{
+    auto t0 = std::chrono::steady_clock::now();
+    f();
+    auto t1 = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(t1 - t0).count();
+}
+
+double perVoice(int mode, int nVoices, double &sink)
+{
+    Setup s(mode, nVoices);
+    float L[blockSize], R[blockSize];
+    auto ns = timeIt(
+        [&]()
+        {
+            for (int b = 0; b < nBlocks; ++b)
+            {
+                s.glide(b);
+                for (auto &f : s.filters)
+                {
+                    std::copy(&s.input[b * blockSize], &s.input[(b + 1) * blockSize], L);
+                    std::copy(&s.input[b * blockSize], &s.input[(b + 1) * blockSize], R);
+                    f.process(L, R, blockSize);
+                    sink += L[blockSize - 1];
+                }
+            }
+        });
+    return ns / ((double)nBlocks * blockSize * nVoices);
+}
+
+double batched(int mode, int nVoices, double &sink)
+{
+    Setup s(mode, nVoices);
+    float io[blockSize][StereoFilter::batchLanes];
+    std::vector<StereoFilter *> ptrs;
+    for (auto &f : s.filters)
+        ptrs.push_back(&f);
+
+    auto ns = timeIt(
+        [&]()
+        {
+            for (int b = 0; b < nBlocks; ++b)
+            {
+                s.glide(b);
+                for (int v = 0; v < nVoices; v += StereoFilter::batchVoices)
+                {
+                    auto count = std::min(StereoFilter::batchVoices, nVoices - v);
+                    for (int i = 0; i < blockSize; ++i)
+                        for (int l = 0; l < StereoFilter::batchLanes; ++l)
+                            io[i][l] = s.input[b * blockSize + i];
+                    processFilterBatch(&ptrs[v], count, io, blockSize);
+                    sink += io[blockSize - 1][0];
+                }
+            }
+        });
+    return ns / ((double)nBlocks * blockSize * nVoices);
+}
+/*
+ * The kernel comparison. Each run writes everything it produces to out, so variants can be
+ * compared sample by sample, and returns ns per sample (per voice for the filters).
+ */
+double kernelSaw(const VoiceKernels &k, std::vector<float> &out)
+{
+    constexpr int uni = 16;
+    alignas(64) double phase[uni], dPhase[uni];
+    alignas(64) float gainL[uni], gainR[uni], amp[blockSize];
+    for (int i = 0; i < uni; ++i)
+    {
+        phase[i] = i / (double)uni;
+        dPhase[i] = (110.0 + i * 0.37) / sampleRate;
+        auto pan = i / (float)(uni - 1);
+        auto g = 1.f / (4.f * (float)(dPhase[i] * dPhase[i]));
+        gainL[i] = (1 - pan) * g;
+        gainR[i] = pan * g;
+    }
+    for (auto &a : amp)
+        a = 0.5f;
+
+    out.assign(2 * nBlocks * blockSize, 0.f);
+    auto ns = timeIt(
+        [&]()
+        {
+            for (int b = 0; b < nBlocks; ++b)
+            {
+                auto o = &out[2 * b * blockSize];
+                k.saw(phase, dPhase, gainL, gainR, uni, amp, o, o + blockSize, blockSize);
+            }
+        });
+    return ns / ((double)nBlocks * blockSize);
+}
+
+double kernelFilter(const VoiceKernels &k, int mode, std::vector<float> &out)
+{
+    constexpr int nv = StereoFilter::batchVoices;
+    Setup s(mode, nv);
+    StereoFilter *ptrs[nv];
+    for (int i = 0; i < nv; ++i)
+        ptrs[i] = &s.filters[i];
+
+    alignas(32) float io[blockSize][StereoFilter::batchLanes];
+    out.assign(nBlocks * blockSize * StereoFilter::batchLanes, 0.f);
+    auto ns = timeIt(
+        [&]()
+        {
+            for (int b = 0; b < nBlocks; ++b)
+            {
+                s.glide(b);
+                for (int i = 0; i < blockSize; ++i)
+                    for (int l = 0; l < StereoFilter::batchLanes; ++l)
+                        io[i][l] = s.input[b * blockSize + i] * (1 + l * 0.1f);
+                k.filterBatch(ptrs, nv, io, blockSize);
+                std::copy(&io[0][0], &io[0][0] + blockSize * StereoFilter::batchLanes,
+                          &out[b * blockSize * StereoFilter::batchLanes]);
+            }
+        });
+    return ns / ((double)nBlocks * blockSize * nv);
+}
+
+double kernelAdd(const VoiceKernels &k, std::vector<float> &out)
+{
+    alignas(32) float io[blockSize][StereoFilter::batchLanes];
+    for (int i = 0; i < blockSize; ++i)
+        for (int l = 0; l < StereoFilter::batchLanes; ++l)
+            io[i][l] = 0.001f * (i - l);
+
+    out.assign(2 * nBlocks * blockSize, 0.f);
+    auto ns = timeIt(
+        [&]()
+        {
+            for (int b = 0; b < nBlocks; ++b)
+            {
+                float *bus[2]{&out[2 * b * blockSize], &out[(2 * b + 1) * blockSize]};
+                for (int v = 0; v < StereoFilter::batchVoices; ++v)
+                    k.addVoice(bus, 2, 0, io, v, blockSize);
+            }
+        });
+    return ns / ((double)nBlocks * blockSize);
+}
+
+// A NaN anywhere comes out as NaN, which fails any tolerance
+float maxDiff(const std::vector<float> &a, const std::vector<float> &b)
+{
+    if (a.size() != b.size())
+        return std::numeric_limits<float>::infinity();
+    float d{0};
+    for (size_t i = 0; i < a.size(); ++i)
+    {
+        auto e = std::fabs(a[i] - b[i]);
+        if (!(e <= d))
+            d = e;
+    }
+    return d;
+}
+
+// Far above the rounding differences FMA and wider vectors bring, far below anything audible
+constexpr float kernelTolerance = 1e-5f;
+
+// Returns how many variants differ from the base one by more than kernelTolerance
+int compareKernels()
+{
+    constexpr int nTests = 5;
+    const int filterModes[] = {StereoFilter::LP, StereoFilter::LADDER, StereoFilter::OB_LP};
+
+    auto run = [&](const VoiceKernels &k, double *ns, std::vector<float> *out)
+    {
+        ns[0] = kernelSaw(k, out[0]);
+        for (int m = 0; m < 3; ++m)
+            ns[1 + m] = kernelFilter(k, filterModes[m], out[1 + m]);
+        ns[4] = kernelAdd(k, out[4]);
+    };
+
+    printf("\n%-8s %10s %10s %10s %10s %10s %12s   (ns/sample, ns/voice/sample for filters)\n",
+           "kernels", "saw x16", "simper", "ladder", "ob", "add", "max diff");
+
+    double ns[nTests];
+    std::vector<float> base[nTests], other[nTests];
+    run(*compiledVoiceKernels(KernelIsa::base), ns, base);
+    printf("%-8s %10.2f %10.2f %10.2f %10.2f %10.2f %12s\n", "base", ns[0], ns[1], ns[2], ns[3],
+           ns[4], "-");
+
+    int mismatches{0};
+    for (int i = 1; i < (int)KernelIsa::nIsas; ++i)
+    {
+        auto isa = (KernelIsa)i;
+        auto k = compiledVoiceKernels(isa);
+        if (!k || !cpuSupports(isa))
+            continue;
+        run(*k, ns, other);
+        float d{0};
+        for (int t = 0; t < nTests; ++t)
+        {
+            auto e = maxDiff(base[t], other[t]);
+            if (!(e <= d))
+                d = e;
+        }
+        auto ok = d <= kernelTolerance;
+        printf("%-8s %10.2f %10.2f %10.2f %10.2f %10.2f %12.3g%s\n", k->name, ns[0], ns[1],
+               ns[2], ns[3], ns[4], d, ok ? "" : " FAIL");
+        if (!ok)
+            mismatches++;
+    }
+    return mismatches;
+}
+} // namespace
+
+int main(int, char **)
+{
+    ScopedDenormalsDisabled noDenormals;
+    selectVoiceKernels();
+
+    struct Model
+    {
+        int mode;
+        const char *name;
+    } models[] = {{StereoFilter::LP, "Simper SVF"},
+                  {StereoFilter::LADDER, "Ladder"},
+                  {StereoFilter::OB_LP, "OB SVF"}};
+
+    double sink{0};
+    printf("%-12s %6s %14s %14s   (ns/voice/sample)\n", "model", "voices", "one at a time",
+           "batched");
+    for (const auto &m : models)
+    {
+        for (int n : {1, 4, 8, 16, 32, 64})
+        {
+            auto one = perVoice(m.mode, n, sink);
+            auto bat = batched(m.mode, n, sink);
+            printf("%-12s %6d %14.2f %14.2f\n", m.name, n, one, bat);
+        }
+    }
+
+    auto mismatches = compareKernels();
+
+    // Keep the optimizer from deciding none of this matters
+    if (sink == 12345.678)
+        printf(" ");
+
+    releaseDspTables();
+
+    if (mismatches)
+    {
+        printf("\n%d kernel variants differ from base by more than %g\n", mismatches,
+               kernelTolerance);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,193 @@
+/*
+ * ClapSawDemo
+ * https://github.com/surge-synthesizer/clap-saw-demo
+ *
+ * Copyright 2022 Paul Walker and others as listed in the git history
+ *
+ * Released under the MIT License. See LICENSE.md for full text.
+ */
+
+#include "filter-models.h"
+#include "fast-math.h"
+#include "voice-kernels.h"
+#include <algorithm>
+#include <cmath>
+
+namespace sst::clap_saw_demo
+{
+namespace
+{
+constexpr float pival = 3.14159265358979323846f;
+} // namespace
+
+StereoFilter::Model StereoFilter::modelFor(int mode)
+{
+    switch (mode)
+    {
+    case LADDER:
+        return fmLadder;
+    case OB_LP:
+    case OB_BP:
+    case OB_HP:
+        return fmOB;
+    default:
+        break;
+    }
+    return fmSimper;
+}
+
+void StereoFilter::setMode(int m)
+{
+    m = std::clamp(m, 0, nModes - 1);
+    auto newModel = modelFor(m);
+    if (newModel != model)
+        init();
+    mode = (Mode)m;
+    model = newModel;
+
+    // The weights of {low, band, high, -k * band}, or of the last stage for the ladder
+    float w[nMix]{1.f, 0.f, 0.f, 0.f};
+    switch (mode)
+    {
+    case LP:
+    case LADDER:
+    case OB_LP:
+        break;
+    case BP:
+    case OB_BP:
+        w[0] = 0.f;
+        w[1] = 1.f;
+        break;
+    case HP:
+    case OB_HP:
+        w[0] = 0.f;
+        w[2] = 1.f;
+        break;
+    case NOTCH:
+        w[2] = 1.f;
+        break;
+    case PEAK:
+        w[2] = -1.f;
+        break;
+    case ALL:
+        w[2] = 1.f;
+        w[3] = -1.f;
+        break;
+    }
+    std::copy(w, w + nMix, mix);
+}
+
+void StereoFilter::setCoeff(float key, float res, float srInv, const CutoffPrewarpTable *table)
+{
+    float g;
+    if (table)
+    {
+        g = table->keyToG(key);
+    }
+    else
+    {
+        auto co = noteFrequencyTable().noteToFrequency(key);
+        co = std::clamp(co, 10.0, 15000.0); // just to be safe/lazy
+        g = fastmath::tan(pival * co * srInv);
+    }
+    res = std::clamp(res, 0.01f, 0.99f);
+
+    if (model == fmLadder)
+    {
+        // It self oscillates at k = 4. The input gain of 1 + k undoes the passband loss
+        // which comes with resonance in a ladder.
+        auto G = g / (1 + g);
+        auto k = 4.f * res;
+        auto G2 = G * G;
+        c[0] = G;
+        c[1] = 1 - G;
+        c[2] = k;
+        c[3] = 1.f / (1 + k * G2 * G2);
+        c[4] = 1 + k;
+    }
+    else
+    {
+        auto k = 2.f - 2.f * res;
+        auto gk = g + k;
+        auto a1 = 1.f / (1.f + g * gk);
+        auto a2 = g * a1;
+        c[0] = a1;
+        c[1] = a2;
+        c[2] = g * a2;
+        c[3] = gk * a1;
+        c[4] = k;
+    }
+
+    // An immediate set cancels any glide in flight
+    std::fill(dc, dc + nCoeffs, 0.f);
+    interpolating = false;
+}
+
+void StereoFilter::setCoeffTarget(float key, float res, float srInv,
+                                  const CutoffPrewarpTable *table, int samples)
+{
+    float from[nCoeffs];
+    std::copy(c, c + nCoeffs, from);
+    setCoeff(key, res, srInv, table);
+    std::copy(c, c + nCoeffs, tc);
+
+    auto inv = 1.f / samples;
+    for (int k = 0; k < nCoeffs; ++k)
+    {
+        dc[k] = (tc[k] - from[k]) * inv;
+        c[k] = from[k];
+    }
+    interpolating = true;
+}
+
+void StereoFilter::finishInterpolation()
+{
+    std::copy(tc, tc + nCoeffs, c);
+    std::fill(dc, dc + nCoeffs, 0.f);
+    interpolating = false;
+}
+
+void StereoFilter::process(float *L, float *R, int n)
+{
+    auto self = this;
+    for (int off = 0; off < n; off += maxBatchFrames)
+    {
+        auto chunk = std::min(n - off, maxBatchFrames);
+        // A lone voice is the first two lanes of a batch, with silence in the rest
+        alignas(32) float io[maxBatchFrames][batchLanes]{};
+        for (int s = 0; s < chunk; ++s)
+        {
+            io[s][0] = L[off + s];
+            io[s][1] = R[off + s];
+        }
+
+        processFilterBatch(&self, 1, io, chunk);
+
+        for (int s = 0; s < chunk; ++s)
+        {
+            L[off + s] = io[s][0];
+            R[off + s] = io[s][1];
+        }
+    }
+}
+
+void StereoFilter::init()
+{
+    for (auto &s : z)
+        s[0] = s[1] = 0.f;
+}
+
+void StereoFilter::flushDenormals()
+{
+    for (auto &s : z)
+        for (auto &v : s)
+            v = std::fabs(v) < denormalThreshold ? 0.f : v;
+}
+
+void processFilterBatch(StereoFilter *const *filters, int count,
+                        float (*io)[StereoFilter::batchLanes], int n)
+{
+    // The lane loops are built per instruction set; see voice-kernels.h
+    voiceKernels().filterBatch(filters, count, io, n);
+}
+} // namespace sst::clap_saw_demo
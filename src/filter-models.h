@@ -0,0 +1,110 @@
+/*
+ * ClapSawDemo
+ * https://github.com/surge-synthesizer/clap-saw-demo
+ *
+ * Copyright 2022 Paul Walker and others as listed in the git history
+ *
+ * Released under the MIT License. See LICENSE.md for full text.
+ */
+
+#ifndef CLAP_SAW_DEMO_FILTER_MODELS_H
+#define CLAP_SAW_DEMO_FILTER_MODELS_H
+
+/*
+ * The voice filter. There are three models, picked by the filter mode:
+ *
+ * - the Simper SVF (thanks to urs @ u-he and andy simper @ cytomic) which gives the LP, HP,
+ *   BP, notch, peak and allpass modes as different mixes of its three outputs
+ * - a 4-pole transistor ladder low pass: four TPT one poles with zero delay feedback and a
+ *   saturator on the input to the first stage, so resonance compresses as it would in the
+ *   hardware
+ * - an OB-style SVF: the same topology as the Simper but with the band integrator saturating,
+ *   which gives the rounder, self limiting resonance of the OB-X family, in LP, BP and HP
+ *
+ * Every model is described by the same five coefficients (what they mean depends on the
+ * model; see setCoeff), at most four states per channel and four output mix weights. That
+ * makes the models interchangeable in a voice and, more importantly, lets
+ * processFilterBatch run several voices using the same model at once: it lays four voices'
+ * left and right channels out in eight lanes and runs each sample as straight line code over
+ * the lanes, built for each instruction set (see voice-kernels.h). Voices using the SVF
+ * with different modes still share a batch since the mode is only the per lane mix weights.
+ *
+ * Coefficients glide per sample across a control block (setCoeffTarget) the same way for
+ * every model, and the voice calls setCoeff / setCoeffTarget / finishInterpolation without
+ * caring which model it has.
+ */
+
+#include "dsp-tables.h"
+
+namespace sst::clap_saw_demo
+{
+struct StereoFilter
+{
+    // Stored in the filter mode parameter, so only ever add to the end
+    enum Mode
+    {
+        LP,
+        HP,
+        BP,
+        NOTCH,
+        PEAK,
+        ALL,
+        LADDER,
+        OB_LP,
+        OB_BP,
+        OB_HP
+    };
+    static constexpr int nModes = OB_HP + 1;
+
+    enum Model
+    {
+        fmSimper,
+        fmLadder,
+        fmOB,
+        nFilterModels
+    };
+    static Model modelFor(int mode);
+
+    static constexpr int nCoeffs = 5, nStates = 4, nMix = 4;
+    // A batch is this many voices, which is twice as many lanes
+    static constexpr int batchVoices = 4, batchLanes = 2 * batchVoices;
+    // and runs at most this many samples between gathering and scattering the voices
+    static constexpr int maxBatchFrames = 16;
+
+    Mode mode{LP};
+    Model model{fmSimper};
+
+    float c[nCoeffs]{}, dc[nCoeffs]{}, tc[nCoeffs]{};
+    float mix[nMix]{1.f, 0.f, 0.f, 0.f};
+    float z[nStates][2]{};
+    bool interpolating{false};
+
+    // Changing to a different model clears the state, which means nothing to the new one
+    void setMode(int mode);
+    void setCoeff(float key, float res, float srInv, const CutoffPrewarpTable *table);
+    // Like setCoeff but glide there linearly over the next 'samples' steps
+    void setCoeffTarget(float key, float res, float srInv, const CutoffPrewarpTable *table,
+                        int samples);
+    void finishInterpolation();
+
+    // Filter n samples of one voice in place
+    void process(float *L, float *R, int n);
+    inline void step(float &L, float &R) { process(&L, &R, 1); }
+
+    void init();
+    // Zero any state which has decayed below denormalThreshold. It's too small to hear
+    // (about -300dB) but left alone would become denormal as a tail rings down.
+    static constexpr float denormalThreshold = 1e-15f;
+    void flushDenormals();
+};
+
+/*
+ * Run count (1 to batchVoices) filters, which must share a model, over n (at most
+ * maxBatchFrames) samples. io[s][2 * i] and io[s][2 * i + 1] are filter i's left and right
+ * input at sample s and are replaced with its output.
+ */
+void processFilterBatch(StereoFilter *const *filters, int count,
+                        float (*io)[StereoFilter::batchLanes], int n);
+} // namespace sst::clap_saw_demo
+
+#endif // CLAP_SAW_DEMO_FILTER_MODELS_H
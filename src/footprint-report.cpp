@@ -0,0 +1,134 @@
+/*
+ * ClapSawDemo
+ * https://github.com/surge-synthesizer/clap-saw-demo
+ *
+ * Copyright 2022 Paul Walker and others as listed in the git history
+ *
+ * Released under the MIT License. See LICENSE.md for full text.
+ */
+
+/*
+ * clap-saw-demo-footprint is a tiny command line tool which reports how much memory an
+ * instance of the synth costs. It prints the sizeof the main classes and then creates,
+ * inits and activates N instances (default 256, or the first argument) against a do-nothing
+ * host and reports the resident set size before and after, so you can see the per-instance
+ * cost including the heap.
+ *
+ * It isn't built by default; run it with
+ *
+ *     cmake --build build --target footprint-report
+ *
+ * The numbers are only meaningful relative to each other (same platform, same build type)
+ * but that is all you need to see if a change made instances fatter.
+ */
+
+#include "clap-saw-demo.h"
+#include "dsp-tables.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#if defined(__APPLE__)
+#include <mach/mach.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#elif defined(__linux__)
+#include <unistd.h>
+#endif
+
+namespace
+{
+size_t residentBytes()
+{
+#if defined(__APPLE__)
+    mach_task_basic_info info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) !=
+        KERN_SUCCESS)
+        return 0;
+    return info.resident_size;
+#elif defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+        return 0;
+    return pmc.WorkingSetSize;
+#elif defined(__linux__)
+    auto f = fopen("/proc/self/statm", "r");
+    if (!f)
+        return 0;
+    long pages{0}, resident{0};
+    auto got = fscanf(f, "%ld %ld", &pages, &resident);
+    fclose(f);
+    if (got != 2)
+        return 0;
+    return (size_t)resident * (size_t)sysconf(_SC_PAGESIZE);
+#else
+    return 0;
+#endif
+}
+
+const void *hostGetExtension(const clap_host *, const char *) { return nullptr; }
+void hostRequest(const clap_host *) {}
+
+const clap_host footprintHost = {CLAP_VERSION,
+                                 nullptr,
+                                 "clap-saw-demo-footprint",
+                                 "surge-synth-team",
+                                 "",
+                                 "1.0.0",
+                                 hostGetExtension,
+                                 hostRequest,
+                                 hostRequest,
+                                 hostRequest};
+} // namespace
+
+int main(int argc, char **argv)
+{
+    using namespace sst::clap_saw_demo;
+
+    int count = 256;
+    if (argc > 1)
+        count = std::max(1, atoi(argv[1]));
+
+    printf("clap-helpers checking level          = %d (0 None, 1 Minimal, 2 Maximal)\n",
+           CLAP_SAW_DEMO_CHECKING_LEVEL);
+    printf("sizeof(ClapSawDemo)                 = %8zu bytes\n", sizeof(ClapSawDemo));
+    printf("sizeof(SawDemoVoice)                = %8zu bytes\n", sizeof(SawDemoVoice));
+    printf("sizeof(SawDemoVoice) * max_voices   = %8zu bytes\n",
+           sizeof(SawDemoVoice) * ClapSawDemo::max_voices);
+    printf("sizeof(ClapSawDemo::UIQueues)       = %8zu bytes (plus heap, only with an editor)\n",
+           sizeof(ClapSawDemo::UIQueues));
+
+    noteFrequencyTable();
+
+    std::vector<const clap_plugin *> plugins;
+    plugins.reserve(count);
+
+    auto before = residentBytes();
+    for (int i = 0; i < count; ++i)
+    {
+        // The helpers own the instance from here; destroy() below deletes it
+        auto p = (new ClapSawDemo(&footprintHost))->clapPlugin();
+        p->init(p);
+        p->activate(p, 48000, 16, 4096);
+        plugins.push_back(p);
+    }
+    auto after = residentBytes();
+
+    printf("resident before %d instances          = %8zu kb\n", count, before / 1024);
+    printf("resident after  %d instances          = %8zu kb\n", count, after / 1024);
+    if (after > before)
+        printf("resident per instance               = %8zu bytes\n", (after - before) / count);
+
+    for (auto p : plugins)
+    {
+        p->deactivate(p);
+        p->destroy(p);
+    }
+    releaseDspTables();
+
+    return 0;
+}
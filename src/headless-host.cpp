@@ -0,0 +1,1105 @@
+/*
+ * ClapSawDemo
+ * https://github.com/surge-synthesizer/clap-saw-demo
+ *
+ * Copyright 2022 Paul Walker and others as listed in the git history
+ *
+ * Released under the MIT License. See LICENSE.md for full text.
+ */
+
+/*
+ * clap-saw-demo-headless is a minimal CLAP host with no audio device and no GUI. It loads
+ * the built plugin the way a DAW would (dlopen / LoadLibrary and clap_entry), so it measures
+ * exactly the binary you ship, flags and all, and it is how the PGO build trains the plugin
+ * (see cmake/pgo-pipeline.cmake).
+ *
+ * It plays a few fixed, seeded scenarios as fast as it can and reports, for each, the wall
+ * clock cost per sample of audio and how many times faster than real time that is:
+ *
+ * - poly: overlapping 16 note chords with release tails, enough to fill all the voices and
+ *   steal some
+ * - unison: a few notes with every unison voice on
+ * - filters: chords which step through every filter mode, so every model gets batches
+ * - modstorm: poly, plus per note modulation of cutoff, resonance and VCA four times a
+ *   block, which is the branchiest path through the voice
+ *
+ * Usage
+ *
+ *     clap-saw-demo-headless <plugin.clap> [--seconds S] [--block N] [--offline]
+ *     clap-saw-demo-headless <plugin.clap> --params
+ *     clap-saw-demo-headless <plugin.clap> --replay <recording> [--offline]
+ *     clap-saw-demo-headless <plugin.clap> --alloc-check [--block N] [--offline]
+ *
+ * S is the seconds of audio per scenario (default 10) and N the block size (default 256).
+ * --offline puts the plugin in offline render mode first. The headless-bench target runs it
+ * on the plugin in the build.
+ *
+ * --params instead checks and times the parameter text conversions, as a host drawing
+ * automation lanes would use them. Every parameter is swept across its range, shown as text
+ * and read back. The text read back must show the same, and for a number the value read back
+ * must be within 1e-4 of the range of where it started. It prints the cost of each direction
+ * and the worst error per parameter, and exits with 3 if anything failed. The param-text
+ * target runs it on the plugin in the build.
+ *
+ * --replay plays back a recording of a real session, made by running the host with
+ * CLAP_SAW_DEMO_RECORD set (see event-recorder.h). Every activate, block and flush happens
+ * again in order, with the same sizes, channel layouts and events, so a problem seen in a
+ * DAW can be profiled here as many times as you like. It prints the cost per sample and the
+ * slowest block, and a hash of all the audio, which is the same on every replay of a
+ * recording with the same build. It exits with 3 if the recording can't be read.
+ *
+ * --alloc-check makes sure process never allocates or frees memory, even when the voices
+ * and the NOTE_END queue overflow: after a few ordinary blocks, it sends one block of
+ * 10,000 NOTE_ONs, then one of their NOTE_OFFs, then two seconds of release tails, and
+ * counts every malloc and free (which is where operator new and delete end up) made while
+ * process is running. It prints the counts and exits with 3 if any is above zero. Counting
+ * needs glibc or macOS (see below); elsewhere it says so and exits with 4. The alloc-check
+ * target runs it on the plugin in the build.
+ */
+
+#include <clap/clap.h>
+
+#include "event-recorder.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#include <sys/stat.h>
+#endif
+
+#if defined(__APPLE__)
+#include <malloc/malloc.h>
+#include <mach/mach.h>
+#endif
+
+/*
+ * Allocation counting for --alloc-check. The plugin is its own binary with its own
+ * references to operator new, so replacing operator new here wouldn't see what it does;
+ * but operator new and delete, ours and the plugin's, are malloc and free underneath, so
+ * those are what we count. With glibc that is by defining malloc and friends here, which
+ * every library loaded after us (the plugin and the C++ runtime included) then calls
+ * instead of glibc's. On macOS it is by swapping the functions of the malloc zones. On
+ * Windows each module can have its own CRT heap with no hook into it, so there is no
+ * counting.
+ *
+ * Counting is only armed around process, so the host's own allocations between calls
+ * don't count.
+ */
+namespace
+{
+std::atomic<bool> allocationsArmed{false};
+std::atomic<uint64_t> allocationCount{0}, freeCount{0};
+
+inline void noteAllocation()
+{
+    if (allocationsArmed.load(std::memory_order_relaxed))
+        allocationCount.fetch_add(1, std::memory_order_relaxed);
+}
+inline void noteFree(void *p)
+{
+    if (p && allocationsArmed.load(std::memory_order_relaxed))
+        freeCount.fetch_add(1, std::memory_order_relaxed);
+}
+} // namespace
+
+#if defined(__GLIBC__)
+extern "C"
+{
+    void *__libc_malloc(size_t);
+    void *__libc_calloc(size_t, size_t);
+    void *__libc_realloc(void *, size_t);
+    void *__libc_memalign(size_t, size_t);
+    void *__libc_valloc(size_t);
+    void *__libc_pvalloc(size_t);
+    void __libc_free(void *);
+
+    void *malloc(size_t n) noexcept
+    {
+        noteAllocation();
+        return __libc_malloc(n);
+    }
+    void *calloc(size_t count, size_t n) noexcept
+    {
+        noteAllocation();
+        return __libc_calloc(count, n);
+    }
+    void *realloc(void *p, size_t n) noexcept
+    {
+        noteAllocation();
+        return __libc_realloc(p, n);
+    }
+    void *memalign(size_t align, size_t n) noexcept
+    {
+        noteAllocation();
+        return __libc_memalign(align, n);
+    }
+    void *aligned_alloc(size_t align, size_t n) noexcept
+    {
+        noteAllocation();
+        return __libc_memalign(align, n);
+    }
+    int posix_memalign(void **out, size_t align, size_t n) noexcept
+    {
+        noteAllocation();
+        auto p = __libc_memalign(align, n);
+        if (!p)
+            return ENOMEM;
+        *out = p;
+        return 0;
+    }
+    void *valloc(size_t n) noexcept
+    {
+        noteAllocation();
+        return __libc_valloc(n);
+    }
+    void *pvalloc(size_t n) noexcept
+    {
+        noteAllocation();
+        return __libc_pvalloc(n);
+    }
+    void free(void *p) noexcept
+    {
+        noteFree(p);
+        __libc_free(p);
+    }
+}
+
+namespace
+{
+bool installAllocationHooks() { return true; }
+} // namespace
+#elif defined(__APPLE__)
+namespace
+{
+/*
+ * malloc goes to the default zone, which on recent macOS is a front which hands on to the
+ * first registered zone, so we hook that as well as every registered zone. Each hook finds
+ * the zone's own function by the zone it is called with.
+ */
+struct HookedZone
+{
+    malloc_zone_t *zone{nullptr};
+    malloc_zone_t original{};
+};
+std::array<HookedZone, 16> hookedZones;
+int nHookedZones{0};
+
+const malloc_zone_t &originalOf(malloc_zone_t *z)
+{
+    for (int i = 0; i < nHookedZones; ++i)
+        if (hookedZones[i].zone == z)
+            return hookedZones[i].original;
+    abort();
+}
+
+void *zoneMalloc(malloc_zone_t *z, size_t n)
+{
+    noteAllocation();
+    return originalOf(z).malloc(z, n);
+}
+void *zoneCalloc(malloc_zone_t *z, size_t count, size_t n)
+{
+    noteAllocation();
+    return originalOf(z).calloc(z, count, n);
+}
+void *zoneValloc(malloc_zone_t *z, size_t n)
+{
+    noteAllocation();
+    return originalOf(z).valloc(z, n);
+}
+void *zoneRealloc(malloc_zone_t *z, void *p, size_t n)
+{
+    noteAllocation();
+    return originalOf(z).realloc(z, p, n);
+}
+void *zoneMemalign(malloc_zone_t *z, size_t align, size_t n)
+{
+    noteAllocation();
+    return originalOf(z).memalign(z, align, n);
+}
+void zoneFree(malloc_zone_t *z, void *p)
+{
+    noteFree(p);
+    originalOf(z).free(z, p);
+}
+void zoneFreeDefiniteSize(malloc_zone_t *z, void *p, size_t n)
+{
+    noteFree(p);
+    originalOf(z).free_definite_size(z, p, n);
+}
+
+void hookZone(malloc_zone_t *z)
+{
+    for (int i = 0; i < nHookedZones; ++i)
+        if (hookedZones[i].zone == z)
+            return;
+    if (!z || nHookedZones == (int)hookedZones.size())
+        return;
+
+    hookedZones[nHookedZones] = {z, *z};
+    nHookedZones++;
+
+    // Zones are normally read only
+    vm_protect(mach_task_self(), (vm_address_t)z, sizeof(malloc_zone_t), 0,
+               VM_PROT_READ | VM_PROT_WRITE);
+    z->malloc = zoneMalloc;
+    z->calloc = zoneCalloc;
+    z->valloc = zoneValloc;
+    z->realloc = zoneRealloc;
+    z->free = zoneFree;
+    if (z->version >= 5 && z->memalign)
+        z->memalign = zoneMemalign;
+    if (z->version >= 6 && z->free_definite_size)
+        z->free_definite_size = zoneFreeDefiniteSize;
+}
+
+bool installAllocationHooks()
+{
+    vm_address_t *zones{nullptr};
+    unsigned int count{0};
+    if (malloc_get_all_zones(mach_task_self(), nullptr, &zones, &count) != KERN_SUCCESS)
+        return false;
+    for (unsigned int i = 0; i < count; ++i)
+        hookZone((malloc_zone_t *)zones[i]);
+    hookZone(malloc_default_zone());
+    return nHookedZones > 0;
+}
+} // namespace
+#else
+namespace
+{
+bool installAllocationHooks() { return false; }
+} // namespace
+#endif
+
+namespace
+{
+constexpr double sampleRate = 48000;
+
+/*
+ * Finding clap_entry. A path to a directory is taken to be a macOS bundle.
+ */
+const clap_plugin_entry_t *loadEntry(std::string path)
+{
+#if defined(_WIN32)
+    auto lib = LoadLibraryA(path.c_str());
+    if (!lib)
+        return nullptr;
+    return (const clap_plugin_entry_t *)GetProcAddress(lib, "clap_entry");
+#else
+    struct stat st;
+    if (stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode))
+    {
+        while (!path.empty() && path.back() == '/')
+            path.pop_back();
+        auto name = path.substr(path.find_last_of('/') + 1);
+        name = name.substr(0, name.find_last_of('.'));
+        path += "/Contents/MacOS/" + name;
+    }
+    auto lib = dlopen(path.c_str(), RTLD_LOCAL | RTLD_NOW);
+    if (!lib)
+    {
+        fprintf(stderr, "%s\n", dlerror());
+        return nullptr;
+    }
+    return (const clap_plugin_entry_t *)dlsym(lib, "clap_entry");
+#endif
+}
+
+const void *hostGetExtension(const clap_host *, const char *) { return nullptr; }
+void hostRequest(const clap_host *) {}
+
+const clap_host headlessHost = {CLAP_VERSION,
+                                nullptr,
+                                "clap-saw-demo-headless",
+                                "surge-synth-team",
+                                "",
+                                "0.0.0",
+                                hostGetExtension,
+                                hostRequest,
+                                hostRequest,
+                                hostRequest};
+
+/*
+ * The block's input events, kept sorted by time as CLAP requires, and an output list which
+ * just counts what the plugin sends us.
+ */
+struct EventList
+{
+    std::vector<std::vector<uint8_t>> events;
+
+    template <typename E> void add(const E &e)
+    {
+        auto p = (const uint8_t *)&e;
+        events.emplace_back(p, p + sizeof(E));
+    }
+    void addRaw(const uint8_t *p, uint32_t bytes) { events.emplace_back(p, p + bytes); }
+
+    void sort()
+    {
+        std::stable_sort(events.begin(), events.end(),
+                         [](const auto &a, const auto &b)
+                         {
+                             return ((const clap_event_header_t *)a.data())->time <
+                                    ((const clap_event_header_t *)b.data())->time;
+                         });
+    }
+
+    clap_input_events_t in{this, size, get};
+
+    static uint32_t size(const clap_input_events_t *l)
+    {
+        return (uint32_t)((EventList *)l->ctx)->events.size();
+    }
+    static const clap_event_header_t *get(const clap_input_events_t *l, uint32_t i)
+    {
+        return (const clap_event_header_t *)((EventList *)l->ctx)->events[i].data();
+    }
+};
+
+uint64_t outEventCount{0};
+bool countOutEvent(const clap_output_events_t *, const clap_event_header_t *)
+{
+    outEventCount++;
+    return true;
+}
+const clap_output_events_t countingOut{nullptr, countOutEvent};
+
+template <typename E> E header(uint16_t type, uint32_t time)
+{
+    E e{};
+    e.header.size = sizeof(E);
+    e.header.time = time;
+    e.header.space_id = CLAP_CORE_EVENT_SPACE_ID;
+    e.header.type = type;
+    e.header.flags = 0;
+    return e;
+}
+
+struct Scenario
+{
+    const char *name;
+    int unison; // 0 for as many as there are
+    int chordSize;
+    int chordEveryBlocks;
+    bool cycleFilters;
+    bool modStorm;
+};
+
+const Scenario scenarios[] = {{"poly", 3, 16, 24, false, false},
+                              {"unison", 0, 4, 96, false, false},
+                              {"filters", 3, 16, 24, true, false},
+                              {"modstorm", 3, 16, 24, false, true}};
+
+struct Plugin
+{
+    const clap_plugin_t *plugin{nullptr};
+    const clap_plugin_params_t *params{nullptr};
+
+    // Parameters are looked up by name, so the scenarios don't depend on our ids
+    clap_param_info_t paramInfo(const char *name) const
+    {
+        clap_param_info_t info{};
+        for (uint32_t i = 0; params && i < params->count(plugin); ++i)
+        {
+            if (params->get_info(plugin, i, &info) && strcmp(info.name, name) == 0)
+                return info;
+        }
+        fprintf(stderr, "No parameter named '%s'\n", name);
+        info.id = CLAP_INVALID_ID;
+        return info;
+    }
+    clap_id paramId(const char *name) const { return paramInfo(name).id; }
+};
+
+// Returns wall clock ns per sample of audio
+double runScenario(const Plugin &p, const Scenario &sc, double seconds, uint32_t blockSize)
+{
+    auto unisonInfo = p.paramInfo("Unison Count");
+    auto unisonId = unisonInfo.id;
+    auto modeInfo = p.paramInfo("Filter Type");
+    auto modeId = modeInfo.id;
+    auto nModes = (int)modeInfo.max_value + 1;
+    auto cutoffId = p.paramId("Cutoff in Keys");
+    auto resId = p.paramId("Resonance");
+    auto vcaId = p.paramId("Pre Filter VCA");
+    auto releaseId = p.paramId("Amplitude Release (s)");
+
+    std::vector<float> L(blockSize), R(blockSize);
+    float *chans[2]{L.data(), R.data()};
+    clap_audio_buffer_t out{};
+    out.data32 = chans;
+    out.channel_count = 2;
+
+    clap_process_t proc{};
+    proc.frames_count = blockSize;
+    proc.audio_outputs = &out;
+    proc.audio_outputs_count = 1;
+    proc.out_events = &countingOut;
+
+    std::minstd_rand gen(2112);
+    EventList events;
+    proc.in_events = &events.in;
+
+    struct Held
+    {
+        int key, noteId;
+    };
+    std::vector<Held> held;
+    int nextNoteId{0}, chord{0};
+    auto nBlocks = (int)(seconds * sampleRate / blockSize);
+
+    auto paramValue = [&](clap_id id, double v, uint32_t t)
+    {
+        auto e = header<clap_event_param_value_t>(CLAP_EVENT_PARAM_VALUE, t);
+        e.param_id = id;
+        e.note_id = -1;
+        e.port_index = e.channel = e.key = -1;
+        e.value = v;
+        events.add(e);
+    };
+
+    double ns{0};
+    for (int b = 0; b < nBlocks; ++b)
+    {
+        events.events.clear();
+        if (b == 0)
+        {
+            paramValue(unisonId, sc.unison ? sc.unison : unisonInfo.max_value, 0);
+            paramValue(modeId, 0, 0);
+            paramValue(cutoffId, 72, 0);
+            paramValue(resId, 0.7, 0);
+            paramValue(releaseId, 0.5, 0);
+        }
+
+        if (b % sc.chordEveryBlocks == 0)
+        {
+            for (const auto &h : held)
+            {
+                auto e = header<clap_event_note_t>(CLAP_EVENT_NOTE_OFF, gen() % blockSize);
+                e.note_id = h.noteId;
+                e.port_index = 0;
+                e.channel = 0;
+                e.key = (int16_t)h.key;
+                events.add(e);
+            }
+            held.clear();
+
+            if (sc.cycleFilters)
+                paramValue(modeId, chord % nModes, 0);
+
+            for (int n = 0; n < sc.chordSize; ++n)
+            {
+                auto e = header<clap_event_note_t>(CLAP_EVENT_NOTE_ON, gen() % blockSize);
+                e.note_id = nextNoteId++;
+                e.port_index = 0;
+                e.channel = 0;
+                e.key = (int16_t)(36 + gen() % 48);
+                e.velocity = 0.8;
+                events.add(e);
+                held.push_back({e.key, e.note_id});
+            }
+            chord++;
+        }
+
+        if (sc.modStorm)
+        {
+            const clap_id targets[3]{cutoffId, resId, vcaId};
+            for (uint32_t t = 0; t < blockSize; t += blockSize / 4)
+            {
+                for (const auto &h : held)
+                {
+                    auto e = header<clap_event_param_mod_t>(CLAP_EVENT_PARAM_MOD, t);
+                    e.param_id = targets[gen() % 3];
+                    e.note_id = h.noteId;
+                    e.port_index = e.channel = e.key = -1;
+                    e.amount = (gen() % 2001) / 1000.0 - 1.0;
+                    events.add(e);
+                }
+            }
+        }
+
+        events.sort();
+        proc.steady_time = (int64_t)b * blockSize;
+
+        auto t0 = std::chrono::steady_clock::now();
+        p.plugin->process(p.plugin, &proc);
+        auto t1 = std::chrono::steady_clock::now();
+        ns += std::chrono::duration<double, std::nano>(t1 - t0).count();
+    }
+    return ns / ((double)nBlocks * blockSize);
+}
+// See --params above. Returns true if every parameter round trips.
+bool checkParamText(const Plugin &p)
+{
+    if (!p.params)
+    {
+        fprintf(stderr, "The plugin has no params extension\n");
+        return false;
+    }
+
+    constexpr int nValues = 2000, nTimingRounds = 50;
+    bool ok{true};
+    printf("%-28s %12s %12s %12s\n", "parameter", "ns to text", "ns from text", "max error");
+    for (uint32_t i = 0; i < p.params->count(p.plugin); ++i)
+    {
+        clap_param_info_t info{};
+        if (!p.params->get_info(p.plugin, i, &info))
+            continue;
+
+        auto range = info.max_value - info.min_value;
+        bool stepped = info.flags & CLAP_PARAM_IS_STEPPED;
+        std::vector<double> values;
+        if (stepped)
+            for (auto v = info.min_value; v <= info.max_value; v += 1)
+                values.push_back(v);
+        else
+            for (int k = 0; k < nValues; ++k)
+                values.push_back(info.min_value + range * k / (nValues - 1));
+
+        double maxErr{0};
+        bool paramOk{true};
+        for (auto v : values)
+        {
+            char text[256], again[256];
+            double back;
+            if (!p.params->value_to_text(p.plugin, info.id, v, text, sizeof(text)) ||
+                !p.params->text_to_value(p.plugin, info.id, text, &back) ||
+                !p.params->value_to_text(p.plugin, info.id, back, again, sizeof(again)))
+            {
+                fprintf(stderr, "%s: no round trip for %g ('%s')\n", info.name, v, text);
+                paramOk = false;
+                continue;
+            }
+            if (strcmp(text, again) != 0)
+            {
+                fprintf(stderr, "%s: %g shows '%s' but reads back as '%s'\n", info.name, v, text,
+                        again);
+                paramOk = false;
+            }
+            if ((text[0] >= '0' && text[0] <= '9') || text[0] == '-')
+            {
+                auto err = std::fabs(back - v);
+                maxErr = std::max(maxErr, err);
+                if (err > 1e-4 * range)
+                {
+                    fprintf(stderr, "%s: %g shows '%s' and reads back as %g\n", info.name, v,
+                            text, back);
+                    paramOk = false;
+                }
+            }
+        }
+
+        // And the cost, over the same values a few times
+        std::vector<std::array<char, 64>> texts(values.size());
+        auto t0 = std::chrono::steady_clock::now();
+        for (int r = 0; r < nTimingRounds; ++r)
+            for (size_t k = 0; k < values.size(); ++k)
+                p.params->value_to_text(p.plugin, info.id, values[k], texts[k].data(), 64);
+        // The calls go through the plugin's function table, so nothing here can be optimized
+        // away
+        auto t1 = std::chrono::steady_clock::now();
+        double back;
+        for (int r = 0; r < nTimingRounds; ++r)
+            for (const auto &t : texts)
+                p.params->text_to_value(p.plugin, info.id, t.data(), &back);
+        auto t2 = std::chrono::steady_clock::now();
+        auto calls = (double)nTimingRounds * values.size();
+        auto toNs = std::chrono::duration<double, std::nano>(t1 - t0).count() / calls;
+        auto fromNs = std::chrono::duration<double, std::nano>(t2 - t1).count() / calls;
+
+        printf("%-28s %12.1f %12.1f %12.3g%s\n", info.name, toNs, fromNs, maxErr,
+               paramOk ? "" : "   FAILED");
+        ok = ok && paramOk;
+    }
+    return ok;
+}
+
+/*
+ * See --alloc-check above. Returns true if process neither allocated nor freed.
+ */
+bool checkAllocations(const Plugin &p, uint32_t blockSize)
+{
+    constexpr int nNotes = 10000, nWarmupBlocks = 8;
+    constexpr double tailSeconds = 2;
+
+    std::vector<float> L(blockSize), R(blockSize);
+    float *chans[2]{L.data(), R.data()};
+    clap_audio_buffer_t out{};
+    out.data32 = chans;
+    out.channel_count = 2;
+
+    EventList events;
+    clap_process_t proc{};
+    proc.frames_count = blockSize;
+    proc.audio_outputs = &out;
+    proc.audio_outputs_count = 1;
+    proc.in_events = &events.in;
+    proc.out_events = &countingOut;
+
+    auto notes = [&](uint16_t type, int count)
+    {
+        for (int n = 0; n < count; ++n)
+        {
+            auto e = header<clap_event_note_t>(type, (uint32_t)((uint64_t)n * blockSize / count));
+            e.note_id = n;
+            e.port_index = 0;
+            e.channel = (int16_t)(n / 128 % 16);
+            e.key = (int16_t)(n % 128);
+            e.velocity = 0.8;
+            events.add(e);
+        }
+    };
+
+    int64_t steadyTime{0};
+    auto runBlock = [&](bool armed)
+    {
+        events.sort();
+        proc.steady_time = steadyTime;
+        steadyTime += blockSize;
+        allocationsArmed.store(armed, std::memory_order_relaxed);
+        p.plugin->process(p.plugin, &proc);
+        allocationsArmed.store(false, std::memory_order_relaxed);
+        events.events.clear();
+    };
+
+    p.plugin->activate(p.plugin, sampleRate, blockSize, blockSize);
+    p.plugin->start_processing(p.plugin);
+
+    // Anything the plugin sets up the first time it plays isn't what we're after
+    for (int b = 0; b < nWarmupBlocks; ++b)
+    {
+        if (b == 0)
+            notes(CLAP_EVENT_NOTE_ON, 16);
+        if (b == nWarmupBlocks / 2)
+            notes(CLAP_EVENT_NOTE_OFF, 16);
+        runBlock(false);
+    }
+
+    printf("%u frames a block, %d notes\n", blockSize, nNotes);
+    printf("%-12s %12s %12s %12s\n", "block", "allocations", "frees", "out events");
+    uint64_t allocations{0}, frees{0};
+    auto report = [&](const char *name, int nBlocks)
+    {
+        allocationCount = 0;
+        freeCount = 0;
+        outEventCount = 0;
+        for (int b = 0; b < nBlocks; ++b)
+            runBlock(true);
+        printf("%-12s %12llu %12llu %12llu\n", name, (unsigned long long)allocationCount.load(),
+               (unsigned long long)freeCount.load(), (unsigned long long)outEventCount);
+        allocations += allocationCount;
+        frees += freeCount;
+    };
+
+    notes(CLAP_EVENT_NOTE_ON, nNotes);
+    report("note ons", 1);
+    notes(CLAP_EVENT_NOTE_OFF, nNotes);
+    report("note offs", 1);
+    report("tails", (int)(tailSeconds * sampleRate / blockSize));
+
+    p.plugin->stop_processing(p.plugin);
+    p.plugin->deactivate(p.plugin);
+
+    if (allocations || frees)
+        printf("process allocated %llu times and freed %llu times\n",
+               (unsigned long long)allocations, (unsigned long long)frees);
+    return allocations == 0 && frees == 0;
+}
+
+// A cursor over one --replay record's payload. Reading past its end sets bad.
+struct RecordReader
+{
+    const uint8_t *at, *end;
+    bool bad{false};
+    template <typename T> T get()
+    {
+        T v{};
+        if (end - at < (ptrdiff_t)sizeof(T))
+        {
+            bad = true;
+            return v;
+        }
+        memcpy(&v, at, sizeof(T));
+        at += sizeof(T);
+        return v;
+    }
+    // The next n events into l
+    void events(EventList &l, uint32_t n)
+    {
+        for (uint32_t i = 0; i < n && !bad; ++i)
+        {
+            clap_event_header_t h;
+            if (end - at < (ptrdiff_t)sizeof(h))
+            {
+                bad = true;
+                return;
+            }
+            memcpy(&h, at, sizeof(h));
+            if (h.size < sizeof(h) || end - at < (ptrdiff_t)h.size)
+            {
+                bad = true;
+                return;
+            }
+            l.addRaw(at, h.size);
+            at += h.size;
+        }
+    }
+};
+
+/*
+ * See --replay above, and event-recorder.h for the format. Returns false if the recording
+ * is unreadable; a cut off last record (from a host which crashed, say) is only reported.
+ */
+bool replayRecording(const Plugin &p, const char *fileName)
+{
+    using sst::clap_saw_demo::EventRecorder;
+
+    std::vector<uint8_t> data;
+    if (auto f = fopen(fileName, "rb"))
+    {
+        uint8_t chunk[1 << 16];
+        size_t n;
+        while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0)
+            data.insert(data.end(), chunk, chunk + n);
+        fclose(f);
+    }
+    if (data.size() < sizeof(EventRecorder::magic) ||
+        memcmp(data.data(), EventRecorder::magic, sizeof(EventRecorder::magic)) != 0)
+    {
+        fprintf(stderr, "'%s' isn't an event recording\n", fileName);
+        return false;
+    }
+
+    auto portsConfig = (const clap_plugin_audio_ports_config_t *)p.plugin->get_extension(
+        p.plugin, CLAP_EXT_AUDIO_PORTS_CONFIG);
+
+    EventList events, uiEvents;
+    std::vector<std::vector<float>> channels;
+    std::vector<float *> channelPtrs;
+    std::vector<clap_audio_buffer_t> outs;
+
+    bool active{false};
+    double sr{sampleRate}, ns{0}, worstNs{0};
+    uint64_t blocks{0}, frames{0}, worstBlock{0}, gaps{0};
+    uint32_t worstFrames{0};
+    uint64_t hash{1469598103934665603ULL}; // FNV-1a over the bits of every output sample
+
+    auto stop = [&]()
+    {
+        if (active)
+        {
+            p.plugin->stop_processing(p.plugin);
+            p.plugin->deactivate(p.plugin);
+        }
+        active = false;
+    };
+    // Editor changes replay at the start of whatever comes next
+    auto takeUIEvents = [&]()
+    {
+        events.events.clear();
+        std::swap(events.events, uiEvents.events);
+    };
+
+    size_t pos = sizeof(EventRecorder::magic);
+    while (pos < data.size())
+    {
+        if (data.size() - pos < 5)
+        {
+            fprintf(stderr, "Ignoring a cut off record at the end\n");
+            break;
+        }
+        auto type = data[pos];
+        uint32_t payload;
+        memcpy(&payload, &data[pos + 1], sizeof(payload));
+        pos += 5;
+        if (data.size() - pos < payload)
+        {
+            fprintf(stderr, "Ignoring a cut off record at the end\n");
+            break;
+        }
+        RecordReader r{&data[pos], &data[pos] + payload};
+        pos += payload;
+
+        switch (type)
+        {
+        case EventRecorder::rtActivate:
+        {
+            stop();
+            sr = r.get<double>();
+            auto minFrames = r.get<uint32_t>();
+            auto maxFrames = r.get<uint32_t>();
+            auto config = r.get<uint32_t>();
+            auto nParams = r.get<uint32_t>();
+            events.events.clear();
+            for (uint32_t i = 0; i < nParams && !r.bad; ++i)
+            {
+                auto e = header<clap_event_param_value_t>(CLAP_EVENT_PARAM_VALUE, 0);
+                e.param_id = r.get<uint32_t>();
+                e.note_id = -1;
+                e.port_index = e.channel = e.key = -1;
+                e.value = r.get<double>();
+                events.add(e);
+            }
+            if (r.bad)
+                break;
+            if (p.params)
+                p.params->flush(p.plugin, &events.in, &countingOut);
+            if (portsConfig)
+                portsConfig->select(p.plugin, config);
+            active = p.plugin->activate(p.plugin, sr, minFrames, maxFrames) &&
+                     p.plugin->start_processing(p.plugin);
+            if (!active)
+                fprintf(stderr, "Plugin refused to activate at %g Hz, %u to %u frames\n", sr,
+                        minFrames, maxFrames);
+            break;
+        }
+        case EventRecorder::rtProcess:
+        {
+            auto nFrames = r.get<uint32_t>();
+            auto steadyTime = r.get<int64_t>();
+            auto nPorts = r.get<uint32_t>();
+            std::vector<uint32_t> chans;
+            for (uint32_t i = 0; i < nPorts && !r.bad; ++i)
+                chans.push_back(r.get<uint32_t>());
+            takeUIEvents();
+            r.events(events, r.get<uint32_t>());
+            if (r.bad)
+                break;
+            if (!active)
+                continue;
+
+            uint32_t nChans{0};
+            for (auto c : chans)
+                nChans += c;
+            channels.resize(nChans);
+            channelPtrs.resize(nChans);
+            for (uint32_t c = 0; c < nChans; ++c)
+            {
+                channels[c].assign(nFrames, 0.f);
+                channelPtrs[c] = channels[c].data();
+            }
+            outs.assign(nPorts, clap_audio_buffer_t{});
+            for (uint32_t i = 0, c = 0; i < nPorts; c += chans[i], ++i)
+            {
+                outs[i].data32 = channelPtrs.data() + c;
+                outs[i].channel_count = chans[i];
+            }
+
+            clap_process_t proc{};
+            proc.frames_count = nFrames;
+            proc.steady_time = steadyTime;
+            proc.audio_outputs = outs.data();
+            proc.audio_outputs_count = nPorts;
+            proc.in_events = &events.in;
+            proc.out_events = &countingOut;
+
+            auto t0 = std::chrono::steady_clock::now();
+            p.plugin->process(p.plugin, &proc);
+            auto t1 = std::chrono::steady_clock::now();
+            auto blockNs = std::chrono::duration<double, std::nano>(t1 - t0).count();
+            ns += blockNs;
+            if (blockNs > worstNs)
+            {
+                worstNs = blockNs;
+                worstBlock = blocks;
+                worstFrames = nFrames;
+            }
+            blocks++;
+            frames += nFrames;
+
+            for (const auto &ch : channels)
+            {
+                for (auto s : ch)
+                {
+                    uint32_t bits;
+                    memcpy(&bits, &s, sizeof(bits));
+                    hash = (hash ^ bits) * 1099511628211ULL;
+                }
+            }
+            break;
+        }
+        case EventRecorder::rtFlush:
+        {
+            takeUIEvents();
+            r.events(events, r.get<uint32_t>());
+            if (!r.bad && p.params)
+                p.params->flush(p.plugin, &events.in, &countingOut);
+            break;
+        }
+        case EventRecorder::rtUIParam:
+        {
+            auto e = header<clap_event_param_value_t>(CLAP_EVENT_PARAM_VALUE, 0);
+            e.param_id = r.get<uint32_t>();
+            e.note_id = -1;
+            e.port_index = e.channel = e.key = -1;
+            e.value = r.get<double>();
+            uiEvents.add(e);
+            break;
+        }
+        case EventRecorder::rtDeactivate:
+            stop();
+            break;
+        case EventRecorder::rtGap:
+            gaps += r.get<uint32_t>();
+            break;
+        default:
+            fprintf(stderr, "Unknown record type %d\n", (int)type);
+            r.bad = true;
+            break;
+        }
+
+        if (r.bad)
+        {
+            fprintf(stderr, "'%s' is damaged at byte %zu\n", fileName, pos - payload - 5);
+            stop();
+            return false;
+        }
+    }
+    stop();
+
+    printf("%s: %llu blocks, %.1f s of audio at %g Hz\n", fileName, (unsigned long long)blocks,
+           frames / sr, sr);
+    if (gaps)
+        printf("The recorder dropped %llu records, so this isn't exactly the session\n",
+               (unsigned long long)gaps);
+    if (frames)
+    {
+        auto perSample = ns / frames;
+        printf("%12s %12s %24s\n", "ns/sample", "x realtime", "slowest block");
+        printf("%12.2f %12.1f %10.1f us (#%llu, %u)\n", perSample, 1e9 / (perSample * sr),
+               worstNs / 1000, (unsigned long long)worstBlock, worstFrames);
+    }
+    printf("output hash %016llx\n", (unsigned long long)hash);
+    return true;
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr,
+                "Usage: %s <plugin.clap> [--seconds S] [--block N] [--offline] [--params] "
+                "[--replay recording] [--alloc-check]\n",
+                argv[0]);
+        return 1;
+    }
+
+    std::string path = argv[1];
+    double seconds{10};
+    uint32_t blockSize{256};
+    bool offline{false}, paramText{false}, allocCheck{false};
+    const char *replayFile{nullptr};
+    for (int i = 2; i < argc; ++i)
+    {
+        std::string a = argv[i];
+        if (a == "--seconds" && i + 1 < argc)
+            seconds = std::max(atof(argv[++i]), 0.1);
+        else if (a == "--block" && i + 1 < argc)
+            blockSize = (uint32_t)std::clamp(atoi(argv[++i]), 16, 8192);
+        else if (a == "--offline")
+            offline = true;
+        else if (a == "--params")
+            paramText = true;
+        else if (a == "--replay" && i + 1 < argc)
+            replayFile = argv[++i];
+        else if (a == "--alloc-check")
+            allocCheck = true;
+    }
+
+    if (allocCheck && !installAllocationHooks())
+    {
+        fprintf(stderr, "Allocations can't be counted on this platform\n");
+        return 4;
+    }
+
+    auto entry = loadEntry(path);
+    if (!entry || !entry->init(path.c_str()))
+    {
+        fprintf(stderr, "Unable to load a CLAP from '%s'\n", path.c_str());
+        return 2;
+    }
+
+    auto factory = (const clap_plugin_factory_t *)entry->get_factory(CLAP_PLUGIN_FACTORY_ID);
+    if (!factory || factory->get_plugin_count(factory) == 0)
+    {
+        fprintf(stderr, "No plugins in '%s'\n", path.c_str());
+        entry->deinit();
+        return 2;
+    }
+
+    auto desc = factory->get_plugin_descriptor(factory, 0);
+    Plugin p;
+    p.plugin = factory->create_plugin(factory, &headlessHost, desc->id);
+    if (!p.plugin || !p.plugin->init(p.plugin))
+    {
+        fprintf(stderr, "Unable to create '%s'\n", desc->id);
+        entry->deinit();
+        return 2;
+    }
+    p.params = (const clap_plugin_params_t *)p.plugin->get_extension(p.plugin, CLAP_EXT_PARAMS);
+
+    if (paramText)
+    {
+        auto ok = checkParamText(p);
+        p.plugin->destroy(p.plugin);
+        entry->deinit();
+        return ok ? 0 : 3;
+    }
+
+    if (offline)
+    {
+        auto render =
+            (const clap_plugin_render_t *)p.plugin->get_extension(p.plugin, CLAP_EXT_RENDER);
+        if (!render || !render->set(p.plugin, CLAP_RENDER_OFFLINE))
+            fprintf(stderr, "Plugin refused offline render mode; measuring real time\n");
+    }
+
+    if (allocCheck)
+    {
+        auto ok = checkAllocations(p, blockSize);
+        p.plugin->destroy(p.plugin);
+        entry->deinit();
+        return ok ? 0 : 3;
+    }
+
+    if (replayFile)
+    {
+        auto ok = replayRecording(p, replayFile);
+        p.plugin->destroy(p.plugin);
+        entry->deinit();
+        return ok ? 0 : 3;
+    }
+
+    printf("%s, %.0f s per scenario, block %u%s\n", desc->name, seconds, blockSize,
+           offline ? ", offline" : "");
+    printf("%-10s %12s %12s\n", "scenario", "ns/sample", "x realtime");
+    p.plugin->activate(p.plugin, sampleRate, blockSize, blockSize);
+    p.plugin->start_processing(p.plugin);
+    for (const auto &sc : scenarios)
+    {
+        auto ns = runScenario(p, sc, seconds, blockSize);
+        printf("%-10s %12.2f %12.1f\n", sc.name, ns, 1e9 / (ns * sampleRate));
+    }
+    p.plugin->stop_processing(p.plugin);
+    p.plugin->deactivate(p.plugin);
+
+    p.plugin->destroy(p.plugin);
+    entry->deinit();
+    return 0;
+}
@@ -0,0 +1,98 @@
+/*
+ * ClapSawDemo
+ * https://github.com/surge-synthesizer/clap-saw-demo
+ *
+ * Copyright 2022 Paul Walker and others as listed in the git history
+ *
+ * Released under the MIT License. See LICENSE.md for full text.
+ */
+
+#ifndef CLAP_SAW_DEMO_KEY_STATE_H
+#define CLAP_SAW_DEMO_KEY_STATE_H
+
+/*
+ * Which of the 128 keys are held down and which are making sound, for the editor's
+ * keyboard. We used to send a queue message to the editor for every note on and off, which
+ * it never read, and which took queue space from parameter updates when the MIDI was busy.
+ *
+ * Instead the audio thread keeps the state itself, which costs the same however many notes
+ * arrive, and publishes it as a couple of bitmaps at the end of each block. The editor
+ * samples them once a frame, so a note shorter than a frame may never show, which is fine
+ * for a display.
+ *
+ * - held: a bit per key with at least one note on, from any port or channel, that hasn't had
+ *   its note off yet. The audio thread counts them per key in heldCount.
+ * - sounding: a bit per key with a voice playing, including voices in their release
+ * - velocity: the velocity of the latest note on per key, 0 to 127
+ *
+ * Everything the editor reads is a relaxed atomic. Each word is consistent on its own, and a
+ * word a frame out of date with its neighbour only shows for that frame.
+ */
+
+#include <atomic>
+#include <cstdint>
+
+namespace sst::clap_saw_demo
+{
+struct KeyState
+{
+    static constexpr int nKeys = 128, nWords = nKeys / 64;
+
+    // The editor's side
+    std::atomic<uint64_t> held[nWords]{}, sounding[nWords]{};
+    std::atomic<uint8_t> velocity[nKeys]{};
+
+    static bool bit(const std::atomic<uint64_t> *words, int key)
+    {
+        return (words[key >> 6].load(std::memory_order_relaxed) >> (key & 63)) & 1;
+    }
+    bool isHeld(int key) const { return bit(held, key); }
+    bool isSounding(int key) const { return bit(sounding, key); }
+
+    // The audio thread's side. Out of range keys (MIDI allows none, CLAP allows -1) are ignored.
+    void noteOn(int key, double vel)
+    {
+        if (key < 0 || key >= nKeys)
+            return;
+        if (heldCount[key] < UINT8_MAX)
+            heldCount[key]++;
+        heldBits[key >> 6] |= 1ULL << (key & 63);
+        auto v = vel <= 0 ? 0 : (vel >= 1 ? 127 : (int)(vel * 127 + 0.5));
+        velocity[key].store((uint8_t)v, std::memory_order_relaxed);
+    }
+    void noteOff(int key)
+    {
+        if (key < 0 || key >= nKeys || heldCount[key] == 0)
+            return;
+        if (--heldCount[key] == 0)
+            heldBits[key >> 6] &= ~(1ULL << (key & 63));
+    }
+    // Once per block, with sounding built by the caller from its voices
+    void publish(const uint64_t (&soundingBits)[nWords])
+    {
+        for (int w = 0; w < nWords; ++w)
+        {
+            held[w].store(heldBits[w], std::memory_order_relaxed);
+            sounding[w].store(soundingBits[w], std::memory_order_relaxed);
+        }
+    }
+    // Forget every held key, for when the host resets us or we reactivate
+    void clear()
+    {
+        for (auto &c : heldCount)
+            c = 0;
+        for (int w = 0; w < nWords; ++w)
+        {
+            heldBits[w] = 0;
+            held[w].store(0, std::memory_order_relaxed);
+            sounding[w].store(0, std::memory_order_relaxed);
+        }
+    }
+
+  private:
+    uint8_t heldCount[nKeys]{};
+    uint64_t heldBits[nWords]{};
+};
+} // namespace sst::clap_saw_demo
+
+#endif // CLAP_SAW_DEMO_KEY_STATE_H
@@ -0,0 +1,81 @@
+/*
+ * ClapSawDemo
+ * https://github.com/surge-synthesizer/clap-saw-demo
+ *
+ * Copyright 2022 Paul Walker and others as listed in the git history
+ *
+ * Released under the MIT License. See LICENSE.md for full text.
+ */
+
+#ifndef CLAP_SAW_DEMO_MODULATORS_H
+#define CLAP_SAW_DEMO_MODULATORS_H
+
+/*
+ * The voice LFO. Nothing about an LFO needs audio rate, so each voice moves its LFO on once a
+ * control block (see SawDemoVoice::controlBlockSize) to where it will be at the end of the
+ * block, and the pitch, cutoff and VCA glide there over the block the same way polyphonic
+ * modulation does.
+ *
+ * The voices of a filter batch share their control block boundaries, so they all want their
+ * LFOs moved on at the same moment. LFOLanes holds that many LFOs side by side, phase in one
+ * array, increment in another and so on, and advance() does them together in a loop the
+ * compiler turns into vector code: every shape is worked out for every lane and the right
+ * one picked per lane, since there is no branching on the shape across a vector.
+ *
+ * The sine is a parabola with one correction term, which is within 0.001 of sin, and
+ * plenty for something which moves a cutoff.
+ */
+
+#include <cmath>
+
+namespace sst::clap_saw_demo
+{
+enum LFOShape
+{
+    lfoSine,
+    lfoTriangle,
+    lfoSaw,
+    lfoSquare,
+    nLFOShapes
+};
+
+// The LFO at phase (in [0, 1)) in [-1, 1]. Every shape but the saw starts at zero going up.
+inline float lfoShapeValue(float phase, float shape)
+{
+    // sin(2 pi phase) is -sin(pi u) for u = 2 phase - 1 in [-1, 1)
+    auto u = 2.f * phase - 1.f;
+    auto p = 4.f * u * (1.f - std::fabs(u));
+    auto sine = -(0.225f * (p * std::fabs(p) - p) + p);
+
+    auto q = phase + 0.25f;
+    q -= (q >= 1.f) ? 1.f : 0.f;
+    auto tri = 1.f - 4.f * std::fabs(q - 0.5f);
+
+    auto saw = u;
+    auto square = (phase < 0.5f) ? 1.f : -1.f;
+
+    return (shape < 0.5f) ? sine : (shape < 1.5f) ? tri : (shape < 2.5f) ? saw : square;
+}
+
+struct LFOLanes
+{
+    static constexpr int lanes = 4;
+
+    // inc is the phase to move on by, which must be below 1. shape is an LFOShape as a float
+    // so that every array is the same width.
+    alignas(16) float phase[lanes]{}, inc[lanes]{}, shape[lanes]{}, out[lanes]{};
+
+    void advance()
+    {
+        for (int i = 0; i < lanes; ++i)
+        {
+            auto p = phase[i] + inc[i];
+            p -= (p >= 1.f) ? 1.f : 0.f;
+            phase[i] = p;
+            out[i] = lfoShapeValue(p, shape[i]);
+        }
+    }
+};
+} // namespace sst::clap_saw_demo
+
+#endif // CLAP_SAW_DEMO_MODULATORS_H
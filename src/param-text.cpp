@@ -0,0 +1,325 @@
+/*
+ * ClapSawDemo
+ * https://github.com/surge-synthesizer/clap-saw-demo
+ *
+ * Copyright 2022 Paul Walker and others as listed in the git history
+ *
+ * Released under the MIT License. See LICENSE.md for full text.
+ */
+
+#include "param-text.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+namespace sst::clap_saw_demo::paramtext
+{
+namespace
+{
+// Powers of ten up to 1e22 are exact in a double, which keeps the common cases exact
+constexpr int maxExactPow10 = 22;
+double pow10(int e)
+{
+    static constexpr double exact[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+                                       1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+                                       1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    if (e >= 0 && e <= maxExactPow10)
+        return exact[e];
+    return std::pow(10.0, e);
+}
+
+// a * 10^e, dividing for negative e so an exact power can be used. Huge e go in two steps
+// so 10^e itself doesn't overflow for a value at the far end of the range.
+double scale10(double a, int e)
+{
+    if (e > 300)
+        return a * 1e300 * pow10(e - 300);
+    if (e < -300)
+        return a / 1e300 / pow10(-e - 300);
+    return e >= 0 ? a * pow10(e) : a / pow10(-e);
+}
+
+/*
+ * a * 10^k, for |k| up to maxExactPow10, rounded to an integer the way printf rounds: from
+ * the exact value, with ties to even. Rounding an already rounded a * 10^k instead lands on
+ * the wrong side of a tie whenever that first rounding crossed it, which is how 99999.95
+ * came out as 100000.
+ *
+ * With 10^|k| exact, the error of the product or quotient is exact too (an fma gives it),
+ * and only its sign matters: the rounded result sits a whole number of ulps from the .5
+ * point or right on it, and the error is under half an ulp. Results from 2^52 up have no
+ * fraction left to round, and are far past any m the caller keeps.
+ */
+long long roundScaled(double a, int k)
+{
+    auto p = pow10(k < 0 ? -k : k);
+    double s, err;
+    if (k >= 0)
+    {
+        s = a * p;
+        err = std::fma(a, p, -s);
+    }
+    else
+    {
+        s = a / p;
+        err = std::fma(-s, p, a); // the remainder, which has the sign of the error
+    }
+    if (!(s < 0x1p52))
+        return std::llround(s);
+
+    auto n = std::floor(s);
+    auto d = (s - n) - 0.5;
+    if (d == 0)
+        d = err;
+    if (d == 0)
+        return (long long)n + ((long long)n & 1);
+    return (long long)n + (d > 0 ? 1 : 0);
+}
+
+/*
+ * The same m and x as Writer::num, from printf's %e. Only for what roundScaled can't do
+ * exactly: magnitudes far outside anything a parameter shows, and more than 15 digits. We
+ * take nothing but the digits and the exponent, so the locale's decimal point can't leak in.
+ */
+long long printfDigits(double a, int digits, int &x)
+{
+    char e[40];
+    snprintf(e, sizeof(e), "%.*e", digits - 1, a);
+    long long m{0};
+    const char *c = e;
+    for (; *c && *c != 'e'; ++c)
+        if (*c >= '0' && *c <= '9')
+            m = m * 10 + (*c - '0');
+    x = *c ? (int)std::strtol(c + 1, nullptr, 10) : 0;
+    return m;
+}
+
+char lower(char c) { return (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c; }
+bool isAlpha(char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); }
+bool isDigit(char c) { return c >= '0' && c <= '9'; }
+} // namespace
+
+Writer::Writer(char *b, uint32_t s) : buf(b), size(s)
+{
+    if (size > 0)
+        buf[0] = '\0';
+}
+
+Writer &Writer::str(const char *s)
+{
+    if (size == 0)
+        return *this;
+    while (*s && len + 1 < size)
+        buf[len++] = *s++;
+    buf[len] = '\0';
+    return *this;
+}
+
+Writer &Writer::integer(long long v)
+{
+    char tmp[24];
+    int n{0};
+    auto u = v < 0 ? 0ULL - (unsigned long long)v : (unsigned long long)v;
+    do
+    {
+        tmp[n++] = (char)('0' + u % 10);
+        u /= 10;
+    } while (u);
+
+    char out[26];
+    int o{0};
+    if (v < 0)
+        out[o++] = '-';
+    while (n)
+        out[o++] = tmp[--n];
+    out[o] = '\0';
+    return str(out);
+}
+
+Writer &Writer::num(double v, int digits)
+{
+    if (std::isnan(v))
+        return str("nan");
+    if (std::isinf(v))
+        return str(v < 0 ? "-inf" : "inf");
+    if (v == 0)
+        return str("0");
+
+    digits = digits < 1 ? 1 : (digits > 17 ? 17 : digits);
+    auto a = std::fabs(v);
+
+    // m is the value rounded to 'digits' significant digits, as an integer, and x its
+    // decimal exponent. log10 can be off by one either side of a power of ten, and rounding
+    // can carry into a new digit, so settle both.
+    auto x = (int)std::floor(std::log10(a));
+    auto lo = (long long)pow10(digits - 1), hi = lo * 10;
+    long long m;
+    auto k = digits - 1 - x;
+    if (digits > 15 || k < 1 - maxExactPow10 || k > maxExactPow10 - 1)
+    {
+        m = printfDigits(a, digits, x);
+    }
+    else
+    {
+        m = roundScaled(a, k);
+        if (m >= hi)
+            m = roundScaled(a, digits - 1 - ++x);
+        else if (m < lo)
+            m = roundScaled(a, digits - 1 - --x);
+        if (m >= hi) // 9.999995 and friends rounding up
+        {
+            m /= 10;
+            x++;
+        }
+    }
+
+    char d[18];
+    for (int i = digits - 1; i >= 0; --i)
+    {
+        d[i] = (char)('0' + m % 10);
+        m /= 10;
+    }
+    // Trailing zeros never show
+    auto nd = digits;
+    while (nd > 1 && d[nd - 1] == '0')
+        nd--;
+
+    char out[40];
+    int o{0};
+    if (v < 0)
+        out[o++] = '-';
+
+    if (x < -4 || x >= digits)
+    {
+        out[o++] = d[0];
+        if (nd > 1)
+        {
+            out[o++] = '.';
+            for (int i = 1; i < nd; ++i)
+                out[o++] = d[i];
+        }
+        out[o++] = 'e';
+        out[o++] = x < 0 ? '-' : '+';
+        auto ax = x < 0 ? -x : x;
+        if (ax >= 100)
+            out[o++] = (char)('0' + ax / 100);
+        out[o++] = (char)('0' + (ax / 10) % 10);
+        out[o++] = (char)('0' + ax % 10);
+    }
+    else if (x >= 0)
+    {
+        for (int i = 0; i <= x; ++i)
+            out[o++] = d[i];
+        if (nd > x + 1)
+        {
+            out[o++] = '.';
+            for (int i = x + 1; i < nd; ++i)
+                out[o++] = d[i];
+        }
+    }
+    else
+    {
+        out[o++] = '0';
+        out[o++] = '.';
+        for (int i = 0; i < -x - 1; ++i)
+            out[o++] = '0';
+        for (int i = 0; i < nd; ++i)
+            out[o++] = d[i];
+    }
+    out[o] = '\0';
+    return str(out);
+}
+
+const char *skipSpace(const char *s)
+{
+    while (*s == ' ' || *s == '\t')
+        s++;
+    return s;
+}
+
+bool parseNumber(const char *s, double &v, const char **end)
+{
+    s = skipSpace(s);
+    bool neg{false};
+    if (*s == '+' || *s == '-')
+        neg = *s++ == '-';
+
+    // Up to 19 significant digits go in the integer mantissa; past that they only move the
+    // exponent, which is far more precision than a double has anyway
+    unsigned long long mant{0};
+    int sig{0}, exp10{0}, nDigits{0};
+    auto digit = [&](char c, bool fraction)
+    {
+        nDigits++;
+        if (sig < 19)
+        {
+            if (mant || c != '0')
+                sig++;
+            mant = mant * 10 + (unsigned)(c - '0');
+            if (fraction)
+                exp10--;
+        }
+        else if (!fraction)
+        {
+            exp10++;
+        }
+    };
+
+    while (isDigit(*s))
+        digit(*s++, false);
+    if (*s == '.' || *s == ',')
+    {
+        s++;
+        while (isDigit(*s))
+            digit(*s++, true);
+    }
+    if (nDigits == 0)
+        return false;
+
+    // Only take an exponent if it is complete, so "2e" reads as 2 followed by junk
+    if (*s == 'e' || *s == 'E')
+    {
+        auto p = s + 1;
+        bool eneg{false};
+        if (*p == '+' || *p == '-')
+            eneg = *p++ == '-';
+        if (isDigit(*p))
+        {
+            int e{0};
+            while (isDigit(*p))
+            {
+                if (e < 10000)
+                    e = e * 10 + (*p - '0');
+                p++;
+            }
+            exp10 += eneg ? -e : e;
+            s = p;
+        }
+    }
+
+    auto r = scale10((double)mant, exp10);
+    v = neg ? -r : r;
+    if (end)
+        *end = s;
+    return true;
+}
+
+bool matchWord(const char *s, const char *word, const char **end)
+{
+    s = skipSpace(s);
+    while (*word)
+    {
+        if (lower(*s) != lower(*word))
+            return false;
+        s++;
+        word++;
+    }
+    if (isAlpha(*s))
+        return false;
+    if (end)
+        *end = s;
+    return true;
+}
+
+bool atEnd(const char *s) { return *skipSpace(s) == '\0'; }
+} // namespace sst::clap_saw_demo::paramtext
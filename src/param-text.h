@@ -0,0 +1,72 @@
+/*
+ * ClapSawDemo
+ * https://github.com/surge-synthesizer/clap-saw-demo
+ *
+ * Copyright 2022 Paul Walker and others as listed in the git history
+ *
+ * Released under the MIT License. See LICENSE.md for full text.
+ */
+
+#ifndef CLAP_SAW_DEMO_PARAM_TEXT_H
+#define CLAP_SAW_DEMO_PARAM_TEXT_H
+
+/*
+ * The text side of the parameters: paramsValueToText writes values into the host's buffer
+ * and paramsTextToValue reads back what a user typed. Hosts call the first one a lot (every
+ * automation lane and tooltip they draw, for every instance), so nothing here allocates,
+ * and nothing here looks at the C locale either. A German locale shouldn't turn 0.5 into
+ * "0,5" on display, or make us read "0.5" as 0.
+ *
+ * Numbers are written like an iostream at setprecision(6) (that is, printf's %g, down to
+ * how it rounds ties), which is what the plugin always showed. Magnitudes no parameter gets
+ * near (below 1e-16, or from 1e27) take their digits from snprintf's %e, and just the
+ * digits. When reading, either '.' or ',' is taken as the decimal point since we never
+ * write a thousands separator.
+ *
+ * We can't use std::to_chars / from_chars for floating point: the macOS deployment target
+ * predates them in libc++, so these are small hand rolled versions of the same idea.
+ */
+
+#include <cstdint>
+
+namespace sst::clap_saw_demo::paramtext
+{
+/*
+ * Appends to a caller's buffer of size bytes, always leaving it NUL terminated. Anything
+ * which doesn't fit is cut off, and len stops at size - 1.
+ */
+struct Writer
+{
+    Writer(char *buf, uint32_t size);
+
+    Writer &str(const char *s);
+    // to digits significant digits, trailing zeros dropped, in exponent form below 1e-4 and
+    // from 10^digits up
+    Writer &num(double v, int digits = 6);
+    Writer &integer(long long v);
+
+    char *buf;
+    uint32_t size;
+    uint32_t len{0};
+};
+
+// Skip spaces and tabs
+const char *skipSpace(const char *s);
+
+/*
+ * Read a decimal number, with optional sign, point and exponent, from the start of s after
+ * any spaces. On success v is set and *end (if given) points just past the number.
+ */
+bool parseNumber(const char *s, double &v, const char **end = nullptr);
+
+/*
+ * Does s, after any spaces, start with word (ignoring ASCII case) followed by something
+ * other than a letter? If so *end (if given) points just past it.
+ */
+bool matchWord(const char *s, const char *word, const char **end = nullptr);
+
+// Is s nothing but spaces from here
+bool atEnd(const char *s);
+} // namespace sst::clap_saw_demo::paramtext
+
+#endif // CLAP_SAW_DEMO_PARAM_TEXT_H
@@ -0,0 +1,118 @@
+/*
+ * ClapSawDemo
+ * https://github.com/surge-synthesizer/clap-saw-demo
+ *
+ * Copyright 2022 Paul Walker and others as listed in the git history
+ *
+ * Released under the MIT License. See LICENSE.md for full text.
+ */
+
+#include "perf-trace.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace sst::clap_saw_demo::perftrace
+{
+namespace
+{
+struct Registry
+{
+    std::mutex lock;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+};
+
+Registry &registry()
+{
+    static Registry r;
+    return r;
+}
+} // namespace
+
+ThreadBuffer &threadBuffer()
+{
+    // The first span on a thread allocates and registers its buffer. That's a one-off
+    // lock and allocation per thread, and only in trace builds.
+    thread_local ThreadBuffer *tb{nullptr};
+    if (!tb)
+    {
+        auto &r = registry();
+        std::lock_guard<std::mutex> g(r.lock);
+        r.buffers.push_back(std::make_unique<ThreadBuffer>());
+        tb = r.buffers.back().get();
+        tb->threadIndex = (uint32_t)r.buffers.size();
+    }
+    return *tb;
+}
+
+int64_t nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+const char *defaultTracePath()
+{
+    auto e = getenv("CLAP_SAW_DEMO_TRACE_FILE");
+    if (e && *e)
+        return e;
+    return "clap-saw-demo-trace.json";
+}
+
+bool dumpChromeTrace(const char *path)
+{
+    auto f = fopen(path, "w");
+    if (!f)
+        return false;
+
+    auto &r = registry();
+    std::lock_guard<std::mutex> g(r.lock);
+
+    // Chrome wants microseconds; rebase on the earliest span so the numbers stay readable
+    int64_t origin{INT64_MAX};
+    for (const auto &b : r.buffers)
+    {
+        auto w = b->writeCount.load(std::memory_order_acquire);
+        auto n = std::min<uint64_t>(w, ThreadBuffer::capacity);
+        for (auto i = w - n; i < w; ++i)
+            origin = std::min(origin, b->spans[i & (ThreadBuffer::capacity - 1)].beginNs);
+    }
+    if (origin == INT64_MAX)
+        origin = 0;
+
+    fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    bool first{true};
+    for (const auto &b : r.buffers)
+    {
+        fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+                   "\"args\":{\"name\":\"clap-saw-demo thread %u\"}}",
+                first ? "" : ",\n", b->threadIndex, b->threadIndex);
+        first = false;
+
+        auto w = b->writeCount.load(std::memory_order_acquire);
+        auto n = std::min<uint64_t>(w, ThreadBuffer::capacity);
+        for (auto i = w - n; i < w; ++i)
+        {
+            const auto &s = b->spans[i & (ThreadBuffer::capacity - 1)];
+            if (!s.name)
+                continue;
+            fprintf(f,
+                    ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,"
+                    "\"dur\":%.3f",
+                    s.name, b->threadIndex, (s.beginNs - origin) * 0.001,
+                    (s.endNs - s.beginNs) * 0.001);
+            if (s.arg >= 0)
+                fprintf(f, ",\"args\":{\"index\":%d}", s.arg);
+            fprintf(f, "}");
+        }
+    }
+    fprintf(f, "\n]}\n");
+    fclose(f);
+    return true;
+}
+} // namespace sst::clap_saw_demo::perftrace
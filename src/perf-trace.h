@@ -0,0 +1,111 @@
+/*
+ * ClapSawDemo
+ * https://github.com/surge-synthesizer/clap-saw-demo
+ *
+ * Copyright 2022 Paul Walker and others as listed in the git history
+ *
+ * Released under the MIT License. See LICENSE.md for full text.
+ */
+
+#ifndef CLAP_SAW_DEMO_PERF_TRACE_H
+#define CLAP_SAW_DEMO_PERF_TRACE_H
+
+/*
+ * perftrace records timed spans of the engine so you can see where a block actually
+ * goes without attaching a sampling profiler to your DAW. It is compiled in only when
+ * you configure with -DCLAP_SAW_DEMO_TRACE=ON; otherwise the macros below are empty.
+ *
+ * Each thread which records a span gets its own ring buffer of spans (allocated the first
+ * time that thread traces, and kept until the process exits) so recording is a couple of
+ * clock reads and a store with no locking. When a ring wraps the oldest spans are lost.
+ *
+ * The result is written as Chrome trace event JSON, which you can open in chrome://tracing
+ * or https://ui.perfetto.dev. A dump happens when the editor asks for one and when a
+ * plugin is destroyed, to the path in the CLAP_SAW_DEMO_TRACE_FILE environment variable
+ * (or clap-saw-demo-trace.json in the working directory if that is unset).
+ *
+ * Usage is just
+ *
+ *     _TRACE_SCOPE("handleInboundEvent");
+ *     _TRACE_SCOPE_ARG("voice", voiceIndex);
+ *
+ * and the span lasts until the end of the enclosing scope. Names must be literals.
+ */
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace sst::clap_saw_demo::perftrace
+{
+struct Span
+{
+    const char *name{nullptr};
+    int64_t beginNs{0}, endNs{0};
+    int32_t arg{-1};
+};
+
+struct ThreadBuffer
+{
+    static constexpr size_t capacity = 1 << 15; // must be a power of two
+
+    uint32_t threadIndex{0};
+    std::atomic<uint64_t> writeCount{0};
+    std::array<Span, capacity> spans;
+
+    inline void record(const Span &s)
+    {
+        auto w = writeCount.load(std::memory_order_relaxed);
+        spans[w & (capacity - 1)] = s;
+        writeCount.store(w + 1, std::memory_order_release);
+    }
+};
+
+ThreadBuffer &threadBuffer();
+int64_t nowNs();
+
+/*
+ * Write every thread's spans as Chrome trace JSON. Spans recorded while the dump
+ * runs may or may not make it into the file. Returns false if the file can't be opened.
+ */
+bool dumpChromeTrace(const char *path);
+
+// The CLAP_SAW_DEMO_TRACE_FILE path (or the default) as described above
+const char *defaultTracePath();
+
+struct ScopedSpan
+{
+    explicit ScopedSpan(const char *name, int32_t arg = -1) : buffer(threadBuffer())
+    {
+        span.name = name;
+        span.arg = arg;
+        span.beginNs = nowNs();
+    }
+    ~ScopedSpan()
+    {
+        span.endNs = nowNs();
+        buffer.record(span);
+    }
+    ThreadBuffer &buffer;
+    Span span;
+};
+} // namespace sst::clap_saw_demo::perftrace
+
+#define _TRACE_CAT_INDIR(a, b) a##b
+#define _TRACE_CAT(a, b) _TRACE_CAT_INDIR(a, b)
+
+#if CLAP_SAW_DEMO_TRACE
+#define _TRACE_SCOPE(name)                                                                         \
+    ::sst::clap_saw_demo::perftrace::ScopedSpan _TRACE_CAT(traceSpan, __LINE__) { name }
+#define _TRACE_SCOPE_ARG(name, arg)                                                                \
+    ::sst::clap_saw_demo::perftrace::ScopedSpan _TRACE_CAT(traceSpan, __LINE__)                    \
+    {                                                                                              \
+        name, static_cast<int32_t>(arg)                                                            \
+    }
+#else
+#define _TRACE_SCOPE(name)
+#define _TRACE_SCOPE_ARG(name, arg)
+#endif
+
+#endif // CLAP_SAW_DEMO_PERF_TRACE_H
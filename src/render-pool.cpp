@@ -0,0 +1,88 @@
+/*
+ * ClapSawDemo
+ * https://github.com/surge-synthesizer/clap-saw-demo
+ *
+ * Copyright 2022 Paul Walker and others as listed in the git history
+ *
+ * Released under the MIT License. See LICENSE.md for full text.
+ */
+
+#include "render-pool.h"
+#include "denormals.h"
+#include <algorithm>
+
+namespace sst::clap_saw_demo
+{
+RenderPool::RenderPool(int nWorkers)
+{
+    for (int i = 0; i < nWorkers; ++i)
+        workers.emplace_back([this]() { workerLoop(); });
+}
+
+RenderPool::~RenderPool()
+{
+    {
+        std::lock_guard<std::mutex> g(lock);
+        quit = true;
+    }
+    wake.notify_all();
+    for (auto &w : workers)
+        w.join();
+}
+
+int RenderPool::defaultWorkers()
+{
+    return std::max((int)std::thread::hardware_concurrency() - 1, 0);
+}
+
+void RenderPool::runJobs(int nJobs, JobFn fn, void *ctx)
+{
+    {
+        std::lock_guard<std::mutex> g(lock);
+        jobFn = fn;
+        jobCtx = ctx;
+        jobCount = nJobs;
+        nextJob.store(0, std::memory_order_relaxed);
+        busy = (int)workers.size();
+        generation++;
+    }
+    wake.notify_all();
+
+    // The caller is already running flushed (it's inside process), so just join in
+    drain();
+
+    std::unique_lock<std::mutex> g(lock);
+    finished.wait(g, [this]() { return busy == 0; });
+}
+
+void RenderPool::drain()
+{
+    int j;
+    while ((j = nextJob.fetch_add(1, std::memory_order_relaxed)) < jobCount)
+        jobFn(jobCtx, j);
+}
+
+void RenderPool::workerLoop()
+{
+    uint64_t seen{0};
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> g(lock);
+            wake.wait(g, [&]() { return quit || generation != seen; });
+            if (quit)
+                return;
+            seen = generation;
+        }
+
+        {
+            ScopedDenormalsDisabled noDenormals;
+            drain();
+        }
+
+        std::lock_guard<std::mutex> g(lock);
+        if (--busy == 0)
+            finished.notify_one();
+    }
+}
+} // namespace sst::clap_saw_demo
@@ -0,0 +1,79 @@
+/*
+ * ClapSawDemo
+ * https://github.com/surge-synthesizer/clap-saw-demo
+ *
+ * Copyright 2022 Paul Walker and others as listed in the git history
+ *
+ * Released under the MIT License. See LICENSE.md for full text.
+ */
+
+#ifndef CLAP_SAW_DEMO_RENDER_POOL_H
+#define CLAP_SAW_DEMO_RENDER_POOL_H
+
+/*
+ * A tiny worker pool for offline rendering (see ClapSawDemo::renderSetMode). run(n, f) calls
+ * f(0) ... f(n - 1) spread across the workers and the calling thread, and returns once they
+ * have all finished. Jobs are handed out from an atomic counter, so a slow job doesn't hold up
+ * the others, and which thread runs which job is unspecified; the jobs must not share
+ * anything they write.
+ *
+ * The pool waits on a mutex and condition variable, which is fine for a bounce but is exactly
+ * what the real time path must never do, so the engine only uses it when the host tells us
+ * we are rendering offline.
+ *
+ * Workers run each job with denormals flushed (see denormals.h) the same as the audio
+ * thread does in process, so a job computes the same bits whichever thread runs it.
+ */
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace sst::clap_saw_demo
+{
+struct RenderPool
+{
+    // nWorkers threads in addition to the caller of run; 0 runs everything on the caller
+    explicit RenderPool(int nWorkers);
+    ~RenderPool();
+
+    RenderPool(const RenderPool &) = delete;
+    RenderPool &operator=(const RenderPool &) = delete;
+
+    // The caller plus the workers
+    int threads() const { return (int)workers.size() + 1; }
+
+    template <typename F> void run(int nJobs, F &f)
+    {
+        runJobs(
+            nJobs, [](void *ctx, int job) { (*static_cast<F *>(ctx))(job); }, &f);
+    }
+
+    // A reasonable worker count for this machine: one less than the hardware threads
+    static int defaultWorkers();
+
+  private:
+    using JobFn = void (*)(void *, int);
+    void runJobs(int nJobs, JobFn fn, void *ctx);
+    void drain();
+    void workerLoop();
+
+    std::vector<std::thread> workers;
+
+    std::mutex lock;
+    std::condition_variable wake, finished;
+    uint64_t generation{0};
+    int busy{0};
+    bool quit{false};
+
+    JobFn jobFn{nullptr};
+    void *jobCtx{nullptr};
+    int jobCount{0};
+    std::atomic<int> nextJob{0};
+};
+} // namespace sst::clap_saw_demo
+
+#endif // CLAP_SAW_DEMO_RENDER_POOL_H
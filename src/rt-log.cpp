@@ -0,0 +1,188 @@
+/*
+ * ClapSawDemo
+ * https://github.com/surge-synthesizer/clap-saw-demo
+ *
+ * Copyright 2022 Paul Walker and others as listed in the git history
+ *
+ * Released under the MIT License. See LICENSE.md for full text.
+ */
+
+#include "rt-log.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+namespace sst::clap_saw_demo::rtlog
+{
+Ring::Ring() : startNs(nowNs())
+{
+    for (size_t i = 0; i < capacity; ++i)
+        cells[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+bool Ring::push(const Record &r)
+{
+    auto pos = enqueuePos.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        auto &cell = cells[pos & (capacity - 1)];
+        auto seq = cell.sequence.load(std::memory_order_acquire);
+        auto diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0)
+        {
+            if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                cell.record = r;
+                cell.sequence.store(pos + 1, std::memory_order_release);
+                return true;
+            }
+        }
+        else if (diff < 0)
+        {
+            // Full. Don't wait, just count it so the drain can report the loss
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        else
+        {
+            pos = enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+bool Ring::pop(Record &r)
+{
+    auto pos = dequeuePos.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        auto &cell = cells[pos & (capacity - 1)];
+        auto seq = cell.sequence.load(std::memory_order_acquire);
+        auto diff = (intptr_t)seq - (intptr_t)(pos + 1);
+        if (diff == 0)
+        {
+            if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                r = cell.record;
+                cell.sequence.store(pos + capacity, std::memory_order_release);
+                return true;
+            }
+        }
+        else if (diff < 0)
+        {
+            return false;
+        }
+        else
+        {
+            pos = dequeuePos.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+bool Ring::empty() const
+{
+    return enqueuePos.load(std::memory_order_acquire) ==
+           dequeuePos.load(std::memory_order_acquire);
+}
+
+Ring &ring()
+{
+    // One ring for the whole process, shared by every instance
+    static Ring theRing;
+    return theRing;
+}
+
+int64_t nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+static const char *levelName(Level l)
+{
+    switch (l)
+    {
+    case Level::Trace:
+        return "TRACE";
+    case Level::Debug:
+        return "DEBUG";
+    case Level::Info:
+        return "INFO";
+    case Level::Warn:
+        return "WARN";
+    case Level::Error:
+        return "ERROR";
+    }
+    return "?";
+}
+
+static void formatArg(std::ostream &os, const Arg &a)
+{
+    switch (a.type)
+    {
+    case Arg::NONE:
+        break;
+    case Arg::INT:
+        os << a.i;
+        break;
+    case Arg::UINT:
+        os << a.u;
+        break;
+    case Arg::DOUBLE:
+        os << a.d;
+        break;
+    case Arg::BOOL:
+        os << (a.b ? "true" : "false");
+        break;
+    case Arg::STRING:
+        os << (a.s ? a.s : "(null)");
+        break;
+    }
+}
+
+size_t drain(std::ostream &os)
+{
+    auto &r = ring();
+    auto lost = r.dropped.exchange(0, std::memory_order_relaxed);
+    if (lost)
+        os << "[clap-saw-demo-imgui] rtlog : " << lost << " records dropped (ring full)"
+           << std::endl;
+
+    size_t count{0};
+    Record rec;
+    while (r.pop(rec))
+    {
+        char when[32];
+        snprintf(when, sizeof(when), "%.6f", (rec.timestampNs - r.startNs) * 1e-9);
+        os << "[clap-saw-demo-imgui] " << when << " " << rec.file << ":" << rec.line << " ("
+           << rec.func << ") " << levelName(rec.level);
+
+        if (rec.fmt && *rec.fmt)
+        {
+            os << " : ";
+            int argi{0};
+            for (auto c = rec.fmt; *c; ++c)
+            {
+                if (c[0] == '{' && c[1] == '}')
+                {
+                    if (argi < rec.nArgs)
+                        formatArg(os, rec.args[argi++]);
+                    ++c;
+                }
+                else
+                {
+                    os << *c;
+                }
+            }
+        }
+        os << "\n";
+        count++;
+    }
+    if (count)
+        os.flush();
+    return count;
+}
+
+size_t drainToStdout() { return drain(std::cout); }
+} // namespace sst::clap_saw_demo::rtlog
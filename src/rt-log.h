@@ -0,0 +1,207 @@
+/*
+ * ClapSawDemo
+ * https://github.com/surge-synthesizer/clap-saw-demo
+ *
+ * Copyright 2022 Paul Walker and others as listed in the git history
+ *
+ * Released under the MIT License. See LICENSE.md for full text.
+ */
+
+#ifndef CLAP_SAW_DEMO_RT_LOG_H
+#define CLAP_SAW_DEMO_RT_LOG_H
+
+/*
+ * rtlog is a tiny deferred logger which is safe to call from the audio thread.
+ *
+ * Writing to std::cout from ::process takes a lock inside the C++ runtime and can block
+ * on console I/O for a very long time (in audio terms), so a debug build which logs from
+ * the audio thread is useless for judging performance. Instead a log call here packs its
+ * arguments into a fixed size binary Record and pushes it into a bounded lock-free ring.
+ * Nothing is formatted and nothing is allocated at the call site. Some time later a main
+ * thread call to `drain` pops the records and formats them to a stream.
+ *
+ * The rules are simple
+ *
+ * - The format string uses `{}` as a placeholder for each argument, in order
+ * - Arguments can be integers, bools, floating point values or `const char *`. Strings
+ *   are stored as a pointer, so they must be literals or otherwise outlive the drain; never
+ *   pass the c_str() of a std::string.
+ * - The format string, file and function must be literals (which they are if you use the
+ *   macros in debug-helpers.h)
+ * - If the ring is full the record is dropped and counted, never blocked on
+ *
+ * Levels are filtered at compile time by CLAP_SAW_DEMO_LOG_LEVEL, so a call below the
+ * threshold compiles to nothing at all.
+ */
+
+#include <atomic>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <type_traits>
+
+// 0 = Trace, 1 = Debug, 2 = Info, 3 = Warn, 4 = Error, 5 = Off
+#if !defined(CLAP_SAW_DEMO_LOG_LEVEL)
+#if defined(NDEBUG)
+#define CLAP_SAW_DEMO_LOG_LEVEL 3
+#else
+#define CLAP_SAW_DEMO_LOG_LEVEL 1
+#endif
+#endif
+
+namespace sst::clap_saw_demo::rtlog
+{
+enum class Level : uint8_t
+{
+    Trace = 0,
+    Debug,
+    Info,
+    Warn,
+    Error
+};
+
+struct Arg
+{
+    enum Type : uint8_t
+    {
+        NONE,
+        INT,
+        UINT,
+        DOUBLE,
+        BOOL,
+        STRING
+    } type{NONE};
+
+    union
+    {
+        int64_t i;
+        uint64_t u;
+        double d;
+        bool b;
+        const char *s;
+    };
+};
+
+struct Record
+{
+    static constexpr int maxArgs = 6;
+
+    int64_t timestampNs{0};
+    const char *file{nullptr};
+    const char *func{nullptr};
+    const char *fmt{nullptr};
+    uint32_t line{0};
+    Level level{Level::Debug};
+    uint8_t nArgs{0};
+    Arg args[maxArgs];
+};
+
+/*
+ * A bounded multi-producer multi-consumer ring in the style of Dmitry Vyukov's
+ * bounded queue. Each cell carries a sequence number which tells producers and
+ * consumers whether the cell is theirs to use, so no thread ever waits on another.
+ * We need multiple producers since every instance in the process (and both the
+ * audio and main threads) write into the one ring.
+ */
+struct Ring
+{
+    static constexpr size_t capacity = 512; // must be a power of two
+
+    Ring();
+
+    bool push(const Record &r);
+    bool pop(Record &r);
+    bool empty() const;
+
+    std::atomic<uint64_t> dropped{0};
+    // nowNs() when the ring was made, which drain counts record timestamps from
+    const int64_t startNs;
+
+  private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        Record record;
+    };
+    std::array<Cell, capacity> cells;
+    alignas(64) std::atomic<size_t> enqueuePos{0};
+    alignas(64) std::atomic<size_t> dequeuePos{0};
+};
+
+Ring &ring();
+int64_t nowNs();
+
+/*
+ * Format every pending record to the stream, each stamped with the seconds between the
+ * first use of the ring and the log call. Call this from the main thread (the ClapSawDemo
+ * does it in onMainThread, which process requests when records are pending, on editor
+ * frames and on destruction). Returns the number of records written.
+ */
+size_t drain(std::ostream &os);
+size_t drainToStdout();
+inline bool hasPending() { return !ring().empty() || ring().dropped.load() > 0; }
+
+template <typename T> inline Arg makeArg(const T &v)
+{
+    using U = std::decay_t<T>;
+    Arg a;
+    if constexpr (std::is_same_v<U, bool>)
+    {
+        a.type = Arg::BOOL;
+        a.b = v;
+    }
+    else if constexpr (std::is_enum_v<U>)
+    {
+        a.type = Arg::INT;
+        a.i = static_cast<int64_t>(v);
+    }
+    else if constexpr (std::is_integral_v<U> && std::is_signed_v<U>)
+    {
+        a.type = Arg::INT;
+        a.i = v;
+    }
+    else if constexpr (std::is_integral_v<U>)
+    {
+        a.type = Arg::UINT;
+        a.u = v;
+    }
+    else if constexpr (std::is_floating_point_v<U>)
+    {
+        a.type = Arg::DOUBLE;
+        a.d = v;
+    }
+    else
+    {
+        static_assert(std::is_convertible_v<U, const char *>,
+                      "rtlog arguments must be numbers, bools or string literals");
+        a.type = Arg::STRING;
+        a.s = v;
+    }
+    return a;
+}
+
+template <Level L, typename... Args>
+inline void emit(const char *file, uint32_t line, const char *func, const char *fmt,
+                 const Args &...args)
+{
+    if constexpr (static_cast<int>(L) >= CLAP_SAW_DEMO_LOG_LEVEL)
+    {
+        static_assert(sizeof...(Args) <= Record::maxArgs, "Too many rtlog arguments");
+        auto &rg = ring(); // first, so the ring's start is never after a record's stamp
+        Record r;
+        r.timestampNs = nowNs();
+        r.file = file;
+        r.func = func;
+        r.fmt = fmt;
+        r.line = line;
+        r.level = L;
+        r.nArgs = static_cast<uint8_t>(sizeof...(Args));
+        [[maybe_unused]] int idx{0};
+        ((r.args[idx++] = makeArg(args)), ...);
+        rg.push(r);
+    }
+}
+} // namespace sst::clap_saw_demo::rtlog
+
+#endif // CLAP_SAW_DEMO_RT_LOG_H
@@ -8,6 +8,8 @@
  */
 
 #include "saw-voice.h"
+#include "fast-math.h"
+#include "voice-kernels.h"
 #include <cmath>
 #include <algorithm>
 
@@ -19,233 +21,636 @@
 
 namespace sst::clap_saw_demo
 {
-float pival =
-    3.14159265358979323846; // I always forget what you need for M_PI to work on all platforms
-
 void SawDemoVoice::recalcPitch()
 {
-    baseFreq = 440.0 * pow(2.0, ((key + pitchNoteExpressionValue + pitchBendWheel +
-                                  (oscDetune + oscDetuneMod) / 100) -
-                                 69.0) /
-                                    12.0);
+    // Voices which have never started have no layout; start() will get here again
+    if (!layout)
+        return;
+
+    const auto &nft = noteFrequencyTable();
+    baseFreq = nft.noteToFrequency(keyPitch + pitchNoteExpressionValue + pitchBendWheel +
+                                   (oscDetune + oscDetuneMod) / 100 + modPitch);
 
-    for (int i = 0; i < unison; ++i)
+    // The padding lanes get a real increment (so nothing divides by zero) but zero gain
+    for (int i = 0; i < unisonPadded; ++i)
     {
-        dPhase[i] =
-            (baseFreq * pow(2.0, (uniSpread + uniSpreadMod) * unitShift[i] / 100.0 / 12.0)) /
-            sampleRate;
-        dPhaseInv[i] = 1.0 / dPhase[i];
+        dPhase[i] = baseFreq *
+                    nft.semitonesToRatio((uniSpread + uniSpreadMod) * layout->unitShift[i] / 100.0) *
+                    srInv;
+        // 0.2 is the output level and 0.25 undoes the phase rescaling in step()
+        auto dPhaseInv = 1.0 / dPhase[i];
+        auto scale = 0.2 * 0.25 * dPhaseInv * dPhaseInv;
+        gainL[i] = (float)(layout->panNormL[i] * scale);
+        gainR[i] = (float)(layout->panNormR[i] * scale);
     }
 }
 
 void SawDemoVoice::recalcFilter()
 {
-    auto co = cutoff + cutoffMod;
+    auto co = cutoffKey();
     auto rm = res + resMod;
 
-    auto newfm = (StereoSimperSVF::Mode)filterMode;
-
-    if (newfm != filter.mode)
-        filter.init();
-    filter.mode = newfm;
-    filter.setCoeff(co, rm, srInv);
+    filter.setMode(filterMode);
+    filter.setCoeff(co, rm, srInv, cutoffTable);
 }
 
 void SawDemoVoice::step()
 {
-    float AR = 1.0;
+    beginRender(1);
+    renderUnfiltered(&L, &R, 1);
+    filter.step(L, R);
+}
 
-    if (state == ATTACK)
+int SawDemoVoice::beginRender(int frames)
+{
+    if (controlCountdown == 0)
+        controlUpdate();
+    return std::min(frames, controlCountdown);
+}
+
+void SawDemoVoice::renderUnfiltered(float *outL, float *outR, int n)
+{
+    // The VCA glides linearly, so if it is shut at both ends of these samples it is shut
+    // throughout and there is nothing to hear. Just keep time.
+    auto vca = vcaGain(preFilterVCAMod) + lfoVCA;
+    if (vca <= 0.f && vca + (preFilterVCAModStep + lfoVCAStep) * (n - 1) <= 0.f)
     {
-        AR = time / ampAttack;
-        releaseFrom = AR;
-        time += srInv;
-        if (time >= ampAttack)
-        {
-            state = HOLD;
-        }
+        std::fill(outL, outL + n, 0.f);
+        std::fill(outR, outR + n, 0.f);
+        controlCountdown -= n;
+        preFilterVCAMod += preFilterVCAModStep * n;
+        lfoVCA += lfoVCAStep * n;
+        advancePhases(n);
+        earlyOutCounts[eoSilentVCA]++;
+        return;
+    }
+
+    // The envelope and VCA are per voice, so they are worked out here; the unison saws
+    // themselves are one of the voice kernels (see voice-kernels.h)
+    float amp[controlBlockSize];
+    for (int s = 0; s < n; ++s)
+    {
+        controlCountdown--;
+        amp[s] = envBlock[controlLength - controlCountdown - 1] *
+                 std::max(vcaGain(preFilterVCAMod) + lfoVCA, 0.f);
+        preFilterVCAMod += preFilterVCAModStep;
+        lfoVCA += lfoVCAStep;
+    }
+
+    voiceKernels().saw(phase.data(), dPhase.data(), gainL.data(), gainR.data(), unisonPadded,
+                       amp, outL, outR, n);
+}
+
+void SawDemoVoice::skip(uint32_t frames)
+{
+    if (frames == 0)
+        return;
+
+    // Nobody can hear a silent voice glide so land the modulation now
+    snapModulation();
+
+    // The same control blocks step() would run, without the audio
+    while (frames > 0 && isPlaying())
+    {
+        auto n = (uint32_t)beginRender((int)std::min(frames, (uint32_t)controlBlockSize));
+        controlCountdown -= n;
+        frames -= n;
+        advancePhases(n);
+    }
+
+    L = 0;
+    R = 0;
+}
+
+void SawDemoVoice::advancePhases(uint32_t n)
+{
+    for (int i = 0; i < unisonPadded; ++i)
+    {
+        auto p = phase[i] + dPhase[i] * n;
+        phase[i] = p - std::floor(p);
+    }
+}
+
+void SawDemoVoice::start(int key)
+{
+    filter.init();
+    this->key = key;
+    state = ATTACK;
+    env.gate = ampGate;
+    setEnvelopeTimes();
+    env.start();
+
+    // The caller has reset the modulation values, so there is nothing to glide
+    activeRamps = 0;
+    controlCountdown = 0;
+    nextControlLength =
+        (controlPhase > 0) ? std::min(controlPhase, (int)controlBlockSize) : controlBlockSize;
+    preFilterVCAModStep = 0.f;
+    preFilterVCAModEnd = preFilterVCAMod;
+    startModulators();
+
+    unison = std::clamp(unison, 1, max_uni);
+    unisonPadded = (unison + uni_lanes - 1) / uni_lanes * uni_lanes;
+    layout = &unisonLayoutTable().forCount(unison);
+    for (int i = 0; i < unisonPadded; ++i)
+        phase[i] = layout->startPhase[i];
+
+    recalcPitch();
+    recalcFilter();
+}
 
-        if (ampGate)
-            AR = 1.0;
+float &SawDemoVoice::modValue(ModTarget target)
+{
+    switch (target)
+    {
+    case mtCutoff:
+        return cutoffMod;
+    case mtResonance:
+        return resMod;
+    case mtUniSpread:
+        return uniSpreadMod;
+    case mtOscDetune:
+        return oscDetuneMod;
+    case mtAmpAttack:
+        return ampAttackMod;
+    case mtAmpRelease:
+        return ampReleaseMod;
+    case mtPreFilterVCA:
+    case nModTargets:
+        break;
     }
-    else if (state == RELEASING)
+    return preFilterVCAMod;
+}
+
+void SawDemoVoice::setModTarget(ModTarget target, float value, uint32_t samples)
+{
+    auto &r = modRamps[target];
+
+    if (samples == 0)
     {
-        auto tn = time / ampRelease;
-        auto tf = (1.0 - tn);
-        AR = releaseFrom * tf;
-        time += srInv;
-        if (time >= ampRelease)
+        activeRamps &= ~(1U << target);
+        if (target == mtPreFilterVCA)
         {
-            state = NEWLY_OFF;
+            preFilterVCAModStep = 0.f;
+            preFilterVCAModEnd = value;
         }
+        modValue(target) = value;
 
-        if (ampGate)
+        if (target == mtCutoff || target == mtResonance)
         {
-            AR = 1.0;
-            const auto lastSeg = 0.02;
-            if (tn > (1.0 - lastSeg))
-            {
-                // Avoid a click with a last 2% fade
-                AR = 1 - (tn - (1.0 - lastSeg)) / lastSeg;
-            }
+            recalcFilter();
+        }
+        else if (target == mtUniSpread || target == mtOscDetune)
+        {
+            recalcPitch();
         }
+        else if (target == mtAmpAttack || target == mtAmpRelease)
+        {
+            recalcEnvelope();
+        }
+        return;
     }
-    else if (state == HOLD)
+
+    /*
+     * The ramp only starts moving at my next control block boundary, controlCountdown
+     * samples from now, and arrives at a boundary, so it gets that much less time and is
+     * rounded down to land on the last boundary before the time asked for. If that is
+     * inside the first block, the end of the first block is as soon as it can be.
+     */
+    auto lengthAfter = [this](int s)
     {
-        AR = 1.0;
-        time = 0;
-        releaseFrom = 1.0;
+        if (s <= nextControlLength)
+            return std::max(s, 1);
+        return nextControlLength +
+               (s - nextControlLength) / controlBlockSize * controlBlockSize;
+    };
+    auto length = lengthAfter((int)samples - controlCountdown);
+
+    // The VCA value is mid glide inside a control block, so ramp from where that glide lands
+    auto from = (target == mtPreFilterVCA) ? preFilterVCAModEnd : modValue(target);
+    r.target = value;
+    r.remaining = length;
+    r.delta = (value - from) / length;
+    activeRamps |= 1U << target;
+}
 
-        if (ampGate)
-            AR = 1.0;
+void SawDemoVoice::snapModulation()
+{
+    if (filter.interpolating)
+        filter.finishInterpolation();
+    filter.flushDenormals();
+    preFilterVCAMod = preFilterVCAModEnd;
+    preFilterVCAModStep = 0.f;
+    lfoVCA = lfoVCAEnd;
+    lfoVCAStep = 0.f;
+
+    for (int t = 0; t < nModTargets; ++t)
+    {
+        if (activeRamps & (1U << t))
+            setModTarget((ModTarget)t, modRamps[t].target, 0);
     }
+}
 
-    AR *= (preFilterVCA + preFilterVCAMod + volumeNoteExpressionValue);
-    L = 0;
-    R = 0;
+/*
+ * Runs at the start of each control block. The glides from the last block land exactly
+ * where they were aiming, then each ramp in flight and the LFO and filter envelope move on
+ * by a control block, and the pitch and filter get recomputed (once, however many of them
+ * moved) for where they will be.
+ */
+void SawDemoVoice::controlUpdate()
+{
+    if (!lfoReady)
+    {
+        auto self = this;
+        advanceLFOs(&self, 1);
+    }
+    lfoReady = false;
 
-    for (int i = 0; i < unison; ++i)
-    {
-        /*
-         * Use a cubic integrated saw and second derive it at
-         * each point. This is basically the math I worked
-         * out for the surge modern oscillator. The cubic function
-         * which gives a clean saw is phase^3 / 6 - phase / 6.
-         * Evaluate it at 3 points and then differentiate it like
-         * we do in Surge Modern. The waveform is the same both
-         * channels.
-         */
-        double phaseSteps[3];
-        for (int q = -2; q <= 0; ++q)
-        {
-            double ph = phase[i] + q * dPhase[i];
-            // Our calculation assumes phase in -1,1 and this phase is
-            // in 0 1 so
-            ph = ph * 2 - 1;
-            phaseSteps[q + 2] = (ph * ph - 1) * ph / 6.0;
-        }
-        // the 0.25 here is because of the phase rescaling again
-        double saw = (phaseSteps[0] + phaseSteps[2] - 2 * phaseSteps[1]) * 0.25 * dPhaseInv[i] *
-                     dPhaseInv[i];
+    controlLength = nextControlLength;
+    nextControlLength = controlBlockSize;
+    controlCountdown = controlLength;
+    // The LFO only ever takes the VCA down, so the release cut below can leave it out
+    lfoVCA = lfoVCAEnd;
+    lfoVCAStep = 0.f;
+
+    // Deep in the release and below -120dB nobody will hear the rest, so stop now. Not while
+    // the VCA is gliding though, since it could be on its way back up.
+    if (state == RELEASING && env.stage != ADSREnvelope::OFF &&
+        !(activeRamps & (1U << mtPreFilterVCA)) &&
+        env.level * std::max(vcaGain(preFilterVCAModEnd), 0.f) < inaudibleLevel)
+    {
+        env.stop();
+        earlyOutCounts[eoReleaseCut]++;
+    }
+
+    // The envelope finished during the last block, so I'm done
+    if (env.stage == ADSREnvelope::OFF && isPlaying())
+        state = NEWLY_OFF;
+    if (state == ATTACK && env.stage != ADSREnvelope::ATTACK)
+        state = HOLD;
+
+    envAtBlockStart = env;
+    envSnapshotOffset = 0;
+    env.process(envBlock, controlLength);
+
+    if (filter.interpolating)
+        filter.finishInterpolation();
+    if (flushFilterDenormals)
+        filter.flushDenormals();
+    preFilterVCAMod = preFilterVCAModEnd;
+    preFilterVCAModStep = 0.f;
+
+    bool pitchDirty{false}, filterDirty{false};
+    if (activeRamps)
+        advanceRamps(pitchDirty, filterDirty);
+    if (isPlaying())
+        advanceModulators(pitchDirty, filterDirty);
+
+    if (pitchDirty)
+        recalcPitch();
+    if (filterDirty)
+        filter.setCoeffTarget(cutoffKey(), res + resMod, srInv, cutoffTable, controlLength);
+}
+
+void SawDemoVoice::advanceRamps(bool &pitchDirty, bool &filterDirty)
+{
+    bool envDirty{false};
+    for (int t = 0; t < nModTargets; ++t)
+    {
+        if (!(activeRamps & (1U << t)))
+            continue;
 
-        L += 0.2 * norm[i] * AR * panL[i] * saw;
-        R += 0.2 * norm[i] * AR * panR[i] * saw;
+        auto &r = modRamps[t];
+        auto n = std::min(r.remaining, controlLength);
+        r.remaining -= n;
 
-        phase[i] += dPhase[i];
-        if (phase[i] > 1)
-            phase[i] -= 1;
+        auto next = r.target;
+        if (r.remaining > 0)
+            next = (t == mtPreFilterVCA ? preFilterVCAModEnd : modValue((ModTarget)t)) +
+                   r.delta * n;
+        else
+            activeRamps &= ~(1U << t);
+
+        switch (t)
+        {
+        case mtCutoff:
+        case mtResonance:
+            modValue((ModTarget)t) = next;
+            filterDirty = true;
+            break;
+        case mtUniSpread:
+        case mtOscDetune:
+            modValue((ModTarget)t) = next;
+            pitchDirty = true;
+            break;
+        case mtPreFilterVCA:
+            preFilterVCAModStep = (next - preFilterVCAMod) / controlLength;
+            preFilterVCAModEnd = next;
+            break;
+        case mtAmpAttack:
+        case mtAmpRelease:
+            modValue((ModTarget)t) = next;
+            envDirty = true;
+            break;
+        }
     }
 
-    filter.step(L, R);
+    // We're at the top of the block, so retime and render it again
+    if (envDirty)
+    {
+        env = envAtBlockStart;
+        setEnvelopeTimes();
+        env.retime();
+        envAtBlockStart = env;
+        env.process(envBlock, controlLength);
+    }
 }
 
-void SawDemoVoice::start(int key)
+void SawDemoVoice::startModulators()
 {
-    srInv = 1.0 / sampleRate;
+    lfoPhase = 0.f;
+    lfoValue = lfoShapeValue(0.f, (float)lfoShape);
+    lfoReady = false;
 
-    filter.init();
-    this->key = key;
-    state = (ampAttack > 0 ? ATTACK : HOLD);
-    time = 0;
+    feg.gate = false;
+    setFilterEnvelopeTimes();
+    feg.start();
 
-    if (unison == 1)
+    // Where the glides of the first control block start from
+    modPitch = lfoToPitch * lfoValue;
+    modPitchEnd = modPitch;
+    modCutoff = lfoToCutoff * lfoValue;
+    lfoVCA = lfoToVCA * 0.5f * (lfoValue - 1.f);
+    lfoVCAEnd = lfoVCA;
+    lfoVCAStep = 0.f;
+}
+
+void SawDemoVoice::advanceLFOs(SawDemoVoice *const *voices, int count)
+{
+    constexpr auto lanes = LFOLanes::lanes;
+    for (int base = 0; base < count; base += lanes)
     {
-        unitShift[0] = 0;
-        panL[0] = 1;
-        panR[0] = 1;
-        phase[0] = 0.0;
-        norm[0] = 1.0;
+        LFOLanes lfos;
+        SawDemoVoice *due[lanes];
+        int n{0};
+        for (int i = base; i < std::min(count, base + lanes); ++i)
+        {
+            auto v = voices[i];
+            if (v->lfoReady || v->controlCountdown != 0 || !v->isPlaying())
+                continue;
+            lfos.phase[n] = v->lfoPhase;
+            // Half a cycle a block is far past any rate we offer, but keeps the wrap simple
+            lfos.inc[n] = std::min(v->lfoRate * v->nextControlLength * v->srInv, 0.5f);
+            lfos.shape[n] = (float)v->lfoShape;
+            due[n++] = v;
+        }
+        if (n == 0)
+            continue;
+
+        lfos.advance();
+        for (int i = 0; i < n; ++i)
+        {
+            due[i]->lfoPhase = lfos.phase[i];
+            due[i]->lfoValue = lfos.out[i];
+            due[i]->lfoReady = true;
+        }
     }
-    else
+}
+
+/*
+ * The LFO has already been moved on to the end of this block, by advanceLFOs, so this runs
+ * the filter envelope there too and aims the cutoff, pitch and VCA at where those put them.
+ * A target which isn't modulated and isn't on its way back from being modulated is left
+ * alone, so a voice with the amounts at zero costs the envelope and nothing else.
+ */
+void SawDemoVoice::advanceModulators(bool &pitchDirty, bool &filterDirty)
+{
+    // The envelope runs whatever its amount, so turning it up mid note finds it where it
+    // should be. A release lands at the next block boundary.
+    float discard[controlBlockSize];
+    feg.process(discard, controlLength);
+
+    if (lfoToPitch != 0.f || modPitch != 0.f)
     {
-        for (int i = 0; i < unison; ++i)
+        auto next = lfoToPitch * lfoValue;
+        auto avg = 0.5f * (modPitchEnd + next);
+        modPitchEnd = next;
+        if (avg != modPitch)
         {
-            float dI = 1.0 * i / (unison - 1);
-            unitShift[i] = 2 * dI - 1;
-            phase[i] = dI;
-            panL[i] = std::cos(0.5 * pival * dI);
-            panR[i] = std::sin(0.5 * pival * dI);
+            modPitch = avg;
+            pitchDirty = true;
+        }
+    }
 
-            norm[i] = 1.0 / sqrt(unison);
+    if (lfoToCutoff != 0.f || fegToCutoff != 0.f || modCutoff != 0.f)
+    {
+        auto next = lfoToCutoff * lfoValue + fegToCutoff * feg.level;
+        if (next != modCutoff)
+        {
+            modCutoff = next;
+            filterDirty = true;
         }
     }
 
-    recalcPitch();
-    recalcFilter();
+    if (lfoToVCA != 0.f || lfoVCA != 0.f)
+    {
+        lfoVCAEnd = lfoToVCA * 0.5f * (lfoValue - 1.f);
+        lfoVCAStep = (lfoVCAEnd - lfoVCA) / controlLength;
+    }
 }
 
 void SawDemoVoice::release()
 {
     state = RELEASING;
-    time = 0;
+    rewindEnvelope();
+    env.release();
+    rerenderEnvelope();
+    feg.release();
+}
 
-    if (time >= ampRelease)
-        state = NEWLY_OFF;
+void SawDemoVoice::setEnvelopeTimes()
+{
+    auto toSamples = [this](float param)
+    { return std::max(timeParamToSeconds(param) * sampleRate, 1.f); };
+    env.attackSamples = toSamples(ampAttack + ampAttackMod);
+    env.decaySamples = toSamples(ampDecay);
+    env.releaseSamples = toSamples(ampRelease + ampReleaseMod);
+    env.sustain = std::clamp(ampSustain, 0.f, 1.f);
 }
 
-void SawDemoVoice::StereoSimperSVF::setCoeff(float key, float res, float srInv)
+void SawDemoVoice::setFilterEnvelopeTimes()
 {
-    auto co = 440.0 * pow(2.0, (key - 69.0) / 12);
-    co = std::clamp(co, 10.0, 15000.0); // just to be safe/lazy
-    res = std::clamp(res, 0.01f, 0.99f);
-    g = std::tan(pival * co * srInv);
-    k = 2.0 - 2.0 * res;
-    gk = g + k;
-    a1 = 1.0 / (1.0 + g * gk);
-    a2 = g * a1;
-    a3 = g * a2;
-    ak = gk * a1;
+    auto toSamples = [this](float param)
+    { return std::max(timeParamToSeconds(param) * sampleRate, 1.f); };
+    feg.attackSamples = toSamples(fegAttack);
+    feg.decaySamples = toSamples(fegDecay);
+    feg.releaseSamples = toSamples(fegRelease);
+    feg.sustain = std::clamp(fegSustain, 0.f, 1.f);
 }
 
-void SawDemoVoice::StereoSimperSVF::step(float &L, float &R)
+void SawDemoVoice::recalcEnvelope()
 {
-    float vin[2]{L, R};
-    float res[2]{0, 0};
-    for (int c = 0; c < 2; ++c)
-    {
-        auto v3 = vin[c] - ic2eq[c];
-        auto v0 = a1 * v3 - ak * ic1eq[c];
-        auto v1 = a2 * v3 + a1 * ic1eq[c];
-        auto v2 = a3 * v3 + a2 * ic1eq[c] + ic2eq[c];
+    rewindEnvelope();
+    setEnvelopeTimes();
+    env.retime();
+    rerenderEnvelope();
 
-        ic1eq[c] = 2 * v1 - ic1eq[c];
-        ic2eq[c] = 2 * v2 - ic2eq[c];
+    // The filter envelope is a control block ahead, so it just carries on from there
+    setFilterEnvelopeTimes();
+    feg.retime();
+}
 
-        // I know that a branch in this loop is inefficient and so on
-        // remember this is mostly showing you how it hangs together.
-        switch (mode)
-        {
-        case LP:
-            res[c] = v2;
-            break;
-        case BP:
-            res[c] = v1;
-            break;
-        case HP:
-            res[c] = v0;
-            break;
-        case NOTCH:
-            res[c] = v2 + v0; // low + high
-            break;
-        case PEAK:
-            res[c] = v2 - v0; // low - high;
-            break;
-        case ALL:
-            res[c] = v2 + v0 - k * v1; // low + high - k * band
-            break;
-        }
+void SawDemoVoice::rewindEnvelope()
+{
+    // At a control block boundary env is already at the current sample
+    if (controlCountdown == 0)
+        return;
+    float discard[controlBlockSize];
+    env = envAtBlockStart;
+    env.process(discard, controlLength - controlCountdown - envSnapshotOffset);
+}
+
+void SawDemoVoice::rerenderEnvelope()
+{
+    if (controlCountdown == 0)
+        return;
+    // Later rewinds in this block replay from here, not from before the change
+    envSnapshotOffset = controlLength - controlCountdown;
+    envAtBlockStart = env;
+    env.process(envBlock + envSnapshotOffset, controlCountdown);
+}
+
+void SawDemoVoice::ADSREnvelope::start()
+{
+    level = 0.f;
+    enter(gate ? GATE_HOLD : ATTACK);
+}
+
+void SawDemoVoice::ADSREnvelope::release()
+{
+    if (stage == OFF)
+        return;
+    if (gate)
+    {
+        // Hold at 1 for 98% of the release then fade over the last 2%
+        level = 1.f;
+        mul = 1.f;
+        add = 0.f;
+        stage = GATE_HOLD;
+        remaining = std::max((int)(releaseSamples * 0.98f), 0);
+        if (remaining == 0)
+            enter(GATE_FADE);
+        return;
     }
+    releaseFrom = level;
+    enter(releaseFrom > 0.f ? RELEASE : OFF);
+}
+
+void SawDemoVoice::ADSREnvelope::stop() { enter(OFF); }
+
+void SawDemoVoice::ADSREnvelope::retime()
+{
+    if (stage == ATTACK || stage == RELEASE)
+        enter(stage);
+    // A new sustain level is approached at the decay rate rather than jumped to
+    else if ((stage == DECAY || stage == SUSTAIN) && level != sustain)
+        enter(DECAY);
+}
 
-    L = res[0];
-    R = res[1];
+/*
+ * Start (or restart from the current level) a segment. This is the only place the
+ * envelope does any arithmetic beyond a multiply-add.
+ */
+void SawDemoVoice::ADSREnvelope::enter(Stage s)
+{
+    stage = s;
+    mul = 1.f;
+    add = 0.f;
+    switch (s)
+    {
+    case OFF:
+        level = 0.f;
+        remaining = INT_MAX;
+        break;
+    case ATTACK:
+        // a linear rise at the full attack rate from wherever we are
+        add = 1.f / attackSamples;
+        remaining = std::max((int)std::ceil((1.f - level) * attackSamples), 1);
+        break;
+    case DECAY:
+    {
+        // Exponential approach to sustain which is within 60db of it after decaySamples
+        mul = std::exp(std::log(0.001f) / decaySamples);
+        add = sustain * (1.f - mul);
+        remaining = std::max((int)decaySamples, 1);
+        break;
+    }
+    case SUSTAIN:
+        level = sustain;
+        remaining = INT_MAX;
+        break;
+    case RELEASE:
+        // a linear fall from the level at note off, to zero in the release time
+        add = -releaseFrom / releaseSamples;
+        remaining = std::max((int)std::ceil(level / releaseFrom * releaseSamples), 1);
+        break;
+    case GATE_HOLD:
+        level = 1.f;
+        remaining = INT_MAX;
+        break;
+    case GATE_FADE:
+    {
+        auto fade = std::max(releaseSamples * 0.02f, 1.f);
+        add = -1.f / fade;
+        remaining = std::max((int)std::ceil(level * fade), 1);
+        break;
+    }
+    }
 }
 
-void SawDemoVoice::StereoSimperSVF::init()
+void SawDemoVoice::ADSREnvelope::process(float *out, int n)
 {
-    for (int c = 0; c < 2; ++c)
+    int i = 0;
+    while (i < n)
     {
-        ic1eq[c] = 0.f;
-        ic2eq[c] = 0.f;
+        if (stage == OFF)
+        {
+            std::fill(out + i, out + n, 0.f);
+            return;
+        }
+
+        auto run = std::min(n - i, remaining);
+        for (int j = 0; j < run; ++j)
+        {
+            out[i + j] = level;
+            level = level * mul + add;
+        }
+        i += run;
+        if (remaining != INT_MAX)
+            remaining -= run;
+
+        if (remaining == 0)
+        {
+            switch (stage)
+            {
+            case ATTACK:
+                level = 1.f;
+                enter(sustain < 1.f ? DECAY : SUSTAIN);
+                break;
+            case DECAY:
+                enter(SUSTAIN);
+                break;
+            case GATE_HOLD:
+                enter(GATE_FADE);
+                break;
+            case RELEASE:
+            case GATE_FADE:
+            default:
+                enter(OFF);
+                break;
+            }
+        }
     }
 }
+
 } // namespace sst::clap_saw_demo
\ No newline at end of file
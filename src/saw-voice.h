@@ -11,7 +11,12 @@
 #define CLAP_SAW_DEMO_VOICE_H
 
 #include <array>
+#include <climits>
 #include "debug-helpers.h"
+#include "dsp-tables.h"
+#include "fast-math.h"
+#include "filter-models.h"
+#include "modulators.h"
 
 namespace sst::clap_saw_demo
 {
@@ -19,9 +24,11 @@ namespace sst::clap_saw_demo
  * SawDemoVoice is a single voice with the following features
  *
  * - A saw wave generated using a second derivative of a cubic curve
- * - Internal unison from 1-7 with detuning from 0 - 100 cents
- * - A simple AR envelope; and an independent VCA level
- * - A multi-mode SVF filter
+ * - Internal unison from 1-32 with detuning from 0 - 100 cents
+ * - An ADSR envelope; and an independent VCA level
+ * - A multi-mode filter with SVF, ladder and OB-style models (see filter-models.h)
+ * - An LFO onto pitch, cutoff and VCA, and an ADSR filter envelope onto cutoff, both
+ *   evaluated at control rate (see modulators.h)
  *
  * It is intended to have 'base' values nad 'modulated' values each
  * of which can be adjusted as a voice is playing.
@@ -37,15 +44,144 @@ namespace sst::clap_saw_demo
  */
 struct SawDemoVoice
 {
-    static constexpr int max_uni = 7;
+    static constexpr int max_uni = UnisonLayoutTable::maxUnison;
+    // The unison loop runs this many voices at a time (and over a count padded up to a
+    // multiple of it) so the compiler can keep it in vector registers.
+    static constexpr int uni_lanes = 4;
+    static_assert(max_uni % uni_lanes == 0);
+
+    // Pitch and filter coefficients follow modulation, and the LFO and filter envelope run,
+    // at this rate; see controlUpdate
+    static constexpr int controlBlockSize = 16;
+    static_assert(controlBlockSize <= StereoFilter::maxBatchFrames);
+
+    /*
+     * The amplitude envelope. Each segment is level = level * mul + add run for a counted
+     * number of samples, with mul, add and the count worked out once when the segment
+     * starts, so rendering is a multiply-add per sample with no division and no branching
+     * on the stage except at segment boundaries. Attack and release are linear (add only),
+     * decay is exponential toward the sustain level (mul and add), sustain holds.
+     *
+     * When the voice bypasses the envelope ('gate' mode) the same machinery holds at 1 and
+     * then, on release, holds for 98% of the release time and fades over the last 2% to
+     * avoid a click.
+     */
+    struct ADSREnvelope
+    {
+        enum Stage
+        {
+            OFF,
+            ATTACK,
+            DECAY,
+            SUSTAIN,
+            RELEASE,
+            GATE_HOLD,
+            GATE_FADE
+        } stage{OFF};
+
+        float level{0.f}, mul{1.f}, add{0.f};
+        int remaining{0};
+
+        // Segment lengths in samples, and the sustain level. Set these then start or retime.
+        float attackSamples{1.f}, decaySamples{1.f}, releaseSamples{1.f}, sustain{1.f};
+        bool gate{false};
+
+        void start();
+        void release();
+        // Straight to OFF, for a voice nobody can hear any more
+        void stop();
+        // The times or sustain changed; re-derive the segment we are in from the level
+        void retime();
+        // Write the next n levels to out, moving through segments as they finish
+        void process(float *out, int n);
+
+      private:
+        void enter(Stage s);
+        float releaseFrom{1.f};
+    };
+
+    /*
+     * The members are laid out hot first. Everything from here down to the 'cold' comment
+     * is touched on every sample by step(); everything after it only at voice start, on
+     * modulation and on parameter changes. An instance has 64 of these and a session can have
+     * hundreds of instances, so keeping the per sample working set to the front of each voice
+     * (and in float where double isn't needed) is worth the slightly odd ordering.
+     */
+
+    // What is my AEG state. This will advance across attack hold releasing NEWLY_OFF
+    // even if the AEG is bypassed. NEWLY_OFF is a state which lets us detect voices which
+    // terminate in a block so we can inform the DAW with a CLAP_EVENT_NOTE_END for polyphonic
+    // voice cooperation
+    enum AEGMode
+    {
+        OFF,
+        ATTACK,
+        HOLD,
+        NEWLY_OFF,
+        RELEASING
+    } state{OFF};
+
+    // L / R are the output.
+    float L{0.f}, R{0.f};
+
+    // unison count is snapped at voice on
+    int unison{3};
+
+  private:
+    int unisonPadded{4};
+
+  public:
+
+    // The internal AEG is an ADSR which can be bypassed. The times are in the 0-1 time
+    // parameter scale (see timeParamToSeconds) and sustain is a level. Attack and release
+    // are polyphonically modulatable.
+    bool ampGate{false};
+    float ampAttack{0.5f}, ampDecay{0.5f}, ampSustain{1.f}, ampRelease{0.5f};
+    float ampAttackMod{0.f}, ampReleaseMod{0.f};
+
+    // The pre-filter VCA is unique in that it can be either internally
+    // modulated and externally modulated. If ampGate is false, the internal
+    // modulation is bypassed. The two vectors for modulation are a VCAMod
+    // value, intended for param modulation, and a volumeNoteExpressionValue
+    float preFilterVCA{1.0}, preFilterVCAMod{0.0}, volumeNoteExpressionValue{0.f};
+
+    StereoFilter filter;
+    // Every control block snaps the filter state below StereoFilter::denormalThreshold to
+    // zero, for hosts and targets which leave us without FTZ (see denormals.h). Always on in
+    // the plugin; tail-bench turns it off to see what it saves.
+    bool flushFilterDenormals{true};
+
+  private:
+    int controlCountdown{0}, controlLength{controlBlockSize}, nextControlLength{controlBlockSize};
+    float preFilterVCAModStep{0.f}, preFilterVCAModEnd{0.f};
+    // The LFO's share of the VCA, which glides alongside preFilterVCAMod
+    float lfoVCA{0.f}, lfoVCAStep{0.f};
+    float srInv{1.0f / 44100.0f};
+
+    // The envelope is rendered a control block at a time into envBlock, which step() reads
+    // at controlLength - controlCountdown. envAtBlockStart (which is the envelope as it
+    // was at sample envSnapshotOffset of the block) lets release and modulation rewind to
+    // the current sample and re-render the rest of the block.
+    ADSREnvelope env, envAtBlockStart;
+    int envSnapshotOffset{0};
+    alignas(16) float envBlock[controlBlockSize];
+
+    // The saw is the second difference of a cubic over a step of dPhase, which cancels
+    // catastrophically in single precision, so phase and its increment have to stay double.
+    // gainL/R fold the pan, the 1/sqrt(unison) norm, the output level and the 1/dPhase^2
+    // scaling of the difference into one multiplier per unison voice; recalcPitch sets them.
+    alignas(16) std::array<double, max_uni> phase, dPhase;
+    alignas(16) std::array<float, max_uni> gainL, gainR;
+
+  public:
+    // ---- cold from here down ----
 
     int portid;  // clap note port index
     int channel; // midi channel
     int key;     // The midi key which triggered me
     int note_id; // and the note_id delivered by the host (used for note expressions)
-
-    // unison count is snapped at voice on
-    int unison{3};
+    int outputPort{0}; // the audio output port I render to, chosen at note on
+    uint64_t startSample{0}; // when, counting from activate, for the editor's telemetry
 
     // Note the pattern that we have an item and its modulator as the API
     float uniSpread{10.0}, uniSpreadMod{0.0};
@@ -54,44 +190,76 @@ struct SawDemoVoice
     float oscDetune{0}, oscDetuneMod{0};
 
     // Filter characteristics. After adjusting these call 'recalcFilter'.
-    int filterMode{StereoSimperSVF::Mode::LP};
+    int filterMode{StereoFilter::LP};
     float cutoff{69.0}, res{0.7};
     float cutoffMod{0.0}, resMod{0.0};
 
-    // The internal AEG is incredibly simple. Bypass or not, and have
-    // an attack and release time in seconds. These aren't modulatable
-    // mostly out of laziness.
-    bool ampGate{false};
-    float ampAttack{0.01}, ampRelease{0.1};
-
-    // The pre-filter VCA is unique in that it can be either internally
-    // modulated and externally modulated. If ampGate is false, the internal
-    // modulation is bypassed. The two vectors for modulation are a VCAMod
-    // value, intended for param modulation, and a volumeNoteExpressionValue
-    float preFilterVCA{1.0}, preFilterVCAMod{0.0}, volumeNoteExpressionValue{0.f};
+    /*
+     * The internal modulation. The LFO (rate in Hz, an LFOShape) restarts at each note and
+     * reaches pitch in semitones, cutoff in keys and the VCA as a dip of up to lfoToVCA from
+     * the top of its cycle. The filter envelope uses the amplitude envelope's time scale and
+     * reaches cutoff in keys. Change them whenever you like; the next control block picks
+     * them up, except the envelope times which need 'recalcEnvelope'.
+     */
+    int lfoShape{lfoSine};
+    float lfoRate{2.f}, lfoToPitch{0.f}, lfoToCutoff{0.f}, lfoToVCA{0.f};
+    float fegAttack{0.f}, fegDecay{0.5f}, fegSustain{0.f}, fegRelease{0.5f}, fegToCutoff{0.f};
 
     // Two values can modify pitch, the note expression and the bend wheel.
     // After adjusting these, call 'recalcPitch'
     float pitchNoteExpressionValue{0.f}, pitchBendWheel{0.f};
 
-    // Finally, please set my sample rate at voice on. Thanks!
+    // The 12-TET note my key sounds at in the current tuning (see tuning.h). Set it before
+    // start, and call 'recalcPitch' if you change it while I'm playing.
+    float keyPitch{60.f};
+
+    // Finally, please set my sample rate (with setSampleRate) before voice on. Thanks! Along
+    // with it we get the shared cutoff-to-coefficient table for that sample rate (see
+    // dsp-tables.h)
     float sampleRate{0};
+    const CutoffPrewarpTable *cutoffTable{nullptr};
+    void setSampleRate(double sr, const CutoffPrewarpTable *table)
+    {
+        sampleRate = (float)sr;
+        srInv = (float)(1.0 / sr);
+        cutoffTable = table;
+    }
 
-    // What is my AEG state. This will advance across attack hold releasing NEWLY_OFF
-    // even if the AEG is bypassed. NEWLY_OFF is a state which lets us detect voices which
-    // terminate in a block so we can inform the DAW with a CLAP_EVENT_NOTE_END for polyphonic
-    // voice cooperation
-    enum AEGMode
+    // How many samples after my start the caller's next control block boundary is (0 for
+    // right away). My first control block is shortened to land on it, so every voice an
+    // engine starts shares the same boundaries and can be rendered in filter batches.
+    int controlPhase{0};
+
+    /*
+     * Polyphonic modulation doesn't jump. setModTarget starts a linear ramp of one of the
+     * modulation values which arrives after 'samples' samples (0 snaps right away), or at
+     * the control block boundary just before then, since that is where ramps move. Every
+     * controlBlockSize samples step() advances the ramps, recomputes the pitch and the
+     * filter coefficients for the end of the next control block, and the filter glides
+     * to those per sample. The pre-filter VCA is interpolated per sample too. So a dense
+     * stream of modulation events costs one recalculation per control block per voice.
+     */
+    enum ModTarget
     {
-        OFF,
-        ATTACK,
-        HOLD,
-        NEWLY_OFF,
-        RELEASING
-    } state{OFF};
+        mtCutoff,
+        mtResonance,
+        mtUniSpread,
+        mtOscDetune,
+        mtPreFilterVCA,
+        mtAmpAttack,
+        mtAmpRelease,
+        nModTargets
+    };
+    void setModTarget(ModTarget target, float value, uint32_t samples);
+    // Jump every ramp in flight to its target
+    void snapModulation();
 
-    // L / R are the output.
-    float L{0.f}, R{0.f};
+    /*
+     * Move the LFOs of those of these voices which are about to start a control block on to
+     * the end of it, several at a time (see LFOLanes). Call it just before beginRender on
+     * voices which share a grid; a voice it wasn't called for does its own in beginRender.
+     */
+    static void advanceLFOs(SawDemoVoice *const *voices, int count);
 
     // start, then step the voice forever. release it on note off. sometime after that
     // the voice will transition to NEWLY_OFF which you should detect then externally
@@ -100,39 +268,99 @@ struct SawDemoVoice
     void step();
     void release();
 
+    /*
+     * Rendering a block at a time, which is what step() does with a block of one. First
+     * call beginRender, which starts a new control block if I'm at a boundary and returns how
+     * many of the next 'frames' samples fit before the following one. Then renderUnfiltered
+     * writes up to that many samples of oscillator times envelope, and you run them through
+     * 'filter' (on its own or in a batch with other voices; see processFilterBatch). If I
+     * stop playing in beginRender I have nothing more to render.
+     */
+    int beginRender(int frames);
+    void renderUnfiltered(float *outL, float *outR, int n);
+
+    /*
+     * Shortcuts for work nobody would hear:
+     *
+     * - a VCA at or below zero for a stretch renders silence without running the oscillator
+     *   (eoSilentVCA counts the stretches). A VCA below zero is silence, not an inverted
+     *   signal
+     * - a releasing voice whose envelope times VCA is below inaudibleLevel (-120dB) ends
+     *   right away (eoReleaseCut counts the voices)
+     *
+     * The counts accumulate until whoever is reporting them reads and zeroes them.
+     */
+    static constexpr float inaudibleLevel = 1e-6f;
+    enum EarlyOut
+    {
+        eoSilentVCA,
+        eoReleaseCut,
+        nEarlyOuts
+    };
+    std::array<uint32_t, nEarlyOuts> earlyOutCounts{};
+
+    // Advance the envelope and oscillator phases by frames samples without making any
+    // sound, for a voice whose output port has no buffer this block
+    void skip(uint32_t frames);
+
     void recalcPitch();
     void recalcFilter();
+    // Pick up changed envelope times or sustain from the current sample onwards
+    void recalcEnvelope();
 
     inline bool isPlaying() const { return state != OFF && state != NEWLY_OFF; }
+    // Where the amplitude envelope got to, for the editor's telemetry
+    float envelopeLevel() const { return env.level; }
 
-    struct StereoSimperSVF // thanks to urs @ u-he and andy simper @ cytomic
+    // Convert 0-1 linear into 0-4s exponential
+    static inline float timeParamToSeconds(float param)
     {
-        float ic1eq[2]{0.f, 0.f}, ic2eq[2]{0.f, 0.f};
-        float g{0.f}, k{0.f}, gk{0.f}, a1{0.f}, a2{0.f}, a3{0.f}, ak{0.f};
-        enum Mode
-        {
-            LP,
-            HP,
-            BP,
-            NOTCH,
-            PEAK,
-            ALL
-        } mode{LP};
-
-        float low[2], band[2], high[2], notch[2], peak[2], all[2];
-        void setCoeff(float key, float res, float srInv);
-        void step(float &L, float &R);
-        void init();
-    } filter;
+        auto scaleTime = std::clamp((param - 2.f / 3.f) * 6, -100.f, 2.f);
+        return fastmath::exp2(scaleTime);
+    }
 
   private:
-    double baseFreq{440.0};
-    double srInv{1.0 / 44100.0};
-    float time{0}, filterTime{0};
-    float releaseFrom{1.0};
+    void controlUpdate();
+    void advanceRamps(bool &pitchDirty, bool &filterDirty);
+    void advanceModulators(bool &pitchDirty, bool &filterDirty);
+    inline float cutoffKey() const { return cutoff + cutoffMod + modCutoff; }
+    void advancePhases(uint32_t n);
+    inline float vcaGain(float vcaMod) const
+    {
+        return preFilterVCA + vcaMod + volumeNoteExpressionValue;
+    }
+    float &modValue(ModTarget target);
+    void setEnvelopeTimes();
+    void setFilterEnvelopeTimes();
+    // Put env back to where it is at the current sample of this control block
+    void rewindEnvelope();
+    void rerenderEnvelope();
+
+    struct ModRamp
+    {
+        float target{0.f}, delta{0.f};
+        int remaining{0};
+    };
+    std::array<ModRamp, nModTargets> modRamps;
+    uint32_t activeRamps{0}; // bitmask of ModTarget
+
+    /*
+     * Where the internal modulation has got to. The LFO and filter envelope are one control
+     * block ahead: lfoValue and feg are where they will be at the end of the current block,
+     * and lfoReady says advanceLFOs has already moved the LFO for the block about to start.
+     * The cutoff and VCA glide to their targets like the ramps above. Pitch can't glide
+     * inside a block, since the saw kernels take one increment per block, so modPitch is the
+     * average of its value at the two ends, which runs up the same phase a glide would.
+     */
+    ADSREnvelope feg;
+    float lfoPhase{0.f}, lfoValue{0.f};
+    bool lfoReady{false};
+    float modPitch{0.f}, modPitchEnd{0.f}, modCutoff{0.f};
+    float lfoVCAEnd{0.f};
+    void startModulators();
 
-    std::array<float, max_uni> panL, panR, unitShift, norm;
-    std::array<double, max_uni> phase, dPhase, dPhaseInv;
+    float baseFreq{440.0};
+    const UnisonLayoutTable::Layout *layout{nullptr};
 };
 } // namespace sst::clap_saw_demo
 #endif
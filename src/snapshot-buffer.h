@@ -0,0 +1,81 @@
+/*
+ * ClapSawDemo
+ * https://github.com/surge-synthesizer/clap-saw-demo
+ *
+ * Copyright 2022 Paul Walker and others as listed in the git history
+ *
+ * Released under the MIT License. See LICENSE.md for full text.
+ */
+
+#ifndef CLAP_SAW_DEMO_SNAPSHOT_BUFFER_H
+#define CLAP_SAW_DEMO_SNAPSHOT_BUFFER_H
+
+/*
+ * A way for the audio thread to hand a whole struct to the editor once a block without
+ * either side waiting on the other, which is how the engine telemetry gets to the screen.
+ *
+ * There are two copies. The writer fills the one the reader was not last told about and then
+ * publishes it with a release store, so a reader copying the latest snapshot is only ever
+ * disturbed if the writer gets two whole blocks done during its copy. The reader can tell
+ * when that happened (this is a seqlock, with the sequence numbers in 'writing' and
+ * 'published') and tries again; it gives up after a few goes and keeps what it had.
+ *
+ * One writer, the audio thread (or the main thread while we aren't processing, which CLAP
+ * never overlaps with it), and any number of readers. T must be trivially copyable, since
+ * a reader can copy it while it is being written and throw the copy away.
+ */
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace sst::clap_saw_demo
+{
+template <typename T> struct SnapshotBuffer
+{
+    static_assert(std::is_trivially_copyable_v<T>, "Snapshots are copied with memcpy");
+
+    // The writer's side: fill in the returned snapshot, then publish it
+    T &beginWrite() noexcept
+    {
+        auto k = published.load(std::memory_order_relaxed) + 1;
+        writing.store(k, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        return slots[k & 1];
+    }
+    void publish() noexcept
+    {
+        published.store(writing.load(std::memory_order_relaxed), std::memory_order_release);
+    }
+
+    // The reader's side. Returns false, leaving out alone, if nothing has been published yet
+    // or the writer kept overtaking us.
+    bool read(T &out) const noexcept
+    {
+        for (int attempt = 0; attempt < 4; ++attempt)
+        {
+            auto k = published.load(std::memory_order_acquire);
+            if (k == 0)
+                return false;
+
+            T copy;
+            memcpy(&copy, &slots[k & 1], sizeof(T));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            // The slot we copied is written again by snapshot k + 2
+            if (writing.load(std::memory_order_relaxed) < k + 2)
+            {
+                out = copy;
+                return true;
+            }
+        }
+        return false;
+    }
+
+  private:
+    T slots[2]{};
+    std::atomic<uint64_t> writing{0}, published{0};
+};
+} // namespace sst::clap_saw_demo
+
+#endif // CLAP_SAW_DEMO_SNAPSHOT_BUFFER_H
@@ -0,0 +1,175 @@
+/*
+ * ClapSawDemo
+ * https://github.com/surge-synthesizer/clap-saw-demo
+ *
+ * Copyright 2022 Paul Walker and others as listed in the git history
+ *
+ * Released under the MIT License. See LICENSE.md for full text.
+ */
+
+/*
+ * clap-saw-demo-tail-bench measures what the synth costs while sound is dying away, which
+ * is where denormals bite (see denormals.h). It runs two scenarios, each with the
+ * floating point control register as the host left it and then with the
+ * ScopedDenormalsDisabled guard that process() uses:
+ *
+ * - "release tails" starts a pile of resonant voices, holds them, releases them all and
+ *   times the samples from the release until the last voice is off.
+ * - "svf ring down" kicks the resonant filters of a bank of voices with an impulse and times
+ *   them ringing down on silence (the pre-filter VCA is at zero, so the oscillators are
+ *   skipped), with and without the control rate state snap
+ *   (SawDemoVoice::flushFilterDenormals). This is the worst case (the state goes denormal as
+ *   fast as it can), and the voices run block by block as the plugin runs them, so the snap
+ *   measured is the voice's own.
+ *
+ * It drives SawDemoVoice directly, not the plugin, so it only needs the voice sources. It
+ * isn't built by default; run it with
+ *
+ *     cmake --build build --target tail-bench
+ *
+ * As with the footprint report, compare numbers on the same machine and build type. The
+ * difference is large on CPUs with slow denormal assists and small on ones without.
+ */
+
+#include "saw-voice.h"
+#include "denormals.h"
+#include "dsp-tables.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace
+{
+using namespace sst::clap_saw_demo;
+
+constexpr double sampleRate = 48000;
+
+// ns per voice per sample for the release phase of nVoices voices
+double releaseTails(int nVoices)
+{
+    std::vector<SawDemoVoice> voices(nVoices);
+    for (int i = 0; i < nVoices; ++i)
+    {
+        auto &v = voices[i];
+        v.setSampleRate(sampleRate, cutoffPrewarpTableFor(sampleRate));
+        v.unison = 3;
+        v.uniSpread = 10;
+        v.cutoff = 40;
+        v.res = 0.95;
+        v.filterMode = StereoFilter::LP;
+        v.ampAttack = 0.2;
+        v.ampRelease = 0.75;
+        v.start(36 + i % 48);
+    }
+
+    double sink{0};
+    for (int s = 0; s < (int)sampleRate / 4; ++s)
+        for (auto &v : voices)
+        {
+            v.step();
+            sink += v.L;
+        }
+
+    for (auto &v : voices)
+        v.release();
+
+    uint64_t samples{0};
+    auto t0 = std::chrono::steady_clock::now();
+    bool any{true};
+    while (any)
+    {
+        any = false;
+        for (auto &v : voices)
+        {
+            if (!v.isPlaying())
+                continue;
+            any = true;
+            v.step();
+            sink += v.L;
+            samples++;
+        }
+    }
+    auto t1 = std::chrono::steady_clock::now();
+
+    // Keep the optimizer from deciding none of this matters
+    if (sink == 12345.678)
+        printf(" ");
+    auto ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+    return ns / std::max<uint64_t>(samples, 1);
+}
+
+// ns per voice per sample for nVoices voices' filters ringing down over 'seconds' of silence
+double svfRingDown(int nVoices, double seconds, bool snap)
+{
+    std::vector<SawDemoVoice> voices(nVoices);
+    for (int i = 0; i < nVoices; ++i)
+    {
+        auto &v = voices[i];
+        v.setSampleRate(sampleRate, cutoffPrewarpTableFor(sampleRate));
+        v.cutoff = 30 + i % 60;
+        v.res = 0.98;
+        v.filterMode = StereoFilter::LP;
+        v.preFilterVCA = 0.f;
+        v.flushFilterDenormals = snap;
+        v.start(60);
+        float L{1.f}, R{1.f};
+        v.filter.step(L, R);
+    }
+
+    int n = (int)(seconds * sampleRate);
+    float L[SawDemoVoice::controlBlockSize], R[SawDemoVoice::controlBlockSize];
+    double sink{0};
+    auto t0 = std::chrono::steady_clock::now();
+    for (int s = 0; s < n; s += SawDemoVoice::controlBlockSize)
+    {
+        for (auto &v : voices)
+        {
+            // Each beginRender here is a control block boundary, which is where the snap is
+            auto todo = v.beginRender(SawDemoVoice::controlBlockSize);
+            v.renderUnfiltered(L, R, todo);
+            v.filter.process(L, R, todo);
+            sink += L[0];
+        }
+    }
+    auto t1 = std::chrono::steady_clock::now();
+
+    if (sink == 12345.678)
+        printf(" ");
+    return std::chrono::duration<double, std::nano>(t1 - t0).count() / ((double)n * nVoices);
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+    int count = 64;
+    if (argc > 1)
+        count = std::max(1, atoi(argv[1]));
+
+    unisonLayoutTable();
+    noteFrequencyTable();
+
+    printf("release tails, %d voices          host FPU  %8.2f ns/voice/sample\n", count,
+           releaseTails(count));
+    {
+        ScopedDenormalsDisabled noDenormals;
+        printf("release tails, %d voices          FTZ/DAZ   %8.2f ns/voice/sample\n", count,
+               releaseTails(count));
+    }
+
+    printf("svf ring down, %d voices, no snap  host FPU  %8.2f ns/voice/sample\n", count,
+           svfRingDown(count, 10, false));
+    printf("svf ring down, %d voices, snap     host FPU  %8.2f ns/voice/sample\n", count,
+           svfRingDown(count, 10, true));
+    {
+        ScopedDenormalsDisabled noDenormals;
+        printf("svf ring down, %d voices, no snap  FTZ/DAZ   %8.2f ns/voice/sample\n", count,
+               svfRingDown(count, 10, false));
+        printf("svf ring down, %d voices, snap     FTZ/DAZ   %8.2f ns/voice/sample\n", count,
+               svfRingDown(count, 10, true));
+    }
+
+    releaseDspTables();
+    return 0;
+}
@@ -0,0 +1,229 @@
+/*
+ * ClapSawDemo
+ * https://github.com/surge-synthesizer/clap-saw-demo
+ *
+ * Copyright 2022 Paul Walker and others as listed in the git history
+ *
+ * Released under the MIT License. See LICENSE.md for full text.
+ */
+
+#include "tuning.h"
+#include <cmath>
+#include <locale>
+#include <sstream>
+
+namespace sst::clap_saw_demo
+{
+namespace
+{
+// The non comment lines of a Scala file with the line ending and surrounding spaces removed
+std::vector<std::string> scalaLines(const std::string &contents)
+{
+    std::vector<std::string> res;
+    std::istringstream iss(contents);
+    std::string line;
+    while (std::getline(iss, line))
+    {
+        if (!line.empty() && line[0] == '!')
+            continue;
+        auto b = line.find_first_not_of(" \t\r");
+        auto e = line.find_last_not_of(" \t\r");
+        res.push_back(b == std::string::npos ? std::string() : line.substr(b, e - b + 1));
+    }
+    return res;
+}
+
+// The first whitespace separated token; Scala allows anything after it on a line
+std::string firstToken(const std::string &line)
+{
+    auto e = line.find_first_of(" \t");
+    return e == std::string::npos ? line : line.substr(0, e);
+}
+
+template <typename T> bool parseNumber(const std::string &s, T &v)
+{
+    std::istringstream iss(s);
+    iss.imbue(std::locale("C"));
+    iss >> v;
+    return !iss.fail() && iss.eof();
+}
+
+int floorDiv(int a, int b) { return (a >= 0) ? a / b : -((-a + b - 1) / b); }
+} // namespace
+
+bool parseScl(const std::string &contents, Scale &scale, std::string &error)
+{
+    auto lines = scalaLines(contents);
+    if (lines.size() < 2)
+    {
+        error = "scl file is missing its description or note count";
+        return false;
+    }
+
+    scale = Scale();
+    scale.description = lines[0];
+
+    // After the description blank lines mean nothing
+    std::vector<std::string> rest;
+    for (size_t i = 1; i < lines.size(); ++i)
+        if (!lines[i].empty())
+            rest.push_back(firstToken(lines[i]));
+
+    int count{0};
+    if (rest.empty() || !parseNumber(rest[0], count) || count < 1 || count > 1024)
+    {
+        error = "scl file has an invalid note count";
+        return false;
+    }
+    if ((int)rest.size() - 1 < count)
+    {
+        error = "scl file has fewer pitches than its note count";
+        return false;
+    }
+
+    for (int i = 1; i <= count; ++i)
+    {
+        const auto &t = rest[i];
+        double cents{0};
+        if (t.find('.') != std::string::npos)
+        {
+            if (!parseNumber(t, cents))
+            {
+                error = "scl pitch '" + t + "' is not a number of cents";
+                return false;
+            }
+        }
+        else
+        {
+            auto slash = t.find('/');
+            long num{0}, den{1};
+            if (!parseNumber(t.substr(0, slash), num) ||
+                (slash != std::string::npos && !parseNumber(t.substr(slash + 1), den)) ||
+                num <= 0 || den <= 0)
+            {
+                error = "scl pitch '" + t + "' is not a valid ratio";
+                return false;
+            }
+            cents = 1200.0 * std::log2((double)num / den);
+        }
+        scale.cents.push_back(cents);
+    }
+
+    if (scale.cents.back() <= 0)
+    {
+        error = "scl period must be above the unison";
+        return false;
+    }
+    return true;
+}
+
+bool parseKbm(const std::string &contents, KeyboardMapping &mapping, std::string &error)
+{
+    std::vector<std::string> lines;
+    for (const auto &l : scalaLines(contents))
+        if (!l.empty())
+            lines.push_back(firstToken(l));
+
+    if (lines.size() < 7)
+    {
+        error = "kbm file is missing some of its seven header values";
+        return false;
+    }
+
+    mapping = KeyboardMapping();
+    mapping.degrees.clear();
+    if (!parseNumber(lines[0], mapping.mapSize) || !parseNumber(lines[1], mapping.firstKey) ||
+        !parseNumber(lines[2], mapping.lastKey) || !parseNumber(lines[3], mapping.middleKey) ||
+        !parseNumber(lines[4], mapping.referenceKey) ||
+        !parseNumber(lines[5], mapping.referenceFrequency) ||
+        !parseNumber(lines[6], mapping.octaveDegree))
+    {
+        error = "kbm file has an invalid header value";
+        return false;
+    }
+    if (mapping.mapSize < 0 || mapping.mapSize > 1024 || mapping.referenceFrequency <= 0 ||
+        mapping.octaveDegree < 0)
+    {
+        error = "kbm file has an out of range header value";
+        return false;
+    }
+
+    // Entries past the end of the file are unmapped
+    for (int i = 0; i < mapping.mapSize; ++i)
+    {
+        int d{-1};
+        auto li = 7 + (size_t)i;
+        if (li < lines.size() && lines[li] != "x" && lines[li] != "X")
+        {
+            if (!parseNumber(lines[li], d) || d < 0)
+            {
+                error = "kbm mapping entry '" + lines[li] + "' is not a scale degree or x";
+                return false;
+            }
+        }
+        mapping.degrees.push_back(d);
+    }
+    return true;
+}
+
+TuningTable::TuningTable()
+{
+    for (int k = 0; k < nKeys; ++k)
+        keyNote[k] = k;
+    mapped.fill(true);
+}
+
+bool TuningTable::build(const Scale &scale, const KeyboardMapping &mapping, std::string &error)
+{
+    int n = (int)scale.cents.size();
+    if (n == 0)
+    {
+        error = "scale is empty";
+        return false;
+    }
+    auto period = scale.cents.back();
+    auto octaveDegree = mapping.octaveDegree > 0 ? mapping.octaveDegree : n;
+
+    auto degreeCents = [&](int d)
+    {
+        auto oct = floorDiv(d, n);
+        auto r = d - oct * n;
+        return oct * period + (r == 0 ? 0.0 : scale.cents[r - 1]);
+    };
+
+    // Which scale degree (counting from the middle key) a key plays, if any
+    auto keyDegree = [&](int k, int &degree)
+    {
+        if (mapping.mapSize == 0)
+        {
+            degree = k - mapping.middleKey;
+            return true;
+        }
+        auto off = k - mapping.middleKey;
+        auto mo = floorDiv(off, mapping.mapSize);
+        auto idx = off - mo * mapping.mapSize;
+        auto e = (idx < (int)mapping.degrees.size()) ? mapping.degrees[idx] : -1;
+        if (e < 0)
+            return false;
+        degree = e + mo * octaveDegree;
+        return true;
+    };
+
+    int refDegree{0};
+    if (!keyDegree(mapping.referenceKey, refDegree))
+    {
+        error = "the kbm reference key is unmapped";
+        return false;
+    }
+
+    auto refNote = 69.0 + 12.0 * std::log2(mapping.referenceFrequency / 440.0);
+    auto refCents = degreeCents(refDegree);
+    for (int k = 0; k < nKeys; ++k)
+    {
+        int d{0};
+        mapped[k] = k >= mapping.firstKey && k <= mapping.lastKey && keyDegree(k, d);
+        keyNote[k] = mapped[k] ? refNote + (degreeCents(d) - refCents) / 100.0 : (double)k;
+    }
+    return true;
+}
+} // namespace sst::clap_saw_demo
@@ -0,0 +1,79 @@
+/*
+ * ClapSawDemo
+ * https://github.com/surge-synthesizer/clap-saw-demo
+ *
+ * Copyright 2022 Paul Walker and others as listed in the git history
+ *
+ * Released under the MIT License. See LICENSE.md for full text.
+ */
+
+#ifndef CLAP_SAW_DEMO_TUNING_H
+#define CLAP_SAW_DEMO_TUNING_H
+
+/*
+ * Microtuning with Scala files. A .scl file describes a scale (a list of pitches in cents
+ * or ratios, the last of which is the period, usually an octave) and a .kbm file describes
+ * how that scale is laid out across the MIDI keys and which key is tuned to which
+ * frequency. See https://www.huygens-fokker.org/scala/scl_format.html and
+ * https://www.huygens-fokker.org/scala/help.htm#mappings for the formats.
+ *
+ * Everything here runs on the main thread. The result is a TuningTable which gives, for
+ * each of the 128 MIDI keys, the 12-TET MIDI note with the same frequency (so key 60 in a
+ * quarter tone scale might be note 60 and key 61 note 60.5). The voices add bends and
+ * detune to that in semitones and go through the shared NoteFrequencyTable as before, so
+ * retuning costs nothing per note. See ClapSawDemo::loadTuning for how a new table gets
+ * to the audio thread.
+ */
+
+#include <array>
+#include <string>
+#include <vector>
+
+namespace sst::clap_saw_demo
+{
+struct Scale
+{
+    std::string description;
+    // One entry per scale degree 1..n in cents; the last one is the period
+    std::vector<double> cents;
+};
+
+struct KeyboardMapping
+{
+    // A size of 0 means the linear mapping where every key is the next scale degree
+    int mapSize{0};
+    int firstKey{0}, lastKey{127};
+    int middleKey{60};
+    int referenceKey{60};
+    double referenceFrequency{261.625565300598623}; // 12-TET middle C
+    // The scale degree which is the period of the mapping; 0 means the scale's own period
+    int octaveDegree{0};
+    // mapSize entries with the scale degree for each key, or -1 for an unmapped key
+    std::vector<int> degrees;
+};
+
+/*
+ * Parse the contents (not the path) of a file. On failure they return false and put a
+ * one line human readable reason in error.
+ */
+bool parseScl(const std::string &contents, Scale &scale, std::string &error);
+bool parseKbm(const std::string &contents, KeyboardMapping &mapping, std::string &error);
+
+struct TuningTable
+{
+    static constexpr int nKeys = 128;
+
+    // The default is standard 12-TET, key n is note n
+    TuningTable();
+    // Build from a scale and mapping. Returns false (leaving the table 12-TET) if the mapping
+    // refers to degrees the scale doesn't have or the reference key has no pitch
+    bool build(const Scale &scale, const KeyboardMapping &mapping, std::string &error);
+
+    std::array<double, nKeys> keyNote;
+    std::array<bool, nKeys> mapped;
+
+    inline bool isMapped(int key) const { return key >= 0 && key < nKeys && mapped[key]; }
+};
+} // namespace sst::clap_saw_demo
+
+#endif // CLAP_SAW_DEMO_TUNING_H
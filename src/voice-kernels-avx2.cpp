@@ -0,0 +1,35 @@
+/*
+ * ClapSawDemo
+ * https://github.com/surge-synthesizer/clap-saw-demo
+ *
+ * Copyright 2022 Paul Walker and others as listed in the git history
+ *
+ * Released under the MIT License. See LICENSE.md for full text.
+ */
+
+/*
+ * The AVX2 + FMA voice kernels (see voice-kernels.h). CMake compiles this file with the AVX2
+ * flags on x86; anywhere else it is empty and the variant isn't offered.
+ */
+
+// MSVC has no __FMA__, but /arch:AVX2 allows FMA instructions
+#if defined(__AVX2__) && (defined(__FMA__) || defined(_MSC_VER))
+#define CLAP_SAW_DEMO_KERNEL_NS kernels_avx2
+#define CLAP_SAW_DEMO_KERNEL_NAME "avx2"
+#include "voice-kernels-impl.h"
+#define CLAP_SAW_DEMO_HAS_KERNELS 1
+#endif
+
+#include "voice-kernels.h"
+
+namespace sst::clap_saw_demo
+{
+const VoiceKernels *avx2VoiceKernels()
+{
+#if CLAP_SAW_DEMO_HAS_KERNELS
+    return &kernels_avx2::kernels;
+#else
+    return nullptr;
+#endif
+}
+} // namespace sst::clap_saw_demo
@@ -0,0 +1,34 @@
+/*
+ * ClapSawDemo
+ * https://github.com/surge-synthesizer/clap-saw-demo
+ *
+ * Copyright 2022 Paul Walker and others as listed in the git history
+ *
+ * Released under the MIT License. See LICENSE.md for full text.
+ */
+
+/*
+ * The AVX-512 voice kernels (see voice-kernels.h). CMake compiles this file with the AVX-512
+ * flags on x86; anywhere else it is empty and the variant isn't offered.
+ */
+
+#if defined(__AVX512F__) && defined(__AVX512VL__)
+#define CLAP_SAW_DEMO_KERNEL_NS kernels_avx512
+#define CLAP_SAW_DEMO_KERNEL_NAME "avx512"
+#include "voice-kernels-impl.h"
+#define CLAP_SAW_DEMO_HAS_KERNELS 1
+#endif
+
+#include "voice-kernels.h"
+
+namespace sst::clap_saw_demo
+{
+const VoiceKernels *avx512VoiceKernels()
+{
+#if CLAP_SAW_DEMO_HAS_KERNELS
+    return &kernels_avx512::kernels;
+#else
+    return nullptr;
+#endif
+}
+} // namespace sst::clap_saw_demo
@@ -0,0 +1,22 @@
+/*
+ * ClapSawDemo
+ * https://github.com/surge-synthesizer/clap-saw-demo
+ *
+ * Copyright 2022 Paul Walker and others as listed in the git history
+ *
+ * Released under the MIT License. See LICENSE.md for full text.
+ */
+
+/*
+ * The base voice kernels: SSE2 on x86, NEON on ARM, plain C++ elsewhere. Always built, and
+ * the fallback for everything else (see voice-kernels.h).
+ */
+
+#define CLAP_SAW_DEMO_KERNEL_NS kernels_base
+#define CLAP_SAW_DEMO_KERNEL_NAME "base"
+#include "voice-kernels-impl.h"
+
+namespace sst::clap_saw_demo
+{
+const VoiceKernels *baseVoiceKernels() { return &kernels_base::kernels; }
+} // namespace sst::clap_saw_demo
@@ -0,0 +1,404 @@
+/*
+ * ClapSawDemo
+ * https://github.com/surge-synthesizer/clap-saw-demo
+ *
+ * Copyright 2022 Paul Walker and others as listed in the git history
+ *
+ * Released under the MIT License. See LICENSE.md for full text.
+ */
+
+/*
+ * The voice kernels (see voice-kernels.h). This is included once by each of the
+ * voice-kernels-*.cpp files, after defining
+ *
+ * - CLAP_SAW_DEMO_KERNEL_NS: the namespace for this variant
+ * - CLAP_SAW_DEMO_KERNEL_NAME: its name, as reported and as CLAP_SAW_DEMO_ISA takes it
+ *
+ * and defines CLAP_SAW_DEMO_KERNEL_NS::kernels. It has no include guard on purpose.
+ *
+ * Everything here is written against the small ops tables below, so the same source makes
+ * 4 wide code from __m128 (or fastmath's vfloat off x86) and 8 wide code from __m256 when
+ * the file is compiled with AVX.
+ *
+ * One rule: don't call an inline function or template from another header here (fastmath,
+ * <algorithm> and so on). The AVX files would emit their own AVX copy of it, and the linker
+ * is free to keep that copy for the whole plugin, which then crashes on an older CPU.
+ * Compiler intrinsics are always inlined, so they are fine.
+ */
+
+#include "voice-kernels.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <immintrin.h>
+#define CLAP_SAW_DEMO_KERNEL_SSE 1
+#else
+#include "fast-math.h"
+#endif
+
+namespace sst::clap_saw_demo::CLAP_SAW_DEMO_KERNEL_NS
+{
+namespace
+{
+#if CLAP_SAW_DEMO_KERNEL_SSE
+struct QuadOps
+{
+    using V = __m128;
+    static constexpr int width = 4;
+    static V load(const float *f) { return _mm_loadu_ps(f); }
+    static void store(float *f, V v) { _mm_storeu_ps(f, v); }
+    static V set(float f) { return _mm_set1_ps(f); }
+    static V add(V a, V b) { return _mm_add_ps(a, b); }
+    static V sub(V a, V b) { return _mm_sub_ps(a, b); }
+    static V mul(V a, V b) { return _mm_mul_ps(a, b); }
+    static V div(V a, V b) { return _mm_div_ps(a, b); }
+    static V min(V a, V b) { return _mm_min_ps(a, b); }
+    static V max(V a, V b) { return _mm_max_ps(a, b); }
+};
+#else
+// Only the base variant is built off x86, so fastmath is safe to use here
+struct QuadOps
+{
+    using V = fastmath::vfloat;
+    static constexpr int width = 4;
+    static V load(const float *f) { return fastmath::vLoad(f); }
+    static void store(float *f, V v) { fastmath::vStore(f, v); }
+    static V set(float f) { return fastmath::vSet(f); }
+    static V add(V a, V b) { return fastmath::vAdd(a, b); }
+    static V sub(V a, V b) { return fastmath::vSub(a, b); }
+    static V mul(V a, V b) { return fastmath::vMul(a, b); }
+    static V div(V a, V b) { return fastmath::vDiv(a, b); }
+    static V min(V a, V b) { return fastmath::vMin(a, b); }
+    static V max(V a, V b) { return fastmath::vMax(a, b); }
+};
+#endif
+
+#if defined(__AVX__)
+struct OctOps
+{
+    using V = __m256;
+    static constexpr int width = 8;
+    static V load(const float *f) { return _mm256_loadu_ps(f); }
+    static void store(float *f, V v) { _mm256_storeu_ps(f, v); }
+    static V set(float f) { return _mm256_set1_ps(f); }
+    static V add(V a, V b) { return _mm256_add_ps(a, b); }
+    static V sub(V a, V b) { return _mm256_sub_ps(a, b); }
+    static V mul(V a, V b) { return _mm256_mul_ps(a, b); }
+    static V div(V a, V b) { return _mm256_div_ps(a, b); }
+    static V min(V a, V b) { return _mm256_min_ps(a, b); }
+    static V max(V a, V b) { return _mm256_max_ps(a, b); }
+};
+// A full batch is one register
+using BatchOps = OctOps;
+#else
+using BatchOps = QuadOps;
+#endif
+
+// The unison sums keep this many partial sums, which is how wide the compiler can go
+#if defined(__AVX512F__)
+constexpr int sawLanes = 8;
+#else
+constexpr int sawLanes = 4;
+#endif
+
+/*
+ * The saws. Use a cubic integrated saw and second derive it at each point. This is
+ * basically the math I worked out for the surge modern oscillator. The cubic function
+ * which gives a clean saw is phase^3 / 6 - phase / 6. Evaluate it at 3 points and then
+ * differentiate it like we do in Surge Modern. The waveform is the same both channels.
+ *
+ * The unison voices are done in two branch free passes over the padded count: the saws and
+ * phase updates (the wrap is a truncation since phase stays below 2) and then sawLanes
+ * separate sums of the saws times gainL/R. Pan, norm and 1/dPhase^2 are all in the gains
+ * and amp multiplies the sum once, so both loops vectorize and each extra unison voice
+ * costs a fraction of the first.
+ */
+void saw(double *phase, const double *dPhase, const float *gainL, const float *gainR,
+         int unisonPadded, const float *amp, float *outL, float *outR, int n)
+{
+    constexpr int maxUni = UnisonLayoutTable::maxUnison;
+    static_assert(maxUni % sawLanes == 0);
+
+    for (int s = 0; s < n; ++s)
+    {
+        alignas(64) double sw[maxUni];
+        for (int i = 0; i < unisonPadded; ++i)
+        {
+            auto p = phase[i], d = dPhase[i];
+            // Our calculation assumes phase in -1,1 and this phase is
+            // in 0 1 so
+            auto x0 = (p - 2 * d) * 2 - 1;
+            auto x1 = (p - d) * 2 - 1;
+            auto x2 = p * 2 - 1;
+            sw[i] = ((x0 * x0 - 1) * x0 + (x2 * x2 - 1) * x2 - 2 * (x1 * x1 - 1) * x1) *
+                    (1.0 / 6.0);
+
+            p += d;
+            phase[i] = p - (double)(int)p;
+        }
+
+        // The count is padded to 4, so a wider sum finishes the last 4 in its low lanes
+        double accL[sawLanes]{}, accR[sawLanes]{};
+        int i = 0;
+        for (; i + sawLanes <= unisonPadded; i += sawLanes)
+        {
+            for (int l = 0; l < sawLanes; ++l)
+            {
+                accL[l] += gainL[i + l] * sw[i + l];
+                accR[l] += gainR[i + l] * sw[i + l];
+            }
+        }
+        for (; i < unisonPadded; i += 4)
+        {
+            for (int l = 0; l < 4; ++l)
+            {
+                accL[l] += gainL[i + l] * sw[i + l];
+                accR[l] += gainR[i + l] * sw[i + l];
+            }
+        }
+
+        for (int w = sawLanes / 2; w >= 4; w /= 2)
+        {
+            for (int l = 0; l < w; ++l)
+            {
+                accL[l] += accL[l + w];
+                accR[l] += accR[l + w];
+            }
+        }
+        outL[s] = (float)(amp[s] * ((accL[0] + accL[1]) + (accL[2] + accL[3])));
+        outR[s] = (float)(amp[s] * ((accR[0] + accR[1]) + (accR[2] + accR[3])));
+    }
+}
+
+/*
+ * The filters. Lanes is the working copy of up to lanes / 2 filters for the length of a
+ * batch. Lane 2 * i is filter i's left channel and 2 * i + 1 its right; both channels carry
+ * the same coefficients. Unused lanes have zero coefficients and state, so they output zero
+ * and cost nothing but the arithmetic they share with the used ones.
+ */
+constexpr int nCoeffs = StereoFilter::nCoeffs, nStates = StereoFilter::nStates,
+              nMix = StereoFilter::nMix;
+
+template <int lanes> struct Lanes
+{
+    alignas(32) float c[nCoeffs][lanes];
+    alignas(32) float dc[nCoeffs][lanes];
+    alignas(32) float mix[nMix][lanes];
+    alignas(32) float z[nStates][lanes];
+
+    void gather(StereoFilter *const *f, int count)
+    {
+        for (int l = 0; l < lanes; ++l)
+        {
+            auto i = l / 2, ch = l % 2;
+            bool used = i < count;
+            for (int k = 0; k < nCoeffs; ++k)
+            {
+                c[k][l] = used ? f[i]->c[k] : 0.f;
+                dc[k][l] = used ? f[i]->dc[k] : 0.f;
+            }
+            for (int k = 0; k < nMix; ++k)
+                mix[k][l] = used ? f[i]->mix[k] : 0.f;
+            for (int k = 0; k < nStates; ++k)
+                z[k][l] = used ? f[i]->z[k][ch] : 0.f;
+        }
+    }
+
+    void scatter(StereoFilter *const *f, int count) const
+    {
+        for (int i = 0; i < count; ++i)
+        {
+            for (int k = 0; k < nCoeffs; ++k)
+                f[i]->c[k] = c[k][2 * i];
+            for (int k = 0; k < nStates; ++k)
+            {
+                f[i]->z[k][0] = z[k][2 * i];
+                f[i]->z[k][1] = z[k][2 * i + 1];
+            }
+        }
+    }
+};
+
+/*
+ * The per model steps. Each register of lanes goes through the sample loop with its
+ * coefficients, deltas, mix and state held locally and written back at the end. c is
+ * {a1, a2, a3, ak, k} for both SVFs and {G, 1 - G, k, 1 / (1 + k G^4), 1 + k} for the
+ * ladder; see StereoFilter::setCoeff.
+ */
+template <typename O> typename O::V tanh(typename O::V x)
+{
+    // fastmath::tanh, op for op
+    x = O::min(O::max(x, O::set(-3.f)), O::set(3.f));
+    auto x2 = O::mul(x, x);
+    auto num = O::mul(x, O::add(O::set(27.f), x2));
+    auto den = O::add(O::set(27.f), O::mul(O::set(9.f), x2));
+    return O::div(num, den);
+}
+
+template <typename O> struct SimperStep
+{
+    using V = typename O::V;
+    V operator()(V in, const V *c, const V *mix, V *z) const
+    {
+        auto two = O::set(2.f);
+        auto v3 = O::sub(in, z[1]);
+        auto v0 = O::sub(O::mul(c[0], v3), O::mul(c[3], z[0]));             // high
+        auto v1 = O::add(O::mul(c[1], v3), O::mul(c[0], z[0]));             // band
+        auto v2 = O::add(O::add(O::mul(c[2], v3), O::mul(c[1], z[0])), z[1]); // low
+
+        z[0] = O::sub(O::mul(two, v1), z[0]);
+        z[1] = O::sub(O::mul(two, v2), z[1]);
+
+        // The mode is the mix; all pass is low + high - k * band
+        auto bandW = O::add(mix[1], O::mul(mix[3], c[4]));
+        return O::add(O::add(O::mul(mix[0], v2), O::mul(bandW, v1)), O::mul(mix[2], v0));
+    }
+};
+
+template <typename O> struct OBStep
+{
+    using V = typename O::V;
+    V operator()(V in, const V *c, const V *mix, V *z) const
+    {
+        auto two = O::set(2.f);
+        auto v3 = O::sub(in, z[1]);
+        auto v0 = O::sub(O::mul(c[0], v3), O::mul(c[3], z[0]));
+        auto v1 = O::add(O::mul(c[1], v3), O::mul(c[0], z[0]));
+        auto v2 = O::add(O::add(O::mul(c[2], v3), O::mul(c[1], z[0])), z[1]);
+
+        // The band integrator saturates, which is what limits the resonance
+        z[0] = tanh<O>(O::sub(O::mul(two, v1), z[0]));
+        z[1] = O::sub(O::mul(two, v2), z[1]);
+
+        return O::add(O::add(O::mul(mix[0], v2), O::mul(mix[1], v1)), O::mul(mix[2], v0));
+    }
+};
+
+template <typename O> struct LadderStep
+{
+    using V = typename O::V;
+    V operator()(V in, const V *c, const V *mix, V *z) const
+    {
+        auto G = c[0];
+
+        // Each one pole is y = G x + (1 - G) s, so the cascade is G^4 u + S. Solve the
+        // feedback u = x - k y4 for u, then saturate it
+        auto S = O::mul(c[1],
+                        O::add(O::mul(G, O::add(O::mul(G, O::add(O::mul(G, z[0]), z[1])), z[2])),
+                               z[3]));
+        auto u = tanh<O>(O::mul(O::sub(O::mul(c[4], in), O::mul(c[2], S)), c[3]));
+
+        auto y = u;
+        for (int st = 0; st < 4; ++st)
+        {
+            auto v = O::mul(O::sub(y, z[st]), G);
+            y = O::add(v, z[st]);
+            z[st] = O::add(y, v);
+        }
+        return O::mul(mix[0], y);
+    }
+};
+
+template <typename O, int lanes, typename Step>
+void runLanes(Lanes<lanes> &b, float (*io)[lanes], int n, Step step)
+{
+    using V = typename O::V;
+    static_assert(lanes % O::width == 0);
+    for (int o = 0; o < lanes; o += O::width)
+    {
+        V c[nCoeffs], dc[nCoeffs], mix[nMix], z[nStates];
+        for (int k = 0; k < nCoeffs; ++k)
+        {
+            c[k] = O::load(&b.c[k][o]);
+            dc[k] = O::load(&b.dc[k][o]);
+        }
+        for (int k = 0; k < nMix; ++k)
+            mix[k] = O::load(&b.mix[k][o]);
+        for (int k = 0; k < nStates; ++k)
+            z[k] = O::load(&b.z[k][o]);
+
+        for (int s = 0; s < n; ++s)
+        {
+            O::store(&io[s][o], step(O::load(&io[s][o]), c, mix, z));
+            for (int k = 0; k < nCoeffs; ++k)
+                c[k] = O::add(c[k], dc[k]);
+        }
+
+        for (int k = 0; k < nCoeffs; ++k)
+            O::store(&b.c[k][o], c[k]);
+        for (int k = 0; k < nStates; ++k)
+            O::store(&b.z[k][o], z[k]);
+    }
+}
+
+template <typename O, int lanes>
+void runModel(StereoFilter::Model model, Lanes<lanes> &b, float (*io)[lanes], int n)
+{
+    switch (model)
+    {
+    case StereoFilter::fmLadder:
+        runLanes<O>(b, io, n, LadderStep<O>());
+        break;
+    case StereoFilter::fmOB:
+        runLanes<O>(b, io, n, OBStep<O>());
+        break;
+    case StereoFilter::fmSimper:
+    case StereoFilter::nFilterModels:
+        runLanes<O>(b, io, n, SimperStep<O>());
+        break;
+    }
+}
+
+void filterBatch(StereoFilter *const *filters, int count, float (*io)[StereoFilter::batchLanes],
+                 int n)
+{
+    static_assert(StereoFilter::batchLanes == 8, "A batch is 8 lanes");
+
+    // One or two voices fit in four lanes, so don't pay for the other four
+    if (count <= 2)
+    {
+        alignas(16) float half[StereoFilter::maxBatchFrames][4];
+        for (int s = 0; s < n; ++s)
+            for (int l = 0; l < 4; ++l)
+                half[s][l] = io[s][l];
+
+        Lanes<4> b;
+        b.gather(filters, count);
+        runModel<QuadOps>(filters[0]->model, b, half, n);
+        b.scatter(filters, count);
+
+        for (int s = 0; s < n; ++s)
+            for (int l = 0; l < 4; ++l)
+                io[s][l] = half[s][l];
+        return;
+    }
+
+    Lanes<8> b;
+    b.gather(filters, count);
+    runModel<BatchOps>(filters[0]->model, b, io, n);
+    b.scatter(filters, count);
+}
+
+void addVoice(float *const *bus, uint32_t chans, uint32_t at,
+              const float (*io)[StereoFilter::batchLanes], int voice, int n)
+{
+    auto l = 2 * voice, r = 2 * voice + 1;
+    if (chans >= 2)
+    {
+        auto outL = bus[0] + at, outR = bus[1] + at;
+        for (int s = 0; s < n; ++s)
+        {
+            outL[s] += io[s][l];
+            outR[s] += io[s][r];
+        }
+    }
+    else if (chans == 1)
+    {
+        auto out = bus[0] + at;
+        for (int s = 0; s < n; ++s)
+            out[s] += (io[s][l] + io[s][r]) * 0.5;
+    }
+}
+} // namespace
+
+extern const VoiceKernels kernels{CLAP_SAW_DEMO_KERNEL_NAME, saw, filterBatch, addVoice};
+} // namespace sst::clap_saw_demo::CLAP_SAW_DEMO_KERNEL_NS
@@ -0,0 +1,140 @@
+/*
+ * ClapSawDemo
+ * https://github.com/surge-synthesizer/clap-saw-demo
+ *
+ * Copyright 2022 Paul Walker and others as listed in the git history
+ *
+ * Released under the MIT License. See LICENSE.md for full text.
+ */
+
+#include "voice-kernels.h"
+
+#include <atomic>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+namespace sst::clap_saw_demo
+{
+// Each defined in its voice-kernels-*.cpp, and null if that file was built without its ISA
+const VoiceKernels *baseVoiceKernels();
+const VoiceKernels *avx2VoiceKernels();
+const VoiceKernels *avx512VoiceKernels();
+
+namespace
+{
+std::atomic<const VoiceKernels *> current{nullptr};
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+/*
+ * MSVC has no __builtin_cpu_supports, so ask cpuid directly. The instructions are only
+ * usable if the OS saves the wider registers on a context switch, which XGETBV reports.
+ */
+bool msvcSupports(KernelIsa isa)
+{
+    int r[4];
+    __cpuid(r, 0);
+    if (r[0] < 7)
+        return false;
+
+    __cpuid(r, 1);
+    bool osxsave = r[2] & (1 << 27), fma = r[2] & (1 << 12);
+    if (!osxsave || !fma)
+        return false;
+    auto xcr0 = _xgetbv(0);
+
+    __cpuidex(r, 7, 0);
+    bool avx2 = r[1] & (1 << 5);
+    bool avx512 = (r[1] & (1 << 16)) && (r[1] & (1 << 17)) && (r[1] & (1 << 30)) &&
+                  (r[1] & (1u << 31)); // F, DQ, BW and VL
+
+    // XMM and YMM state, then opmask and the upper ZMM state as well
+    bool ymm = (xcr0 & 0x6) == 0x6, zmm = (xcr0 & 0xE6) == 0xE6;
+    if (isa == KernelIsa::avx2)
+        return avx2 && ymm;
+    return avx2 && avx512 && zmm;
+}
+#endif
+} // namespace
+
+const VoiceKernels *compiledVoiceKernels(KernelIsa isa)
+{
+    switch (isa)
+    {
+    case KernelIsa::base:
+        return baseVoiceKernels();
+    case KernelIsa::avx2:
+        return avx2VoiceKernels();
+    case KernelIsa::avx512:
+        return avx512VoiceKernels();
+    case KernelIsa::nIsas:
+        break;
+    }
+    return nullptr;
+}
+
+bool cpuSupports(KernelIsa isa)
+{
+    if (isa == KernelIsa::base)
+        return true;
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+    // These check the OS support for the wider registers too
+    if (isa == KernelIsa::avx2)
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    if (isa == KernelIsa::avx512)
+        // The Skylake-X set, which is what /arch:AVX512 means to MSVC
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") &&
+               __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vl") &&
+               __builtin_cpu_supports("avx512dq") && __builtin_cpu_supports("avx512bw");
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    if (isa == KernelIsa::avx2 || isa == KernelIsa::avx512)
+        return msvcSupports(isa);
+#endif
+    return false;
+}
+
+const VoiceKernels &voiceKernels()
+{
+    auto k = current.load(std::memory_order_relaxed);
+    return k ? *k : *baseVoiceKernels();
+}
+
+bool useVoiceKernels(KernelIsa isa)
+{
+    auto k = compiledVoiceKernels(isa);
+    if (!k || !cpuSupports(isa))
+        return false;
+    current.store(k, std::memory_order_relaxed);
+    return true;
+}
+
+const VoiceKernels &selectVoiceKernels()
+{
+    // The best we can run, or the best at or below what CLAP_SAW_DEMO_ISA asks for
+    auto top = (int)KernelIsa::nIsas - 1;
+    if (auto env = getenv("CLAP_SAW_DEMO_ISA"))
+    {
+        for (int i = 0; i < (int)KernelIsa::nIsas; ++i)
+        {
+            auto k = compiledVoiceKernels((KernelIsa)i);
+            auto name = i == 0 ? "base" : (i == 1 ? "avx2" : "avx512");
+            if (strcmp(env, name) == 0 || (k && strcmp(env, k->name) == 0))
+                top = i;
+        }
+    }
+
+    for (int i = top; i > 0; --i)
+    {
+        if (useVoiceKernels((KernelIsa)i))
+            return voiceKernels();
+    }
+    useVoiceKernels(KernelIsa::base);
+    return voiceKernels();
+}
+} // namespace sst::clap_saw_demo
@@ -0,0 +1,88 @@
+/*
+ * ClapSawDemo
+ * https://github.com/surge-synthesizer/clap-saw-demo
+ *
+ * Copyright 2022 Paul Walker and others as listed in the git history
+ *
+ * Released under the MIT License. See LICENSE.md for full text.
+ */
+
+#ifndef CLAP_SAW_DEMO_VOICE_KERNELS_H
+#define CLAP_SAW_DEMO_VOICE_KERNELS_H
+
+/*
+ * The three loops the voices spend their time in (the unison saws, the filter batch and
+ * adding a batch to the output) are built once per instruction set and picked at run time,
+ * since one binary has to run on anything from an SSE2-only machine to an AVX-512
+ * workstation.
+ *
+ * The source of each kernel is written once, in voice-kernels-impl.h. Each of
+ * voice-kernels-base.cpp, -avx2.cpp and -avx512.cpp includes it in its own namespace and is
+ * compiled with its own flags (see CMakeLists.txt). The base build is SSE2 on x86 and NEON
+ * on ARM. AVX2 runs the 8 lanes of a filter batch in one 256 bit register and the unison
+ * sums 4 doubles wide. AVX-512 sums the unison 8 doubles wide and otherwise gets the wider
+ * register file. On other targets, or when the compiler wasn't given the flags, the AVX
+ * variants compile to nothing and aren't offered.
+ *
+ * selectVoiceKernels picks the best variant the CPU supports (cpuid, including the OS
+ * saving the wider registers) and ClapSawDemo::activate calls it. Setting the environment
+ * variable CLAP_SAW_DEMO_ISA to base, avx2 or avx512 asks for a particular variant, for
+ * testing. A variant the CPU or the build can't run falls back to the best one below it.
+ *
+ * The variants don't agree to the bit. They add in different orders and may fuse multiplies
+ * and adds, so expect differences around 1e-6 of full scale. The choice is process wide
+ * and stays put while audio runs, so a render is consistent with itself, and live and
+ * offline renders (see ClapSawDemo::renderSetMode) still match exactly.
+ */
+
+#include "filter-models.h"
+#include <cstdint>
+
+namespace sst::clap_saw_demo
+{
+struct VoiceKernels
+{
+    const char *name;
+
+    /*
+     * n samples of a voice's unison saws. phase, dPhase, gainL and gainR hold unisonPadded
+     * entries (a multiple of SawDemoVoice::uni_lanes) and phase is advanced. Each sample is
+     * the gain weighted sum of the saws times amp[s].
+     */
+    void (*saw)(double *phase, const double *dPhase, const float *gainL, const float *gainR,
+                int unisonPadded, const float *amp, float *outL, float *outR, int n);
+
+    // processFilterBatch; see filter-models.h
+    void (*filterBatch)(StereoFilter *const *filters, int count,
+                        float (*io)[StereoFilter::batchLanes], int n);
+
+    /*
+     * Add voice 'voice' of a batch (lanes 2 * voice and 2 * voice + 1 of io) for n samples
+     * to a bus from sample 'at'. A mono bus gets the average of the two.
+     */
+    void (*addVoice)(float *const *bus, uint32_t chans, uint32_t at,
+                     const float (*io)[StereoFilter::batchLanes], int voice, int n);
+};
+
+enum class KernelIsa
+{
+    base,
+    avx2,
+    avx512,
+    nIsas
+};
+
+// The variant compiled for isa, or nullptr if this build doesn't have it
+const VoiceKernels *compiledVoiceKernels(KernelIsa isa);
+// Can this CPU (and OS) run it
+bool cpuSupports(KernelIsa isa);
+
+// The variant in use. Until the first selectVoiceKernels that is the base one.
+const VoiceKernels &voiceKernels();
+// Choose and install the variant to use, as described above, and return it
+const VoiceKernels &selectVoiceKernels();
+// Install a particular variant, if it is compiled in and supported, for tools
+bool useVoiceKernels(KernelIsa isa);
+} // namespace sst::clap_saw_demo
+
+#endif // CLAP_SAW_DEMO_VOICE_KERNELS_H